@@ -0,0 +1,525 @@
+#define _GNU_SOURCE
+#include "include/willis.h"
+#include "include/willis_x11.h"
+#include "common/willis_private.h"
+#include "nix/nix.h"
+#include "nix/nix_registry.h"
+#include "nix/nix_table.h"
+#include "x11/x11.h"
+
+#include <linux/perf_event.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <xcb/xcb.h>
+#include <xcb/xinput.h>
+#include <xcb/xkb.h>
+#include <xkbcommon/xkbcommon.h>
+#include <xkbcommon/xkbcommon-compose.h>
+
+// replays synthesised xcb event streams through willis without an X server,
+// the output can be saved and given back as a baseline to compare against
+
+#define BENCH_EVENTS 4096
+#define BENCH_ROUNDS 256
+#define BENCH_XKB_EVENT 85
+#define BENCH_XKB_DEVICE 3
+#define BENCH_NAME_SIZE 32
+
+// evdev keycodes of the letter and digit rows
+#define BENCH_KEYCODE_FIRST 10
+#define BENCH_KEYCODE_LAST 58
+#define BENCH_KEYCODE_GRAVE 49
+#define BENCH_KEYCODE_E 26
+
+// a single sequence is enough to keep the compose state machine busy
+static const char bench_compose[] =
+	"<grave> <e> : \"\xc3\xa8\" egrave\n";
+
+// xinput2 raw motion events are followed by their valuators
+struct bench_raw_motion
+{
+	xcb_input_raw_motion_event_t header;
+	uint32_t mask;
+	xcb_input_fp3232_t values[2];
+	xcb_input_fp3232_t values_raw[2];
+};
+
+union bench_event
+{
+	xcb_generic_event_t generic;
+	xcb_key_press_event_t key;
+	xcb_button_press_event_t button;
+	xcb_motion_notify_event_t motion;
+	struct bench_raw_motion raw;
+	xcb_xkb_state_notify_event_t xkb;
+};
+
+struct bench_stream
+{
+	const char* name;
+	bool compose;
+	union bench_event* events;
+	void* pointers[BENCH_EVENTS];
+};
+
+struct bench_perf
+{
+	int cycles;
+	int instructions;
+};
+
+struct bench_result
+{
+	char name[BENCH_NAME_SIZE];
+	double ns;
+	double allocations;
+	double cycles;
+	double instructions;
+};
+
+static int perf_open(
+	uint64_t config)
+{
+	struct perf_event_attr attr = {0};
+
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof (struct perf_event_attr);
+	attr.config = config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t perf_read(
+	int fd)
+{
+	uint64_t value = 0;
+
+	if (fd < 0)
+	{
+		return 0;
+	}
+
+	if (read(fd, &value, sizeof (uint64_t)) != sizeof (uint64_t))
+	{
+		return 0;
+	}
+
+	return value;
+}
+
+static void perf_toggle(
+	struct bench_perf* perf,
+	bool enable)
+{
+	unsigned long request = PERF_EVENT_IOC_DISABLE;
+
+	if (enable == true)
+	{
+		request = PERF_EVENT_IOC_ENABLE;
+
+		if (perf->cycles >= 0)
+		{
+			ioctl(perf->cycles, PERF_EVENT_IOC_RESET, 0);
+		}
+
+		if (perf->instructions >= 0)
+		{
+			ioctl(perf->instructions, PERF_EVENT_IOC_RESET, 0);
+		}
+	}
+
+	if (perf->cycles >= 0)
+	{
+		ioctl(perf->cycles, request, 0);
+	}
+
+	if (perf->instructions >= 0)
+	{
+		ioctl(perf->instructions, request, 0);
+	}
+}
+
+static void fill_key(
+	union bench_event* event,
+	uint8_t type,
+	xcb_keycode_t keycode,
+	uint32_t i)
+{
+	event->key.response_type = type;
+	event->key.detail = keycode;
+	event->key.sequence = i;
+	event->key.time = i;
+}
+
+static void fill_stream(
+	struct bench_stream* stream,
+	const char* name)
+{
+	stream->name = name;
+	stream->compose = (strcmp(name, "key_press_compose") == 0);
+
+	for (uint32_t i = 0; i < BENCH_EVENTS; ++i)
+	{
+		union bench_event* event = &(stream->events[i]);
+		uint32_t keys = BENCH_KEYCODE_LAST - BENCH_KEYCODE_FIRST + 1;
+		xcb_keycode_t keycode = BENCH_KEYCODE_FIRST + (i % keys);
+
+		union bench_event zero = {0};
+		*event = zero;
+		stream->pointers[i] = event;
+
+		if (strcmp(name, "key_press") == 0)
+		{
+			fill_key(event, XCB_KEY_PRESS, keycode, i);
+		}
+		else if (strcmp(name, "key_press_compose") == 0)
+		{
+			// alternate composed sequences and regular keys
+			switch (i % 4)
+			{
+				case 0:
+				{
+					keycode = BENCH_KEYCODE_GRAVE;
+					break;
+				}
+				case 1:
+				{
+					keycode = BENCH_KEYCODE_E;
+					break;
+				}
+				default:
+				{
+					break;
+				}
+			}
+
+			fill_key(event, XCB_KEY_PRESS, keycode, i);
+		}
+		else if (strcmp(name, "key_release") == 0)
+		{
+			fill_key(event, XCB_KEY_RELEASE, keycode, i);
+		}
+		else if (strcmp(name, "button") == 0)
+		{
+			if ((i % 2) == 0)
+			{
+				event->button.response_type = XCB_BUTTON_PRESS;
+			}
+			else
+			{
+				event->button.response_type = XCB_BUTTON_RELEASE;
+			}
+
+			event->button.detail = XCB_BUTTON_INDEX_1 + ((i / 2) % 5);
+			event->button.time = i;
+		}
+		else if (strcmp(name, "motion") == 0)
+		{
+			event->motion.response_type = XCB_MOTION_NOTIFY;
+			event->motion.event_x = i % 1920;
+			event->motion.event_y = i % 1080;
+			event->motion.time = i;
+		}
+		else if (strcmp(name, "raw_motion") == 0)
+		{
+			event->raw.header.response_type = XCB_GE_GENERIC;
+			event->raw.header.event_type = XCB_INPUT_RAW_MOTION;
+			event->raw.header.valuators_len = 1;
+			event->raw.header.time = i;
+			event->raw.mask = 0x3;
+			event->raw.values_raw[0].integral = ((int32_t) (i % 7)) - 3;
+			event->raw.values_raw[1].integral = ((int32_t) (i % 5)) - 2;
+			event->raw.values[0] = event->raw.values_raw[0];
+			event->raw.values[1] = event->raw.values_raw[1];
+		}
+		else if (strcmp(name, "xkb_state") == 0)
+		{
+			event->xkb.response_type = BENCH_XKB_EVENT;
+			event->xkb.xkbType = XCB_XKB_STATE_NOTIFY;
+			event->xkb.deviceID = BENCH_XKB_DEVICE;
+			event->xkb.time = i;
+			event->xkb.baseMods = i % 2; // shift on and off
+		}
+	}
+}
+
+static void run_stream(
+	struct willis* willis,
+	struct willis_xkb* xkb_common,
+	struct xkb_compose_state* compose_state,
+	struct bench_stream* stream,
+	struct bench_perf* perf,
+	struct bench_result* result)
+{
+	struct willis_event_info info;
+	struct willis_error_info error;
+	struct willis_stats stats_start;
+	struct willis_stats stats_end;
+
+	xkb_common->compose_state = NULL;
+
+	if (stream->compose == true)
+	{
+		xkb_common->compose_state = compose_state;
+	}
+
+	// warm the caches up once
+	for (size_t i = 0; i < BENCH_EVENTS; ++i)
+	{
+		willis_handle_event(willis, stream->pointers[i], &info, &error);
+		free(info.utf8_string);
+	}
+
+	willis_get_stats(willis, &stats_start, &error);
+	perf_toggle(perf, true);
+
+	uint64_t start = willis_get_time_ns();
+
+	for (size_t round = 0; round < BENCH_ROUNDS; ++round)
+	{
+		for (size_t i = 0; i < BENCH_EVENTS; ++i)
+		{
+			willis_handle_event(willis, stream->pointers[i], &info, &error);
+			free(info.utf8_string);
+		}
+	}
+
+	uint64_t end = willis_get_time_ns();
+
+	perf_toggle(perf, false);
+	willis_get_stats(willis, &stats_end, &error);
+
+	double count = BENCH_EVENTS * BENCH_ROUNDS;
+
+	snprintf(result->name, BENCH_NAME_SIZE, "%s", stream->name);
+	result->ns = (end - start) / count;
+	result->allocations = (stats_end.allocations - stats_start.allocations) / count;
+	result->cycles = perf_read(perf->cycles) / count;
+	result->instructions = perf_read(perf->instructions) / count;
+}
+
+static bool baseline_find(
+	FILE* baseline,
+	const char* name,
+	double* ns)
+{
+	char line[256];
+	char line_name[BENCH_NAME_SIZE];
+
+	rewind(baseline);
+
+	while (fgets(line, sizeof (line), baseline) != NULL)
+	{
+		if ((sscanf(line, "%31s %lf", line_name, ns) == 2)
+		&& (strcmp(line_name, name) == 0))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int main(
+	int argc,
+	char** argv)
+{
+	struct willis_error_info error = {0};
+	struct willis_config_backend config = {0};
+	FILE* baseline = NULL;
+
+	if (argc > 1)
+	{
+		baseline = fopen(argv[1], "r");
+
+		if (baseline == NULL)
+		{
+			fprintf(stderr, "could not open baseline %s\n", argv[1]);
+			return 1;
+		}
+	}
+
+	// bind the x11 backend without starting it, we set up xkb ourselves
+	willis_prepare_init_x11(&config);
+
+	struct willis* willis = willis_init(&config, &error);
+
+	if (willis_error_get_code(&error) != WILLIS_ERROR_OK)
+	{
+		return 1;
+	}
+
+	struct x11_backend* backend = willis->backend_data;
+	struct willis_xkb* xkb_common = backend->xkb_common;
+
+	backend->xkb_event = BENCH_XKB_EVENT;
+	backend->xkb_device_id = BENCH_XKB_DEVICE;
+
+	// taken from the registry, which willis_stop gives it back to
+	willis_xkb_registry_lock();
+	xkb_common->context = willis_xkb_registry_context_acquire();
+	willis_xkb_registry_unlock();
+
+	if (xkb_common->context == NULL)
+	{
+		fprintf(stderr, "could not create the xkb context\n");
+		return 1;
+	}
+
+	struct xkb_rule_names names =
+	{
+		.rules = "evdev",
+		.model = "pc105",
+		.layout = "us",
+		.variant = NULL,
+		.options = NULL,
+	};
+
+	xkb_common->keymap =
+		xkb_keymap_new_from_names(
+			xkb_common->context,
+			&names,
+			XKB_KEYMAP_COMPILE_NO_FLAGS);
+
+	if (xkb_common->keymap == NULL)
+	{
+		fprintf(stderr, "could not compile the us keymap\n");
+		return 1;
+	}
+
+	xkb_common->state = xkb_state_new(xkb_common->keymap);
+
+	struct xkb_compose_table* compose_table =
+		xkb_compose_table_new_from_buffer(
+			xkb_common->context,
+			bench_compose,
+			(sizeof (bench_compose)) - 1,
+			"C",
+			XKB_COMPOSE_FORMAT_TEXT_V1,
+			XKB_COMPOSE_COMPILE_NO_FLAGS);
+
+	if (compose_table == NULL)
+	{
+		fprintf(stderr, "could not compile the compose table\n");
+		return 1;
+	}
+
+	// without a prefix set every key goes through the compose state
+	struct willis_xkb_trie compose_trie = {0};
+	uint64_t compose_prefix[WILLIS_XKB_COMPOSE_PREFIX_BITS / 64] = {0};
+
+	// the registry owns the compose table, willis_stop releases it and the state
+	willis_xkb_registry_lock();
+
+	xkb_common->compose_shared =
+		willis_xkb_registry_compose_add(
+			"C",
+			false,
+			compose_table,
+			&compose_trie,
+			compose_prefix,
+			false);
+
+	willis_xkb_registry_unlock();
+
+	if (xkb_common->compose_shared == NULL)
+	{
+		fprintf(stderr, "could not share the compose table\n");
+		return 1;
+	}
+
+	xkb_common->compose_table = compose_table;
+
+	struct xkb_compose_state* compose_state =
+		xkb_compose_state_new(
+			compose_table,
+			XKB_COMPOSE_STATE_NO_FLAGS);
+
+	struct bench_perf perf =
+	{
+		.cycles = perf_open(PERF_COUNT_HW_CPU_CYCLES),
+		.instructions = perf_open(PERF_COUNT_HW_INSTRUCTIONS),
+	};
+
+	const char* names_stream[] =
+	{
+		"key_press",
+		"key_press_compose",
+		"key_release",
+		"button",
+		"motion",
+		"raw_motion",
+		"xkb_state",
+	};
+
+	size_t count = (sizeof (names_stream)) / (sizeof (names_stream[0]));
+
+	struct bench_stream stream;
+	stream.events = malloc(BENCH_EVENTS * (sizeof (union bench_event)));
+
+	if (stream.events == NULL)
+	{
+		return 1;
+	}
+
+	printf("# stream ns/event allocations/event cycles/event instructions/event\n");
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		struct bench_result result;
+		double ns_baseline;
+
+		fill_stream(&stream, names_stream[i]);
+		run_stream(willis, xkb_common, compose_state, &stream, &perf, &result);
+
+		printf(
+			"%s %.2f %.3f %.1f %.1f",
+			result.name,
+			result.ns,
+			result.allocations,
+			result.cycles,
+			result.instructions);
+
+		if ((baseline != NULL)
+		&& (baseline_find(baseline, result.name, &ns_baseline) == true)
+		&& (ns_baseline > 0))
+		{
+			printf(" # %+.1f%%", ((result.ns / ns_baseline) - 1.0) * 100.0);
+		}
+
+		printf("\n");
+	}
+
+	// cleanup
+	free(stream.events);
+	xkb_common->compose_state = compose_state;
+
+	if (perf.cycles >= 0)
+	{
+		close(perf.cycles);
+	}
+
+	if (perf.instructions >= 0)
+	{
+		close(perf.instructions);
+	}
+
+	if (baseline != NULL)
+	{
+		fclose(baseline);
+	}
+
+	willis_stop(willis, &error);
+	willis_clean(willis, &error);
+
+	return 0;
+}
@@ -0,0 +1,163 @@
+#!/bin/bash
+
+# get into the script's folder
+cd "$(dirname "$0")" || exit
+cd ../..
+
+# params
+build=$1
+
+echo "syntax reminder: $0 <build type>"
+echo "build types: development, release"
+
+# utilitary variables
+tag=$(git tag --sort v:refname | tail -n 1)
+output="make/output"
+
+# ninja file variables
+folder_ninja="build"
+folder_objects="\$builddir/obj"
+folder_willis="willis_bin_$tag"
+folder_library="\$folder_willis/lib/willis"
+name="willis_bench_x11"
+cc="gcc"
+
+# compiler flags
+flags+=("-std=c99" "-pedantic")
+flags+=("-Wall" "-Wextra" "-Werror=vla" "-Werror")
+flags+=("-Wformat")
+flags+=("-Wformat-security")
+flags+=("-Wno-address-of-packed-member")
+flags+=("-Wno-unused-parameter")
+flags+=("-Wno-unused-variable")
+flags+=("-Isrc")
+flags+=("-Isrc/include")
+flags+=("-fdiagnostics-color=always")
+
+# customize depending on the chosen build type
+if [ -z "$build" ]; then
+	build=release
+fi
+
+case $build in
+	development)
+flags+=("-g")
+flags+=("-O2")
+	;;
+
+	release)
+flags+=("-O2")
+	;;
+
+	*)
+echo "invalid build type"
+exit 1
+	;;
+esac
+
+# list link flags (order matters)
+link+=("-lxcb")
+link+=("-lxcb-xfixes")
+link+=("-lxcb-xinput")
+link+=("-lxcb-xkb")
+link+=("-lxkbcommon")
+link+=("-lxkbcommon-x11")
+link+=("-lpthread")
+
+# benchmark
+ninja_file=bench_x11.ninja
+src+=("bench/x11.c")
+
+# ninja start
+mkdir -p "$output"
+
+{ \
+echo "# vars"; \
+echo "builddir = $folder_ninja"; \
+echo "folder_objects = $folder_objects"; \
+echo "folder_willis = $folder_willis"; \
+echo "folder_library = $folder_library"; \
+echo "name = $name"; \
+echo "cc = $cc"; \
+echo ""; \
+} > "$output/$ninja_file"
+
+# ninja flags
+echo "# flags" >> "$output/$ninja_file"
+
+echo -n "flags =" >> "$output/$ninja_file"
+for flag in "${flags[@]}"; do
+	echo -ne " \$\n$flag" >> "$output/$ninja_file"
+done
+echo -e "\n" >> "$output/$ninja_file"
+
+echo -n "link =" >> "$output/$ninja_file"
+for flag in "${link[@]}"; do
+	echo -ne " \$\n$flag" >> "$output/$ninja_file"
+done
+echo -e "\n" >> "$output/$ninja_file"
+
+# ninja rules
+{ \
+echo "# rules"; \
+echo "rule cc"; \
+echo "    deps = $cc"; \
+echo "    depfile = \$out.d"; \
+echo "    command = \$cc \$flags -MMD -MF \$out.d -c \$in -o \$out"; \
+echo "    description = cc \$out"; \
+echo ""; \
+} >> "$output/$ninja_file"
+
+{ \
+echo "rule link"; \
+echo "    command = \$cc -o \$out \$in \$link"; \
+echo "    description = link \$out"; \
+echo ""; \
+} >> "$output/$ninja_file"
+
+{ \
+echo "rule run"; \
+echo "    command = ./\$in"; \
+echo "    description = run \$in"; \
+echo "    pool = console"; \
+echo ""; \
+} >> "$output/$ninja_file"
+
+{ \
+echo "rule generator"; \
+echo "    command = make/bench/x11.sh $build"; \
+echo "    description = re-generating the ninja build file"; \
+echo ""; \
+} >> "$output/$ninja_file"
+
+# ninja targets
+## compile sources
+echo "# compile sources" >> "$output/$ninja_file"
+for file in "${src[@]}"; do
+	folder=$(dirname "$file")
+	filename=$(basename "$file" .c)
+	obj+=("\$folder_objects/$folder/$filename.o")
+	{ \
+	echo "build \$folder_objects/$folder/$filename.o: \$"; \
+	echo "cc $file"; \
+	echo ""; \
+	} >> "$output/$ninja_file"
+done
+
+## link against the willis core and backend (order matters)
+echo "# link benchmark" >> "$output/$ninja_file"
+echo -n "build \$builddir/\$name: link" >> "$output/$ninja_file"
+for file in "${obj[@]}"; do
+	echo -ne " \$\n$file" >> "$output/$ninja_file"
+done
+echo -ne " \$\n\$folder_library/x11/willis_x11.a" >> "$output/$ninja_file"
+echo -ne " \$\n\$folder_library/willis_elf.a" >> "$output/$ninja_file"
+echo -e "\n" >> "$output/$ninja_file"
+
+## special targets
+{ \
+echo "# run special targets"; \
+echo "build run: run \$builddir/\$name"; \
+echo "build regen: generator"; \
+echo "default \$builddir/\$name"; \
+} >> "$output/$ninja_file"
@@ -139,6 +139,10 @@ esac
 ninja_file=lib_macho.ninja
 src+=("src/common/willis.c")
 src+=("src/common/willis_error.c")
+src+=("src/common/willis_latency.c")
+src+=("src/common/willis_trace.c")
+src+=("src/common/willis_queue.c")
+src+=("src/common/willis_time.c")
 
 # default target
 default+=("\$folder_library/\$name.a")
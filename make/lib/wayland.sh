@@ -44,6 +44,17 @@ flags+=("-fdiagnostics-color=always")
 #defines+=("-DWILLIS_ERROR_SKIP")
 defines+=("-DWILLIS_ERROR_LOG_DEBUG")
 
+# the keymap disk cache is invalidated when xkbcommon changes
+xkb_version=$(pkg-config --modversion xkbcommon 2> /dev/null)
+if [ -n "$xkb_version" ]; then
+	defines+=("-DWILLIS_XKB_VERSION=\\\"$xkb_version\\\"")
+fi
+
+# listing the compose sequences needs xkbcommon 1.6
+if pkg-config --atleast-version=1.6.0 xkbcommon 2> /dev/null; then
+	defines+=("-DWILLIS_XKB_COMPOSE_ITERATOR")
+fi
+
 # customize depending on the chosen build type
 if [ -z "$build" ]; then
 	build=development
@@ -118,6 +129,8 @@ esac
 # backend
 ninja_file=lib_wayland.ninja
 src+=("src/nix/nix.c")
+src+=("src/nix/nix_table.c")
+src+=("src/nix/nix_registry.c")
 src+=("src/wayland/wayland.c")
 src+=("src/wayland/wayland_helpers.c")
 src+=("res/wayland_headers/zwp-relative-pointer-protocol.c")
@@ -218,6 +231,15 @@ echo "    description = re-generating the ninja build file"; \
 echo ""; \
 } >> "$output/$ninja_file"
 
+{ \
+echo "rule amalgamate"; \
+echo "    deps = gcc"; \
+echo "    depfile = \$out.d"; \
+echo "    command = make/scripts/amalgamate.sh wayland \$out"; \
+echo "    description = amalgamate \$out"; \
+echo ""; \
+} >> "$output/$ninja_file"
+
 # ninja targets
 ## copy headers
 { \
@@ -233,6 +255,25 @@ echo "\$folder_include/willis_wayland.h"; \
 echo ""; \
 } >> "$output/$ninja_file"
 
+## single translation unit
+{ \
+echo "# single translation unit"; \
+echo "build \$folder_willis/amalgamation/willis_wayland.c: amalgamate \$"; \
+echo "| make/scripts/amalgamate.sh"; \
+echo ""; \
+echo "build \$folder_willis/amalgamation/willis.h: \$"; \
+echo "cp src/include/willis.h"; \
+echo ""; \
+echo "build \$folder_willis/amalgamation/willis_wayland.h: \$"; \
+echo "cp src/include/willis_wayland.h"; \
+echo ""; \
+echo "build amalgamation: phony \$"; \
+echo "\$folder_willis/amalgamation/willis_wayland.c \$"; \
+echo "\$folder_willis/amalgamation/willis.h \$"; \
+echo "\$folder_willis/amalgamation/willis_wayland.h"; \
+echo ""; \
+} >> "$output/$ninja_file"
+
 ## compile sources
 echo "# compile sources" >> "$output/$ninja_file"
 for file in "${src[@]}"; do
@@ -220,6 +220,15 @@ echo "    description = re-generating the ninja build file"; \
 echo ""; \
 } >> "$output/$ninja_file"
 
+{ \
+echo "rule amalgamate"; \
+echo "    deps = gcc"; \
+echo "    depfile = \$out.d"; \
+echo "    command = make/scripts/amalgamate.sh win \$out"; \
+echo "    description = amalgamate \$out"; \
+echo ""; \
+} >> "$output/$ninja_file"
+
 # ninja targets
 ## copy headers
 { \
@@ -235,6 +244,25 @@ echo "\$folder_include/willis_win.h"; \
 echo ""; \
 } >> "$output/$ninja_file"
 
+## single translation unit
+{ \
+echo "# single translation unit"; \
+echo "build \$folder_willis/amalgamation/willis_win.c: amalgamate \$"; \
+echo "| make/scripts/amalgamate.sh"; \
+echo ""; \
+echo "build \$folder_willis/amalgamation/willis.h: \$"; \
+echo "cp src/include/willis.h"; \
+echo ""; \
+echo "build \$folder_willis/amalgamation/willis_win.h: \$"; \
+echo "cp src/include/willis_win.h"; \
+echo ""; \
+echo "build amalgamation: phony \$"; \
+echo "\$folder_willis/amalgamation/willis_win.c \$"; \
+echo "\$folder_willis/amalgamation/willis.h \$"; \
+echo "\$folder_willis/amalgamation/willis_win.h"; \
+echo ""; \
+} >> "$output/$ninja_file"
+
 ## compile sources
 echo "# compile sources" >> "$output/$ninja_file"
 for file in "${src[@]}"; do
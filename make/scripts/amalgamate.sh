@@ -0,0 +1,171 @@
+#!/bin/bash
+
+# get in the right folder
+path="$(pwd)/$0"
+folder=$(dirname "$path")
+cd "$folder"/../.. || exit
+
+# get params
+backend=$1
+output=$2
+
+if [ -z "$output" ]; then
+	echo "syntax reminder: $0 <backend> <output file>"
+	echo "backends: x11, wayland, win"
+	exit 1
+fi
+
+# sources in the order they are concatenated
+src+=("src/common/willis_error.c")
+src+=("src/common/willis_time.c")
+src+=("src/common/willis_queue.c")
+src+=("src/common/willis_latency.c")
+src+=("src/common/willis_trace.c")
+src+=("src/common/willis.c")
+
+case $backend in
+	x11)
+src+=("src/nix/nix.c")
+src+=("src/nix/nix_table.c")
+src+=("src/nix/nix_registry.c")
+src+=("src/x11/x11.c")
+src+=("src/x11/x11_helpers.c")
+	;;
+
+	wayland)
+src+=("src/nix/nix.c")
+src+=("src/nix/nix_table.c")
+src+=("src/nix/nix_registry.c")
+src+=("src/wayland/wayland.c")
+src+=("src/wayland/wayland_helpers.c")
+src+=("res/wayland_headers/zwp-relative-pointer-protocol.c")
+src+=("res/wayland_headers/zwp-pointer-constraints-protocol.c")
+	;;
+
+	win)
+src+=("src/win/win.c")
+src+=("src/win/win_helpers.c")
+	;;
+
+	*)
+echo "invalid backend: $backend"
+exit 1
+	;;
+esac
+
+# private headers are looked up like the compiler would
+search+=("src")
+search+=("res/wayland_headers")
+
+declare -A inlined
+deps=()
+
+# public headers are included as-is and copied next to the amalgamation
+is_public()
+{
+	[ -f "src/include/$(basename "$1")" ] \
+		&& { [ "$1" = "$(basename "$1")" ] || [ "$1" = "include/$(basename "$1")" ]; }
+}
+
+resolve()
+{
+	for dir in "${search[@]}"; do
+		if [ -f "$dir/$1" ]; then
+			echo "$dir/$1"
+			return
+		fi
+	done
+}
+
+inline_file()
+{
+	local file=$1
+	local number=0
+	local line
+	local header
+
+	deps+=("$file")
+	echo "#line 1 \"$file\""
+
+	while IFS= read -r line || [ -n "$line" ]; do
+		number=$((number + 1))
+
+		# feature test macros must come before any system header
+		if [[ $line =~ ^#define\ _(GNU|XOPEN)_SOURCE ]]; then
+			echo ""
+			continue
+		fi
+
+		if [[ $line =~ ^#include\ \"(.*)\" ]]; then
+			if is_public "${BASH_REMATCH[1]}"; then
+				echo "#include \"$(basename "${BASH_REMATCH[1]}")\""
+				continue
+			fi
+
+			header=$(resolve "${BASH_REMATCH[1]}")
+
+			if [ -z "$header" ]; then
+				echo "could not find $line in $file" >&2
+				exit 1
+			fi
+
+			if [ -z "${inlined[$header]}" ]; then
+				inlined[$header]=1
+				inline_file "$header"
+				echo "#line $((number + 1)) \"$file\""
+			else
+				echo ""
+			fi
+
+			continue
+		fi
+
+		echo "$line"
+	done < "$file"
+}
+
+mkdir -p "$(dirname "$output")"
+
+{ \
+echo "// willis amalgamation for the $backend backend"; \
+echo "// generated by make/scripts/amalgamate.sh, do not edit"; \
+echo ""; \
+echo "#define _GNU_SOURCE"; \
+echo "#define _XOPEN_SOURCE 700"; \
+echo ""; \
+echo "// bind the entry points to the backend at compile-time"; \
+echo "#if defined(WILLIS_STATIC_BACKEND)"; \
+echo "	#undef WILLIS_STATIC_BACKEND"; \
+echo "	#define WILLIS_STATIC_BACKEND $backend"; \
+} > "$output.tmp"
+
+if grep -q "willis_${backend}_handle_events(" src/"$backend"/*.c; then
+	echo "	#define WILLIS_STATIC_BACKEND_BATCH" >> "$output.tmp"
+fi
+
+if grep -q "willis_${backend}_mouse_grab_poll(" src/"$backend"/*.c; then
+	echo "	#define WILLIS_STATIC_BACKEND_GRAB_POLL" >> "$output.tmp"
+fi
+
+if grep -q "willis_${backend}_window_attach(" src/"$backend"/*.c; then
+	echo "	#define WILLIS_STATIC_BACKEND_WINDOWS" >> "$output.tmp"
+fi
+
+{ \
+echo "#endif"; \
+echo ""; \
+} >> "$output.tmp"
+
+for file in "${src[@]}"; do
+	inline_file "$file" >> "$output.tmp" || exit 1
+	echo "" >> "$output.tmp"
+done
+
+mv "$output.tmp" "$output"
+
+# make-style depfile for ninja
+echo -n "$output:" > "$output.d"
+for file in "${deps[@]}"; do
+	echo -ne " \\\\\n $file" >> "$output.d"
+done
+echo "" >> "$output.d"
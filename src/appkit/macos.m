@@ -64,13 +64,20 @@ void willis_appkit_handle_event(
 	event_info->event_state = event_state;
 	event_info->utf8_string = NULL;
 	event_info->utf8_size = 0;
+	event_info->utf8_buffer[0] = '\0';
+	event_info->utf8_overflow = false;
 	event_info->mouse_x = 0;
 	event_info->mouse_y = 0;
 	event_info->diff_x = 0;
 	event_info->diff_y = 0;
+	event_info->mouse_raw = false;
+	event_info->seat = 0;
+	event_info->device = 0;
+	event_info->window = 0;
 
 	// handle event
 	NSEvent* nsevent = (NSEvent*) event;
+	event_info->time_native_ns = [nsevent timestamp] * 1000000000.0;
 	NSEventType type = [nsevent type];
 
 	switch (type)
@@ -178,6 +185,7 @@ void willis_appkit_handle_event(
 
 				event_info->event_code = WILLIS_MOUSE_MOTION;
 				event_info->event_state = WILLIS_STATE_NONE;
+				event_info->mouse_raw = true;
 				event_info->diff_x = diff_x;
 				event_info->diff_y = diff_y;
 			}
@@ -198,8 +206,12 @@ void willis_appkit_handle_event(
 			id string = [nsevent characters];
 			const char* str = [string UTF8String];
 
-			event_info->utf8_string = strdup(str);
-			event_info->utf8_size = strlen(str);
+			willis_utf8_store(
+				context,
+				event_info,
+				str,
+				strlen(str),
+				error);
 
 			break;
 		}
@@ -217,8 +229,12 @@ void willis_appkit_handle_event(
 			id string = [nsevent characters];
 			const char* str = [string UTF8String];
 
-			event_info->utf8_string = strdup(str);
-			event_info->utf8_size = strlen(str);
+			willis_utf8_store(
+				context,
+				event_info,
+				str,
+				strlen(str),
+				error);
 
 			break;
 		}
@@ -377,8 +393,11 @@ void willis_prepare_init_appkit(
 	config->init = willis_appkit_init;
 	config->start = willis_appkit_start;
 	config->handle_event = willis_appkit_handle_event;
+	config->handle_events = NULL;
 	config->mouse_grab = willis_appkit_mouse_grab;
 	config->mouse_ungrab = willis_appkit_mouse_ungrab;
+	config->window_attach = NULL;
+	config->window_detach = NULL;
 	config->stop = willis_appkit_stop;
 	config->clean = willis_appkit_clean;
 }
@@ -1,7 +1,26 @@
 #include "include/willis.h"
 #include "common/willis_private.h"
+#include "common/willis_latency.h"
+#include "common/willis_trace.h"
 
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+
+// names tables in read-only memory
+static const char* const event_code_names[WILLIS_CODE_COUNT] =
+{
+#define WILLIS_KEYS_NAME(code, x11, win, appkit) [code] = #code,
+	WILLIS_KEYS(WILLIS_KEYS_NAME)
+#undef WILLIS_KEYS_NAME
+};
+
+static const char* const event_state_names[WILLIS_STATE_COUNT] =
+{
+	[WILLIS_STATE_NONE] =    "WILLIS_STATE_NONE",
+	[WILLIS_STATE_PRESS] =   "WILLIS_STATE_PRESS",
+	[WILLIS_STATE_RELEASE] = "WILLIS_STATE_RELEASE",
+};
 
 struct willis* willis_init(
 	struct willis_config_backend* config,
@@ -17,131 +36,11 @@ struct willis* willis_init(
 	struct willis zero = {0};
 	*context = zero;
 
-	willis_error_init(context);
-
 	context->backend_data = NULL;
 	context->backend_callbacks = *config;
-	context->backend_callbacks.init(context, error);
-
-	char** code_names = context->event_code_names;
-	code_names[WILLIS_NONE] =                 "WILLIS_NONE";
-	code_names[WILLIS_MOUSE_CLICK_LEFT] =     "WILLIS_MOUSE_CLICK_LEFT";
-	code_names[WILLIS_MOUSE_CLICK_RIGHT] =    "WILLIS_MOUSE_CLICK_RIGHT";
-	code_names[WILLIS_MOUSE_CLICK_MIDDLE] =   "WILLIS_MOUSE_CLICK_MIDDLE";
-	code_names[WILLIS_MOUSE_WHEEL_UP] =       "WILLIS_MOUSE_WHEEL_UP";
-	code_names[WILLIS_MOUSE_WHEEL_DOWN] =     "WILLIS_MOUSE_WHEEL_DOWN";
-	code_names[WILLIS_MOUSE_MOTION] =         "WILLIS_MOUSE_MOTION";
-	code_names[WILLIS_KEY_ESCAPE] =           "WILLIS_KEY_ESCAPE";
-	code_names[WILLIS_KEY_F1] =               "WILLIS_KEY_F1";
-	code_names[WILLIS_KEY_F2] =               "WILLIS_KEY_F2";
-	code_names[WILLIS_KEY_F3] =               "WILLIS_KEY_F3";
-	code_names[WILLIS_KEY_F4] =               "WILLIS_KEY_F4";
-	code_names[WILLIS_KEY_F5] =               "WILLIS_KEY_F5";
-	code_names[WILLIS_KEY_F6] =               "WILLIS_KEY_F6";
-	code_names[WILLIS_KEY_F7] =               "WILLIS_KEY_F7";
-	code_names[WILLIS_KEY_F8] =               "WILLIS_KEY_F8";
-	code_names[WILLIS_KEY_F9] =               "WILLIS_KEY_F9";
-	code_names[WILLIS_KEY_F10] =              "WILLIS_KEY_F10";
-	code_names[WILLIS_KEY_F11] =              "WILLIS_KEY_F11";
-	code_names[WILLIS_KEY_F12] =              "WILLIS_KEY_F12";
-	code_names[WILLIS_KEY_GRAVE] =            "WILLIS_KEY_GRAVE";
-	code_names[WILLIS_KEY_1] =                "WILLIS_KEY_1";
-	code_names[WILLIS_KEY_2] =                "WILLIS_KEY_2";
-	code_names[WILLIS_KEY_3] =                "WILLIS_KEY_3";
-	code_names[WILLIS_KEY_4] =                "WILLIS_KEY_4";
-	code_names[WILLIS_KEY_5] =                "WILLIS_KEY_5";
-	code_names[WILLIS_KEY_6] =                "WILLIS_KEY_6";
-	code_names[WILLIS_KEY_7] =                "WILLIS_KEY_7";
-	code_names[WILLIS_KEY_8] =                "WILLIS_KEY_8";
-	code_names[WILLIS_KEY_9] =                "WILLIS_KEY_9";
-	code_names[WILLIS_KEY_0] =                "WILLIS_KEY_0";
-	code_names[WILLIS_KEY_HYPHEN_MINUS] =     "WILLIS_KEY_HYPHEN_MINUS";
-	code_names[WILLIS_KEY_EQUALS] =           "WILLIS_KEY_EQUALS";
-	code_names[WILLIS_KEY_BACKSPACE] =        "WILLIS_KEY_BACKSPACE";
-	code_names[WILLIS_KEY_TAB] =              "WILLIS_KEY_TAB";
-	code_names[WILLIS_KEY_Q] =                "WILLIS_KEY_Q";
-	code_names[WILLIS_KEY_W] =                "WILLIS_KEY_W";
-	code_names[WILLIS_KEY_E] =                "WILLIS_KEY_E";
-	code_names[WILLIS_KEY_R] =                "WILLIS_KEY_R";
-	code_names[WILLIS_KEY_T] =                "WILLIS_KEY_T";
-	code_names[WILLIS_KEY_Y] =                "WILLIS_KEY_Y";
-	code_names[WILLIS_KEY_U] =                "WILLIS_KEY_U";
-	code_names[WILLIS_KEY_I] =                "WILLIS_KEY_I";
-	code_names[WILLIS_KEY_O] =                "WILLIS_KEY_O";
-	code_names[WILLIS_KEY_P] =                "WILLIS_KEY_P";
-	code_names[WILLIS_KEY_BRACKET_LEFT] =     "WILLIS_KEY_BRACKET_LEFT";
-	code_names[WILLIS_KEY_BRACKET_RIGHT] =    "WILLIS_KEY_BRACKET_RIGHT";
-	code_names[WILLIS_KEY_ANTISLASH] =        "WILLIS_KEY_ANTISLASH";
-	code_names[WILLIS_KEY_CAPS_LOCK] =        "WILLIS_KEY_CAPS_LOCK";
-	code_names[WILLIS_KEY_A] =                "WILLIS_KEY_A";
-	code_names[WILLIS_KEY_S] =                "WILLIS_KEY_S";
-	code_names[WILLIS_KEY_D] =                "WILLIS_KEY_D";
-	code_names[WILLIS_KEY_F] =                "WILLIS_KEY_F";
-	code_names[WILLIS_KEY_G] =                "WILLIS_KEY_G";
-	code_names[WILLIS_KEY_H] =                "WILLIS_KEY_H";
-	code_names[WILLIS_KEY_J] =                "WILLIS_KEY_J";
-	code_names[WILLIS_KEY_K] =                "WILLIS_KEY_K";
-	code_names[WILLIS_KEY_L] =                "WILLIS_KEY_L";
-	code_names[WILLIS_KEY_SEMICOLON] =        "WILLIS_KEY_SEMICOLON";
-	code_names[WILLIS_KEY_APOSTROPHE] =       "WILLIS_KEY_APOSTROPHE";
-	code_names[WILLIS_KEY_ENTER] =            "WILLIS_KEY_ENTER";
-	code_names[WILLIS_KEY_SHIFT_LEFT] =       "WILLIS_KEY_SHIFT_LEFT";
-	code_names[WILLIS_KEY_Z] =                "WILLIS_KEY_Z";
-	code_names[WILLIS_KEY_X] =                "WILLIS_KEY_X";
-	code_names[WILLIS_KEY_C] =                "WILLIS_KEY_C";
-	code_names[WILLIS_KEY_V] =                "WILLIS_KEY_V";
-	code_names[WILLIS_KEY_B] =                "WILLIS_KEY_B";
-	code_names[WILLIS_KEY_N] =                "WILLIS_KEY_N";
-	code_names[WILLIS_KEY_M] =                "WILLIS_KEY_M";
-	code_names[WILLIS_KEY_COMMA] =            "WILLIS_KEY_COMMA";
-	code_names[WILLIS_KEY_PERIOD] =           "WILLIS_KEY_PERIOD";
-	code_names[WILLIS_KEY_SLASH] =            "WILLIS_KEY_SLASH";
-	code_names[WILLIS_KEY_SHIFT_RIGHT] =      "WILLIS_KEY_SHIFT_RIGHT";
-	code_names[WILLIS_KEY_CTRL_LEFT] =        "WILLIS_KEY_CTRL_LEFT";
-	code_names[WILLIS_KEY_MOD_LEFT] =         "WILLIS_KEY_MOD_LEFT";
-	code_names[WILLIS_KEY_ALT_LEFT] =         "WILLIS_KEY_ALT_LEFT";
-	code_names[WILLIS_KEY_SPACE] =            "WILLIS_KEY_SPACE";
-	code_names[WILLIS_KEY_ALT_RIGHT] =        "WILLIS_KEY_ALT_RIGHT";
-	code_names[WILLIS_KEY_MOD_RIGHT] =        "WILLIS_KEY_MOD_RIGHT";
-	code_names[WILLIS_KEY_MENU] =             "WILLIS_KEY_MENU";
-	code_names[WILLIS_KEY_CTRL_RIGHT] =       "WILLIS_KEY_CTRL_RIGHT";
-	code_names[WILLIS_KEY_PRINT_SCREEN] =     "WILLIS_KEY_PRINT_SCREEN";
-#if 0
-	code_names[WILLIS_KEY_SCROLL_LOCK] =      "WILLIS_KEY_SCROLL_LOCK";
-	code_names[WILLIS_KEY_PAUSE] =            "WILLIS_KEY_PAUSE";
-#endif
-	code_names[WILLIS_KEY_INSERT] =           "WILLIS_KEY_INSERT";
-	code_names[WILLIS_KEY_DELETE] =           "WILLIS_KEY_DELETE";
-	code_names[WILLIS_KEY_HOME] =             "WILLIS_KEY_HOME";
-	code_names[WILLIS_KEY_END] =              "WILLIS_KEY_END";
-	code_names[WILLIS_KEY_PAGE_UP] =          "WILLIS_KEY_PAGE_UP";
-	code_names[WILLIS_KEY_PAGE_DOWN] =        "WILLIS_KEY_PAGE_DOWN";
-	code_names[WILLIS_KEY_UP] =               "WILLIS_KEY_UP";
-	code_names[WILLIS_KEY_DOWN] =             "WILLIS_KEY_DOWN";
-	code_names[WILLIS_KEY_LEFT] =             "WILLIS_KEY_LEFT";
-	code_names[WILLIS_KEY_RIGHT] =            "WILLIS_KEY_RIGHT";
-	code_names[WILLIS_KEY_NUM_LOCK] =         "WILLIS_KEY_NUM_LOCK";
-	code_names[WILLIS_KEY_NUM_SLASH] =        "WILLIS_KEY_NUM_SLASH";
-	code_names[WILLIS_KEY_NUM_ASTERISK] =     "WILLIS_KEY_NUM_ASTERISK";
-	code_names[WILLIS_KEY_NUM_HYPHEN_MINUS] = "WILLIS_KEY_NUM_HYPHEN_MINUS";
-	code_names[WILLIS_KEY_NUM_PLUS] =         "WILLIS_KEY_NUM_PLUS";
-	code_names[WILLIS_KEY_NUM_ENTER] =        "WILLIS_KEY_NUM_ENTER";
-	code_names[WILLIS_KEY_NUM_DELETE] =       "WILLIS_KEY_NUM_DELETE";
-	code_names[WILLIS_KEY_NUM_0] =            "WILLIS_KEY_NUM_0";
-	code_names[WILLIS_KEY_NUM_1] =            "WILLIS_KEY_NUM_1";
-	code_names[WILLIS_KEY_NUM_2] =            "WILLIS_KEY_NUM_2";
-	code_names[WILLIS_KEY_NUM_3] =            "WILLIS_KEY_NUM_3";
-	code_names[WILLIS_KEY_NUM_4] =            "WILLIS_KEY_NUM_4";
-	code_names[WILLIS_KEY_NUM_5] =            "WILLIS_KEY_NUM_5";
-	code_names[WILLIS_KEY_NUM_6] =            "WILLIS_KEY_NUM_6";
-	code_names[WILLIS_KEY_NUM_7] =            "WILLIS_KEY_NUM_7";
-	code_names[WILLIS_KEY_NUM_8] =            "WILLIS_KEY_NUM_8";
-	code_names[WILLIS_KEY_NUM_9] =            "WILLIS_KEY_NUM_9";
-
-	char** state_names = context->event_state_names;
-	state_names[WILLIS_STATE_NONE] =    "WILLIS_STATE_NONE";
-	state_names[WILLIS_STATE_PRESS] =   "WILLIS_STATE_PRESS";
-	state_names[WILLIS_STATE_RELEASE] = "WILLIS_STATE_RELEASE";
+	context->utf8_alloc = true;
+	context->compose_ready = true;
+	WILLIS_BACKEND(context, init)(context, error);
 
 	return context;
 }
@@ -151,7 +50,99 @@ void willis_start(
 	void* data,
 	struct willis_error_info* error)
 {
-	context->backend_callbacks.start(context, data, error);
+	WILLIS_BACKEND(context, start)(context, data, error);
+}
+
+// the queue takes ownership of the heap string of the events it accepts
+static inline void queue_event(
+	struct willis* context,
+	struct willis_event_info* event_info)
+{
+	if (event_info->event_code == WILLIS_NONE)
+	{
+		return;
+	}
+
+	if (willis_queue_push(context->queue, event_info) == true)
+	{
+		event_info->utf8_string = NULL;
+	}
+}
+
+static size_t handle_events_fallback(
+	struct willis* context,
+	void** events,
+	size_t count,
+	struct willis_event_info* event_infos,
+	struct willis_error_info* error)
+{
+	// translate events one by one
+	struct willis_error_info error_event;
+	size_t produced = 0;
+
+	willis_error_ok(error);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		WILLIS_BACKEND(context, handle_event)(
+			context,
+			events[i],
+			&(event_infos[produced]),
+			&error_event);
+
+		// report the first error but keep translating the batch
+		if ((willis_error_get_code(&error_event) != WILLIS_ERROR_OK)
+		&& (willis_error_get_code(error) == WILLIS_ERROR_OK))
+		{
+			*error = error_event;
+		}
+
+		// skip non-input events
+		if (willis_event_batched(&(event_infos[produced])) == true)
+		{
+			++produced;
+		}
+		else
+		{
+			free(event_infos[produced].utf8_string); // ok to free if NULL
+		}
+	}
+
+	return produced;
+}
+
+// use the native batch translation if the backend provides one
+static inline size_t handle_events_backend(
+	struct willis* context,
+	void** events,
+	size_t count,
+	struct willis_event_info* event_infos,
+	struct willis_error_info* error)
+{
+#if defined(WILLIS_STATIC_BACKEND) && defined(WILLIS_STATIC_BACKEND_BATCH)
+	return
+		WILLIS_BACKEND(context, handle_events)(
+			context,
+			events,
+			count,
+			event_infos,
+			error);
+#elif defined(WILLIS_STATIC_BACKEND)
+	return handle_events_fallback(context, events, count, event_infos, error);
+#else
+	if (context->backend_callbacks.handle_events != NULL)
+	{
+		return
+			context->backend_callbacks.handle_events(
+				context,
+				events,
+				count,
+				event_infos,
+				error);
+	}
+
+	return handle_events_fallback(context, events, count, event_infos, error);
+#endif
 }
 
 void willis_handle_event(
@@ -160,11 +151,559 @@ void willis_handle_event(
 	struct willis_event_info* event_info,
 	struct willis_error_info* error)
 {
-	context->backend_callbacks.handle_event(
+	uint64_t start = 0;
+
+	if (context->latency != NULL)
+	{
+		start = willis_get_time_ns();
+	}
+
+	WILLIS_BACKEND(context, handle_event)(
 		context,
 		event,
 		event_info,
 		error);
+
+	event_info->time_ns = willis_get_time_ns();
+	willis_stats_event(context, event_info);
+	willis_keys_update(context, event_info);
+
+	if (context->latency != NULL)
+	{
+		willis_latency_record(context, event_info, event_info->time_ns - start);
+	}
+
+	if (context->recorder != NULL)
+	{
+		willis_recorder_write(context, event_info);
+	}
+
+	if (context->queue != NULL)
+	{
+		queue_event(context, event_info);
+	}
+}
+
+size_t willis_handle_events(
+	struct willis* context,
+	void** events,
+	size_t count,
+	struct willis_event_info* event_infos,
+	struct willis_error_info* error)
+{
+	size_t produced = 0;
+	uint64_t start = 0;
+
+	if (context->latency != NULL)
+	{
+		start = willis_get_time_ns();
+	}
+
+	produced =
+		handle_events_backend(
+			context,
+			events,
+			count,
+			event_infos,
+			error);
+
+	// the whole batch was translated at once
+	uint64_t time = willis_get_time_ns();
+
+	WILLIS_STATS_ADD(context, events_ignored, count - produced);
+
+	for (size_t i = 0; i < produced; ++i)
+	{
+		event_infos[i].time_ns = time;
+		willis_stats_event(context, &(event_infos[i]));
+		willis_keys_update(context, &(event_infos[i]));
+	}
+
+	// the translation time is amortized over the whole batch
+	if ((context->latency != NULL) && (count > 0))
+	{
+		uint64_t translation = (time - start) / count;
+
+		for (size_t i = 0; i < produced; ++i)
+		{
+			willis_latency_record(context, &(event_infos[i]), translation);
+		}
+	}
+
+	// traces keep the events as they were before coalescing
+	if (context->recorder != NULL)
+	{
+		for (size_t i = 0; i < produced; ++i)
+		{
+			willis_recorder_write(context, &(event_infos[i]));
+		}
+	}
+
+	if (context->coalesce == true)
+	{
+		produced = willis_coalesce_events(context, event_infos, produced);
+	}
+
+	if (context->queue != NULL)
+	{
+		for (size_t i = 0; i < produced; ++i)
+		{
+			queue_event(context, &(event_infos[i]));
+		}
+	}
+
+	return produced;
+}
+
+size_t willis_handle_events_soa(
+	struct willis* context,
+	void** events,
+	size_t count,
+	struct willis_event_info* event_infos,
+	struct willis_event_soa* event_soa,
+	struct willis_error_info* error)
+{
+	size_t produced =
+		willis_handle_events(
+			context,
+			events,
+			count,
+			event_infos,
+			error);
+
+	// scatter in separate passes to keep each loop trivially vectorizable
+	if (event_soa->codes != NULL)
+	{
+		for (size_t i = 0; i < produced; ++i)
+		{
+			event_soa->codes[i] = event_infos[i].event_code;
+		}
+	}
+
+	if (event_soa->states != NULL)
+	{
+		for (size_t i = 0; i < produced; ++i)
+		{
+			event_soa->states[i] = event_infos[i].event_state;
+		}
+	}
+
+	if (event_soa->diff_x != NULL)
+	{
+		for (size_t i = 0; i < produced; ++i)
+		{
+			event_soa->diff_x[i] = event_infos[i].diff_x;
+		}
+	}
+
+	if (event_soa->diff_y != NULL)
+	{
+		for (size_t i = 0; i < produced; ++i)
+		{
+			event_soa->diff_y[i] = event_infos[i].diff_y;
+		}
+	}
+
+	return produced;
+}
+
+void willis_set_utf8_alloc(
+	struct willis* context,
+	bool utf8_alloc,
+	struct willis_error_info* error)
+{
+	context->utf8_alloc = utf8_alloc;
+	willis_error_ok(error);
+}
+
+void willis_set_coalesce(
+	struct willis* context,
+	bool coalesce,
+	struct willis_error_info* error)
+{
+	context->coalesce = coalesce;
+	willis_error_ok(error);
+}
+
+void willis_set_keymap_cache(
+	struct willis* context,
+	bool keymap_cache,
+	struct willis_error_info* error)
+{
+	context->keymap_cache = keymap_cache;
+	willis_error_ok(error);
+}
+
+void willis_set_compose_cache(
+	struct willis* context,
+	bool compose_cache,
+	struct willis_error_info* error)
+{
+	context->compose_cache = compose_cache;
+	willis_error_ok(error);
+}
+
+void willis_set_compose_loading(
+	struct willis* context,
+	enum willis_compose_loading compose_loading,
+	struct willis_error_info* error)
+{
+	context->compose_loading = compose_loading;
+	willis_error_ok(error);
+}
+
+// written by the X11 input thread
+bool willis_compose_ready(
+	struct willis* context)
+{
+	return __atomic_load_n(&(context->compose_ready), __ATOMIC_ACQUIRE);
+}
+
+static inline bool coalesce_wheel(
+	enum willis_event_code event_code)
+{
+	return (event_code == WILLIS_MOUSE_WHEEL_UP)
+		|| (event_code == WILLIS_MOUSE_WHEEL_DOWN);
+}
+
+// events of the same wheel direction, seat, device and window
+static inline bool coalesce_wheel_same(
+	const struct willis_event_info* a,
+	const struct willis_event_info* b)
+{
+	return (a->event_code == b->event_code)
+		&& (a->seat == b->seat)
+		&& (a->device == b->device)
+		&& (a->window == b->window);
+}
+
+// true if the events starting at index repeat the states of the run in order
+static inline bool coalesce_wheel_cycle(
+	const struct willis_event_info* event_infos,
+	size_t count,
+	size_t index,
+	const size_t* wheel_slots,
+	size_t wheel_count)
+{
+	if ((count - index) < wheel_count)
+	{
+		return false;
+	}
+
+	for (size_t k = 0; k < wheel_count; ++k)
+	{
+		const struct willis_event_info* slot = &(event_infos[wheel_slots[k]]);
+		const struct willis_event_info* next = &(event_infos[index + k]);
+
+		if ((coalesce_wheel_same(slot, next) == false)
+		|| (slot->event_state != next->event_state))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+size_t willis_coalesce_events(
+	struct willis* context,
+	struct willis_event_info* event_infos,
+	size_t count)
+{
+	// output slots of the wheel run being merged, in the order of their states
+	size_t wheel_slots[WILLIS_STATE_COUNT];
+	size_t wheel_count = 0;
+	bool wheel_merged = false;
+	size_t produced = 0;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		struct willis_event_info* event_info = &(event_infos[i]);
+		enum willis_event_code event_code = event_info->event_code;
+
+		// merge consecutive motion events of a seat, device and window
+		// into the last one, raw and core motion are kept apart since
+		// the position of raw motion is unknown
+		if ((event_code == WILLIS_MOUSE_MOTION)
+		&& (produced > 0)
+		&& (event_infos[produced - 1].event_code == WILLIS_MOUSE_MOTION)
+		&& (event_infos[produced - 1].mouse_raw == event_info->mouse_raw)
+		&& (event_infos[produced - 1].seat == event_info->seat)
+		&& (event_infos[produced - 1].device == event_info->device)
+		&& (event_infos[produced - 1].window == event_info->window))
+		{
+			struct willis_event_info* last = &(event_infos[produced - 1]);
+
+			last->diff_x += event_info->diff_x;
+			last->diff_y += event_info->diff_y;
+			last->mouse_x = event_info->mouse_x;
+			last->mouse_y = event_info->mouse_y;
+			last->time_native_ns = event_info->time_native_ns;
+			last->time_ns = event_info->time_ns;
+			continue;
+		}
+
+		// merge the steps of a run of events for the same wheel direction,
+		// one whole cycle of states at a time so the last state stays last
+		if (coalesce_wheel(event_code) == true)
+		{
+			bool same =
+				(wheel_count > 0)
+				&& (coalesce_wheel_same(&(event_infos[wheel_slots[0]]), event_info) == true);
+
+			bool known = false;
+
+			for (size_t k = 0; (same == true) && (k < wheel_count); ++k)
+			{
+				if (event_infos[wheel_slots[k]].event_state == event_info->event_state)
+				{
+					known = true;
+				}
+			}
+
+			if ((same == true) && (known == true)
+			&& (coalesce_wheel_cycle(event_infos, count, i, wheel_slots, wheel_count) == true))
+			{
+				for (size_t k = 0; k < wheel_count; ++k)
+				{
+					event_infos[wheel_slots[k]].mouse_wheel_steps +=
+						event_infos[i + k].mouse_wheel_steps;
+				}
+
+				wheel_merged = true;
+				i += wheel_count - 1;
+				continue;
+			}
+
+			// the first cycle gives the order of the states
+			if ((same == true) && (known == false) && (wheel_merged == false))
+			{
+				wheel_slots[wheel_count] = produced;
+				++wheel_count;
+			}
+			else
+			{
+				wheel_slots[0] = produced;
+				wheel_count = 1;
+				wheel_merged = false;
+			}
+		}
+		else
+		{
+			wheel_count = 0;
+		}
+
+		if (produced != i)
+		{
+			event_infos[produced] = *event_info;
+		}
+
+		++produced;
+	}
+
+	__atomic_add_fetch(&(context->coalesced), count - produced, __ATOMIC_RELAXED);
+
+	return produced;
+}
+
+size_t willis_get_coalesced(
+	struct willis* context)
+{
+	return __atomic_load_n(&(context->coalesced), __ATOMIC_RELAXED);
+}
+
+void willis_set_queue(
+	struct willis* context,
+	struct willis_queue* queue,
+	struct willis_error_info* error)
+{
+	context->queue = queue;
+	willis_error_ok(error);
+}
+
+void willis_utf8_store(
+	struct willis* context,
+	struct willis_event_info* event_info,
+	const char* string,
+	size_t size,
+	struct willis_error_info* error)
+{
+	event_info->utf8_size = size;
+	event_info->utf8_string = NULL;
+
+	// the string can already be in the inline buffer
+	if (size < WILLIS_UTF8_BUFFER_SIZE)
+	{
+		if (string != event_info->utf8_buffer)
+		{
+			memcpy(event_info->utf8_buffer, string, size);
+		}
+
+		event_info->utf8_buffer[size] = '\0';
+		event_info->utf8_overflow = false;
+	}
+	else
+	{
+		event_info->utf8_buffer[0] = '\0';
+		event_info->utf8_overflow = true;
+	}
+
+	WILLIS_STATS_ADD(context, utf8_bytes, size);
+
+	// legacy heap copy, empty strings have none
+	if ((context->utf8_alloc == true) && (size > 0))
+	{
+		WILLIS_STATS_ADD(context, allocations, 1);
+		event_info->utf8_string = malloc(size + 1);
+
+		if (event_info->utf8_string == NULL)
+		{
+			willis_error_throw(context, error, WILLIS_ERROR_ALLOC);
+			return;
+		}
+
+		memcpy(event_info->utf8_string, string, size);
+		event_info->utf8_string[size] = '\0';
+	}
+
+	willis_error_ok(error);
+}
+
+void willis_stats_event(
+	struct willis* context,
+	struct willis_event_info* event_info)
+{
+	if (event_info->event_code == WILLIS_NONE)
+	{
+		WILLIS_STATS_ADD(context, events_ignored, 1);
+	}
+	else if (event_info->event_code < WILLIS_CODE_COUNT)
+	{
+		WILLIS_STATS_ADD(context, events[event_info->event_code], 1);
+	}
+}
+
+void willis_get_stats(
+	struct willis* context,
+	struct willis_stats* stats,
+	struct willis_error_info* error)
+{
+	for (size_t i = 0; i < WILLIS_CODE_COUNT; ++i)
+	{
+		stats->events[i] =
+			__atomic_load_n(&(context->stats.events[i]), __ATOMIC_RELAXED);
+	}
+
+	stats->events_ignored =
+		__atomic_load_n(&(context->stats.events_ignored), __ATOMIC_RELAXED);
+	stats->utf8_bytes =
+		__atomic_load_n(&(context->stats.utf8_bytes), __ATOMIC_RELAXED);
+	stats->allocations =
+		__atomic_load_n(&(context->stats.allocations), __ATOMIC_RELAXED);
+	stats->keymap_rebuilds =
+		__atomic_load_n(&(context->stats.keymap_rebuilds), __ATOMIC_RELAXED);
+	stats->keymap_cache_hits =
+		__atomic_load_n(&(context->stats.keymap_cache_hits), __ATOMIC_RELAXED);
+	stats->compose_feeds =
+		__atomic_load_n(&(context->stats.compose_feeds), __ATOMIC_RELAXED);
+	stats->compose_results =
+		__atomic_load_n(&(context->stats.compose_results), __ATOMIC_RELAXED);
+	stats->x11_round_trips =
+		__atomic_load_n(&(context->stats.x11_round_trips), __ATOMIC_RELAXED);
+	stats->wayland_callbacks =
+		__atomic_load_n(&(context->stats.wayland_callbacks), __ATOMIC_RELAXED);
+
+	willis_error_ok(error);
+}
+
+// the bitset can be updated by an input thread while it is queried,
+// so all accesses to its words are atomic
+void willis_keys_update(
+	struct willis* context,
+	struct willis_event_info* event_info)
+{
+	size_t word = event_info->event_code / 64;
+	uint64_t bit = ((uint64_t) 1) << (event_info->event_code % 64);
+
+	if (event_info->event_code >= WILLIS_CODE_COUNT)
+	{
+		return;
+	}
+
+	switch (event_info->event_state)
+	{
+		case WILLIS_STATE_PRESS:
+		{
+			__atomic_fetch_or(&(context->keys_down[word]), bit, __ATOMIC_RELAXED);
+			break;
+		}
+		case WILLIS_STATE_RELEASE:
+		{
+			__atomic_fetch_and(&(context->keys_down[word]), ~bit, __ATOMIC_RELAXED);
+			break;
+		}
+		default:
+		{
+			break;
+		}
+	}
+}
+
+void willis_key_snapshot(
+	struct willis* context)
+{
+	for (size_t i = 0; i < WILLIS_KEYS_WORDS; ++i)
+	{
+		context->keys_prev[i] =
+			__atomic_load_n(&(context->keys_down[i]), __ATOMIC_RELAXED);
+	}
+}
+
+bool willis_key_is_down(
+	struct willis* context,
+	enum willis_event_code event_code)
+{
+	if (event_code >= WILLIS_CODE_COUNT)
+	{
+		return false;
+	}
+
+	uint64_t down =
+		__atomic_load_n(&(context->keys_down[event_code / 64]), __ATOMIC_RELAXED);
+
+	return ((down >> (event_code % 64)) & 1) != 0;
+}
+
+bool willis_key_pressed_since(
+	struct willis* context,
+	enum willis_event_code event_code)
+{
+	if (event_code >= WILLIS_CODE_COUNT)
+	{
+		return false;
+	}
+
+	size_t word = event_code / 64;
+	uint64_t down = __atomic_load_n(&(context->keys_down[word]), __ATOMIC_RELAXED);
+	uint64_t changed = down ^ context->keys_prev[word];
+
+	return (((changed & down) >> (event_code % 64)) & 1) != 0;
+}
+
+bool willis_key_released_since(
+	struct willis* context,
+	enum willis_event_code event_code)
+{
+	if (event_code >= WILLIS_CODE_COUNT)
+	{
+		return false;
+	}
+
+	size_t word = event_code / 64;
+	uint64_t down = __atomic_load_n(&(context->keys_down[word]), __ATOMIC_RELAXED);
+	uint64_t changed = down ^ context->keys_prev[word];
+
+	return (((changed & ~down) >> (event_code % 64)) & 1) != 0;
 }
 
 const char* willis_get_event_code_name(
@@ -175,7 +714,7 @@ const char* willis_get_event_code_name(
 	if (event_code < WILLIS_CODE_COUNT)
 	{
 		willis_error_ok(error);
-		return context->event_code_names[event_code];
+		return event_code_names[event_code];
 	}
 
 	willis_error_throw(context, error, WILLIS_ERROR_EVENT_CODE_INVALID);
@@ -190,7 +729,7 @@ const char* willis_get_event_state_name(
 	if (event_state < WILLIS_STATE_COUNT)
 	{
 		willis_error_ok(error);
-		return context->event_state_names[event_state];
+		return event_state_names[event_state];
 	}
 
 	willis_error_throw(context, error, WILLIS_ERROR_EVENT_STATE_INVALID);
@@ -201,27 +740,88 @@ bool willis_mouse_grab(
 	struct willis* context,
 	struct willis_error_info* error)
 {
-	return context->backend_callbacks.mouse_grab(context, error);
+	return WILLIS_BACKEND(context, mouse_grab)(context, error);
 }
 
 bool willis_mouse_ungrab(
 	struct willis* context,
 	struct willis_error_info* error)
 {
-	return context->backend_callbacks.mouse_ungrab(context, error);
+	return WILLIS_BACKEND(context, mouse_ungrab)(context, error);
+}
+
+bool willis_mouse_grab_poll(
+	struct willis* context,
+	struct willis_error_info* error)
+{
+#if defined(WILLIS_STATIC_BACKEND) && defined(WILLIS_STATIC_BACKEND_GRAB_POLL)
+	return WILLIS_BACKEND(context, mouse_grab_poll)(context, error);
+#elif defined(WILLIS_STATIC_BACKEND)
+	willis_error_ok(error);
+	return true;
+#else
+	if (context->backend_callbacks.mouse_grab_poll != NULL)
+	{
+		return context->backend_callbacks.mouse_grab_poll(context, error);
+	}
+
+	willis_error_ok(error);
+	return true;
+#endif
+}
+
+void willis_window_attach(
+	struct willis* context,
+	uintptr_t window,
+	struct willis_error_info* error)
+{
+#if defined(WILLIS_STATIC_BACKEND) && defined(WILLIS_STATIC_BACKEND_WINDOWS)
+	WILLIS_BACKEND(context, window_attach)(context, window, error);
+#elif defined(WILLIS_STATIC_BACKEND)
+	willis_error_throw(context, error, WILLIS_ERROR_WINDOW_UNSUPPORTED);
+#else
+	if (context->backend_callbacks.window_attach != NULL)
+	{
+		context->backend_callbacks.window_attach(context, window, error);
+		return;
+	}
+
+	willis_error_throw(context, error, WILLIS_ERROR_WINDOW_UNSUPPORTED);
+#endif
+}
+
+void willis_window_detach(
+	struct willis* context,
+	uintptr_t window,
+	struct willis_error_info* error)
+{
+#if defined(WILLIS_STATIC_BACKEND) && defined(WILLIS_STATIC_BACKEND_WINDOWS)
+	WILLIS_BACKEND(context, window_detach)(context, window, error);
+#elif defined(WILLIS_STATIC_BACKEND)
+	willis_error_throw(context, error, WILLIS_ERROR_WINDOW_UNSUPPORTED);
+#else
+	if (context->backend_callbacks.window_detach != NULL)
+	{
+		context->backend_callbacks.window_detach(context, window, error);
+		return;
+	}
+
+	willis_error_throw(context, error, WILLIS_ERROR_WINDOW_UNSUPPORTED);
+#endif
 }
 
 void willis_stop(
 	struct willis* context,
 	struct willis_error_info* error)
 {
-	context->backend_callbacks.stop(context, error);
+	WILLIS_BACKEND(context, stop)(context, error);
 }
 
 void willis_clean(
 	struct willis* context,
 	struct willis_error_info* error)
 {
-	context->backend_callbacks.clean(context, error);
+	WILLIS_BACKEND(context, clean)(context, error);
+	free(context->latency);
 	free(context);
 }
@@ -12,98 +12,116 @@
 	#include <stdlib.h>
 #endif
 
-void willis_error_init(
-	struct willis* context)
+// error messages in read-only memory
+static const char* const error_messages[WILLIS_ERROR_COUNT] =
 {
-#ifndef WILLIS_ERROR_SKIP
-	char** log = context->error_messages;
-
-	log[WILLIS_ERROR_OK] =
-		"out-of-bound error message";
-	log[WILLIS_ERROR_NULL] =
-		"null pointer";
-	log[WILLIS_ERROR_ALLOC] =
-		"failed malloc";
-	log[WILLIS_ERROR_BOUNDS] =
-		"out-of-bounds index";
-	log[WILLIS_ERROR_DOMAIN] =
-		"invalid domain";
-	log[WILLIS_ERROR_FD] =
-		"invalid file descriptor";
-
-	log[WILLIS_ERROR_EVENT_CODE_INVALID] =
-		"invalid event code";
-	log[WILLIS_ERROR_EVENT_STATE_INVALID] =
-		"invalid event state";
-
-	log[WILLIS_ERROR_X11_XFIXES_VERSION] =
-		"couldn't get required Xfixes version";
-	log[WILLIS_ERROR_X11_XFIXES_HIDE] =
-		"couldn't hide the cursor with Xfixes";
-	log[WILLIS_ERROR_X11_XFIXES_SHOW] =
-		"couldn't show the cursor with Xfixes";
-	log[WILLIS_ERROR_X11_GRAB] =
-		"couldn't grab the mouse pointer";
-	log[WILLIS_ERROR_X11_UNGRAB] =
-		"couldn't ungrab the mouse pointer";
-	log[WILLIS_ERROR_X11_XINPUT_SELECT_EVENTS] =
-		"couldn't select events with Xinput";
-	log[WILLIS_ERROR_X11_XINPUT_GET_POINTER] =
-		"couldn't get pointer with Xinput";
-	log[WILLIS_ERROR_X11_XKB_SETUP] =
-		"couldn't initialize the XKB X11 extension";
-	log[WILLIS_ERROR_X11_XKB_DEVICE_GET] =
-		"couldn't get the device id with XKB";
-	log[WILLIS_ERROR_X11_XKB_KEYMAP_NEW] =
-		"couldn't create a new XKB keymap";
-	log[WILLIS_ERROR_X11_XKB_STATE_NEW] =
-		"couldn't create a new XKB state";
-	log[WILLIS_ERROR_X11_XKB_SELECT_EVENTS] =
-		"couldn't select events with XKB";
-	log[WILLIS_ERROR_XKB_CONTEXT_NEW] =
-		"couldn't create a new XKB context";
-
-	log[WILLIS_ERROR_WIN_MOUSE_GRAB] =
-		"couldn't grab win32 mouse";
-	log[WILLIS_ERROR_WIN_MOUSE_UNGRAB] =
-		"couldn't ungrab win32 mouse";
-	log[WILLIS_ERROR_WIN_WINDOW_RECT_GET] =
-		"couldn't get win32 window rectangle";
-	log[WILLIS_ERROR_WIN_WINDOW_CURSOR_CLIP] =
-		"couldn't clip win32 mouse";
-	log[WILLIS_ERROR_WIN_WINDOW_CURSOR_UNCLIP] =
-		"couldn't unclip win32 mouse";
-	log[WILLIS_ERROR_WIN_WINDOW_MOUSE_RAW_GET] =
-		"couldn't get win32 window raw mouse movement info";
-	log[WILLIS_ERROR_WIN_ACTIVE_GET] =
-		"couldn't get a win32 active window handle";
-
-	log[WILLIS_ERROR_WAYLAND_REQUEST] =
-		"could not perform Wayland request";
-	log[WILLIS_ERROR_WAYLAND_LISTENER_ADD] =
-		"could not add Wayland listener";
-	log[WILLIS_ERROR_WAYLAND_POINTER_MISSING] =
-		"could not register Wayland mouse pointer";
-	log[WILLIS_ERROR_WAYLAND_POINTER_SURFACE_MISSING] =
-		"could not register Wayland mouse pointer surface";
-	log[WILLIS_ERROR_WAYLAND_POINTER_RELATIVE_MANAGER_MISSING] =
-		"could not register Wayland relative mouse pointer manager";
-	log[WILLIS_ERROR_WAYLAND_POINTER_CONSTRAINTS_MANAGER_MISSING] =
-		"could not register Wayland locked mouse pointer manager";
-	log[WILLIS_ERROR_WAYLAND_POINTER_RELATIVE_MISSING] =
-		"could not register Wayland relative mouse pointer";
-	log[WILLIS_ERROR_WAYLAND_POINTER_LOCKED_MISSING] =
-		"could not register Wayland locked mouse pointer";
-	log[WILLIS_ERROR_WAYLAND_POINTER_RELATIVE_GET] =
-		"could not get Wayland relative mouse pointer";
-	log[WILLIS_ERROR_WAYLAND_POINTER_LOCKED_GET] =
-		"could not get Wayland locked mouse pointer";
-	log[WILLIS_ERROR_WAYLAND_POINTER_GET] =
-		"could not get Wayland mouse pointer";
-	log[WILLIS_ERROR_WAYLAND_KEYBOARD_GET] =
-		"could not get Wayland keyboard";
-#endif
-}
+	[WILLIS_ERROR_OK] =
+		"out-of-bound error message",
+	[WILLIS_ERROR_NULL] =
+		"null pointer",
+	[WILLIS_ERROR_ALLOC] =
+		"failed malloc",
+	[WILLIS_ERROR_BOUNDS] =
+		"out-of-bounds index",
+	[WILLIS_ERROR_DOMAIN] =
+		"invalid domain",
+	[WILLIS_ERROR_FD] =
+		"invalid file descriptor",
+
+	[WILLIS_ERROR_EVENT_CODE_INVALID] =
+		"invalid event code",
+	[WILLIS_ERROR_EVENT_STATE_INVALID] =
+		"invalid event state",
+
+	[WILLIS_ERROR_X11_XFIXES_VERSION] =
+		"couldn't get required Xfixes version",
+	[WILLIS_ERROR_X11_XFIXES_HIDE] =
+		"couldn't hide the cursor with Xfixes",
+	[WILLIS_ERROR_X11_XFIXES_SHOW] =
+		"couldn't show the cursor with Xfixes",
+	[WILLIS_ERROR_X11_GRAB] =
+		"couldn't grab the mouse pointer",
+	[WILLIS_ERROR_X11_UNGRAB] =
+		"couldn't ungrab the mouse pointer",
+	[WILLIS_ERROR_X11_XINPUT_SELECT_EVENTS] =
+		"couldn't select events with Xinput",
+	[WILLIS_ERROR_X11_XINPUT_GET_POINTER] =
+		"couldn't get pointer with Xinput",
+	[WILLIS_ERROR_X11_XKB_SETUP] =
+		"couldn't initialize the XKB X11 extension",
+	[WILLIS_ERROR_X11_XKB_DEVICE_GET] =
+		"couldn't get the device id with XKB",
+	[WILLIS_ERROR_X11_XKB_KEYMAP_NEW] =
+		"couldn't create a new XKB keymap",
+	[WILLIS_ERROR_X11_XKB_STATE_NEW] =
+		"couldn't create a new XKB state",
+	[WILLIS_ERROR_X11_XKB_SELECT_EVENTS] =
+		"couldn't select events with XKB",
+	[WILLIS_ERROR_XKB_CONTEXT_NEW] =
+		"couldn't create a new XKB context",
+
+	[WILLIS_ERROR_WIN_MOUSE_GRAB] =
+		"couldn't grab win32 mouse",
+	[WILLIS_ERROR_WIN_MOUSE_UNGRAB] =
+		"couldn't ungrab win32 mouse",
+	[WILLIS_ERROR_WIN_WINDOW_RECT_GET] =
+		"couldn't get win32 window rectangle",
+	[WILLIS_ERROR_WIN_WINDOW_CURSOR_CLIP] =
+		"couldn't clip win32 mouse",
+	[WILLIS_ERROR_WIN_WINDOW_CURSOR_UNCLIP] =
+		"couldn't unclip win32 mouse",
+	[WILLIS_ERROR_WIN_WINDOW_MOUSE_RAW_GET] =
+		"couldn't get win32 window raw mouse movement info",
+	[WILLIS_ERROR_WIN_ACTIVE_GET] =
+		"couldn't get a win32 active window handle",
+
+	[WILLIS_ERROR_WAYLAND_REQUEST] =
+		"could not perform Wayland request",
+	[WILLIS_ERROR_WAYLAND_LISTENER_ADD] =
+		"could not add Wayland listener",
+	[WILLIS_ERROR_WAYLAND_POINTER_MISSING] =
+		"could not register Wayland mouse pointer",
+	[WILLIS_ERROR_WAYLAND_POINTER_SURFACE_MISSING] =
+		"could not register Wayland mouse pointer surface",
+	[WILLIS_ERROR_WAYLAND_POINTER_RELATIVE_MANAGER_MISSING] =
+		"could not register Wayland relative mouse pointer manager",
+	[WILLIS_ERROR_WAYLAND_POINTER_CONSTRAINTS_MANAGER_MISSING] =
+		"could not register Wayland locked mouse pointer manager",
+	[WILLIS_ERROR_WAYLAND_POINTER_RELATIVE_MISSING] =
+		"could not register Wayland relative mouse pointer",
+	[WILLIS_ERROR_WAYLAND_POINTER_LOCKED_MISSING] =
+		"could not register Wayland locked mouse pointer",
+	[WILLIS_ERROR_WAYLAND_POINTER_RELATIVE_GET] =
+		"could not get Wayland relative mouse pointer",
+	[WILLIS_ERROR_WAYLAND_POINTER_LOCKED_GET] =
+		"could not get Wayland locked mouse pointer",
+	[WILLIS_ERROR_WAYLAND_POINTER_GET] =
+		"could not get Wayland mouse pointer",
+	[WILLIS_ERROR_WAYLAND_KEYBOARD_GET] =
+		"could not get Wayland keyboard",
+
+	[WILLIS_ERROR_X11_CONNECT] =
+		"couldn't open the X11 input thread connection",
+	[WILLIS_ERROR_X11_XINPUT_VERSION] =
+		"couldn't get required Xinput version",
+	[WILLIS_ERROR_X11_THREAD_START] =
+		"couldn't start the X11 input thread",
+
+	[WILLIS_ERROR_X11_XINPUT_QUERY_DEVICE] =
+		"couldn't list the devices with Xinput",
+
+	[WILLIS_ERROR_XKB_KEYMAP_NEW] =
+		"couldn't compile the cached XKB keymap",
+	[WILLIS_ERROR_XKB_STATE_NEW] =
+		"couldn't create the state of the cached XKB keymap",
+
+	[WILLIS_ERROR_WINDOW_LIMIT] =
+		"too many windows attached",
+	[WILLIS_ERROR_WINDOW_UNKNOWN] =
+		"window not attached",
+	[WILLIS_ERROR_WINDOW_UNSUPPORTED] =
+		"attaching windows is not supported by this backend",
+};
 
 void willis_error_log(
 	struct willis* context,
@@ -121,11 +139,11 @@ void willis_error_log(
 
 		if (error->code < WILLIS_ERROR_COUNT)
 		{
-			fprintf(stderr, "%s\n", context->error_messages[error->code]);
+			fprintf(stderr, "%s\n", error_messages[error->code]);
 		}
 		else
 		{
-			fprintf(stderr, "%s\n", context->error_messages[0]);
+			fprintf(stderr, "%s\n", error_messages[0]);
 		}
 	#endif
 #endif
@@ -137,11 +155,11 @@ const char* willis_error_get_msg(
 {
 	if (error->code < WILLIS_ERROR_COUNT)
 	{
-		return context->error_messages[error->code];
+		return error_messages[error->code];
 	}
 	else
 	{
-		return context->error_messages[0];
+		return error_messages[0];
 	}
 }
 
@@ -194,11 +212,11 @@ void willis_error_throw_extra(
 
 		if (error->code < WILLIS_ERROR_COUNT)
 		{
-			fprintf(stderr, "%s\n", context->error_messages[error->code]);
+			fprintf(stderr, "%s\n", error_messages[error->code]);
 		}
 		else
 		{
-			fprintf(stderr, "%s\n", context->error_messages[0]);
+			fprintf(stderr, "%s\n", error_messages[0]);
 		}
 	#endif
 
@@ -20,7 +20,4 @@ void willis_error_throw_extra(
 	const char* file,
 	unsigned line);
 
-void willis_error_init(
-	struct willis* context);
-
 #endif
@@ -0,0 +1,236 @@
+#include "include/willis.h"
+#include "common/willis_private.h"
+#include "common/willis_latency.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+static inline size_t latency_bucket(
+	uint64_t value)
+{
+	if (value < (1 << WILLIS_LATENCY_SUB_BITS))
+	{
+		return value;
+	}
+
+	size_t exponent = 63 - __builtin_clzll(value);
+
+	if (exponent > WILLIS_LATENCY_MAX_EXPONENT)
+	{
+		return WILLIS_LATENCY_BUCKETS - 1;
+	}
+
+	size_t shift = exponent - WILLIS_LATENCY_SUB_BITS;
+	size_t sub = (value >> shift) & ((1 << WILLIS_LATENCY_SUB_BITS) - 1);
+
+	return ((shift + 1) << WILLIS_LATENCY_SUB_BITS) + sub;
+}
+
+// highest value falling in the given bucket
+static inline uint64_t latency_bucket_limit(
+	size_t bucket)
+{
+	if (bucket < (1 << WILLIS_LATENCY_SUB_BITS))
+	{
+		return bucket;
+	}
+
+	size_t shift = (bucket >> WILLIS_LATENCY_SUB_BITS) - 1;
+	uint64_t sub = bucket & ((1 << WILLIS_LATENCY_SUB_BITS) - 1);
+	uint64_t low = ((1 << WILLIS_LATENCY_SUB_BITS) | sub) << shift;
+
+	return low + (((uint64_t) 1) << shift) - 1;
+}
+
+static inline bool latency_get_class(
+	enum willis_event_code event_code,
+	enum willis_latency_class* event_class)
+{
+	switch (event_code)
+	{
+		case WILLIS_NONE:
+		{
+			return false;
+		}
+		case WILLIS_MOUSE_CLICK_LEFT:
+		case WILLIS_MOUSE_CLICK_RIGHT:
+		case WILLIS_MOUSE_CLICK_MIDDLE:
+		case WILLIS_MOUSE_WHEEL_UP:
+		case WILLIS_MOUSE_WHEEL_DOWN:
+		{
+			*event_class = WILLIS_LATENCY_BUTTON;
+			return true;
+		}
+		case WILLIS_MOUSE_MOTION:
+		{
+			*event_class = WILLIS_LATENCY_MOTION;
+			return true;
+		}
+		default:
+		{
+			*event_class = WILLIS_LATENCY_KEY;
+			return true;
+		}
+	}
+}
+
+// events can be recorded by an input thread while the histograms are read
+static inline void latency_add(
+	struct willis_latency_histogram* histogram,
+	uint64_t value)
+{
+	uint64_t max = __atomic_load_n(&(histogram->max), __ATOMIC_RELAXED);
+
+	while ((value > max)
+	&& (__atomic_compare_exchange_n(
+		&(histogram->max),
+		&max,
+		value,
+		true,
+		__ATOMIC_RELAXED,
+		__ATOMIC_RELAXED) == false));
+
+	__atomic_add_fetch(&(histogram->buckets[latency_bucket(value)]), 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&(histogram->count), 1, __ATOMIC_RELAXED);
+}
+
+void willis_latency_record(
+	struct willis* context,
+	struct willis_event_info* event_info,
+	uint64_t translation_ns)
+{
+	struct willis_latency* latency = context->latency;
+	enum willis_latency_class latency_class;
+
+	if (latency_get_class(event_info->event_code, &latency_class) == false)
+	{
+		return;
+	}
+
+	latency_add(
+		&(latency->histograms[latency_class][WILLIS_LATENCY_TRANSLATION]),
+		translation_ns);
+
+	// only meaningful when the windowing system uses the monotonic clock,
+	// so we ignore timestamps from the future or from another clock domain
+	if ((event_info->time_native_ns != 0)
+	&& (event_info->time_native_ns <= event_info->time_ns))
+	{
+		latency_add(
+			&(latency->histograms[latency_class][WILLIS_LATENCY_DELIVERY]),
+			event_info->time_ns - event_info->time_native_ns);
+	}
+}
+
+void willis_set_latency(
+	struct willis* context,
+	bool latency,
+	struct willis_error_info* error)
+{
+	if ((latency == true) && (context->latency == NULL))
+	{
+		WILLIS_STATS_ADD(context, allocations, 1);
+		struct willis_latency* histograms = malloc(sizeof (struct willis_latency));
+
+		if (histograms == NULL)
+		{
+			willis_error_throw(context, error, WILLIS_ERROR_ALLOC);
+			return;
+		}
+
+		struct willis_latency zero = {0};
+		*histograms = zero;
+
+		context->latency = histograms;
+	}
+	else if ((latency == false) && (context->latency != NULL))
+	{
+		free(context->latency);
+		context->latency = NULL;
+	}
+
+	willis_error_ok(error);
+}
+
+void willis_latency_get(
+	struct willis* context,
+	enum willis_latency_class latency_class,
+	enum willis_latency_stage stage,
+	struct willis_latency_info* latency_info,
+	struct willis_error_info* error)
+{
+	if (context->latency == NULL)
+	{
+		willis_error_throw(context, error, WILLIS_ERROR_NULL);
+		return;
+	}
+
+	if ((latency_class >= WILLIS_LATENCY_CLASS_COUNT)
+	|| (stage >= WILLIS_LATENCY_STAGE_COUNT))
+	{
+		willis_error_throw(context, error, WILLIS_ERROR_DOMAIN);
+		return;
+	}
+
+	struct willis_latency_histogram* histogram =
+		&(context->latency->histograms[latency_class][stage]);
+
+	uint64_t count = __atomic_load_n(&(histogram->count), __ATOMIC_RELAXED);
+	uint64_t rank_p50 = (count + 1) / 2;
+	uint64_t rank_p99 = count - (count / 100);
+	uint64_t seen = 0;
+
+	latency_info->count = count;
+	latency_info->p50 = 0;
+	latency_info->p99 = 0;
+	latency_info->max = __atomic_load_n(&(histogram->max), __ATOMIC_RELAXED);
+
+	// percentiles are reported as the upper limit of their bucket
+	for (size_t i = 0; (i < WILLIS_LATENCY_BUCKETS) && (seen < rank_p99); ++i)
+	{
+		uint64_t bucket = __atomic_load_n(&(histogram->buckets[i]), __ATOMIC_RELAXED);
+
+		if ((seen < rank_p50) && ((seen + bucket) >= rank_p50))
+		{
+			latency_info->p50 = latency_bucket_limit(i);
+		}
+
+		seen += bucket;
+
+		if (seen >= rank_p99)
+		{
+			latency_info->p99 = latency_bucket_limit(i);
+		}
+	}
+
+	// the max is exact while buckets are not
+	if (latency_info->p50 > latency_info->max)
+	{
+		latency_info->p50 = latency_info->max;
+	}
+
+	if (latency_info->p99 > latency_info->max)
+	{
+		latency_info->p99 = latency_info->max;
+	}
+
+	willis_error_ok(error);
+}
+
+void willis_latency_reset(
+	struct willis* context,
+	struct willis_error_info* error)
+{
+	if (context->latency == NULL)
+	{
+		willis_error_throw(context, error, WILLIS_ERROR_NULL);
+		return;
+	}
+
+	struct willis_latency zero = {0};
+	*(context->latency) = zero;
+
+	willis_error_ok(error);
+}
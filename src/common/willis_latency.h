@@ -0,0 +1,36 @@
+#ifndef H_WILLIS_LATENCY
+#define H_WILLIS_LATENCY
+
+#include "include/willis.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// log-scale buckets with 8 linear sub-buckets per power of two,
+// latencies above 2^36 ns (about a minute) end up in the last bucket
+#define WILLIS_LATENCY_SUB_BITS 3
+#define WILLIS_LATENCY_MAX_EXPONENT 36
+#define WILLIS_LATENCY_BUCKETS \
+	(((WILLIS_LATENCY_MAX_EXPONENT - WILLIS_LATENCY_SUB_BITS + 1) \
+		<< WILLIS_LATENCY_SUB_BITS) + (1 << WILLIS_LATENCY_SUB_BITS))
+
+struct willis_latency_histogram
+{
+	uint64_t count;
+	uint64_t max;
+	uint64_t buckets[WILLIS_LATENCY_BUCKETS];
+};
+
+struct willis_latency
+{
+	struct willis_latency_histogram
+		histograms[WILLIS_LATENCY_CLASS_COUNT][WILLIS_LATENCY_STAGE_COUNT];
+};
+
+// records the latencies of a translated event
+void willis_latency_record(
+	struct willis* context,
+	struct willis_event_info* event_info,
+	uint64_t translation_ns);
+
+#endif
@@ -4,16 +4,147 @@
 #include "include/willis.h"
 #include "common/willis_error.h"
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#define WILLIS_KEYS_WORDS ((WILLIS_CODE_COUNT + 63) / 64)
+
+// native timestamps conversion
+#define WILLIS_TIME_MS_TO_NS(ms) (((uint64_t) (ms)) * 1000000)
+#define WILLIS_TIME_US_TO_NS(us) (((uint64_t) (us)) * 1000)
+
+// backend dispatch, WILLIS_STATIC_BACKEND can be set to a backend name
+// (x11, wayland or win) to call its functions directly instead of going
+// through the callbacks filled at runtime, with WILLIS_STATIC_BACKEND_BATCH
+// also defined when the backend implements batched translation
+// and WILLIS_STATIC_BACKEND_GRAB_POLL when it grabs the mouse asynchronously
+// and WILLIS_STATIC_BACKEND_WINDOWS when it can serve several windows
+#if defined(WILLIS_STATIC_BACKEND)
+	#define WILLIS_BACKEND_PASTE(backend, name) willis_##backend##_##name
+	#define WILLIS_BACKEND_NAME(backend, name) WILLIS_BACKEND_PASTE(backend, name)
+	#define WILLIS_BACKEND(context, name) \
+		WILLIS_BACKEND_NAME(WILLIS_STATIC_BACKEND, name)
+#else
+	#define WILLIS_BACKEND(context, name) ((context)->backend_callbacks.name)
+#endif
+
+// sparse keycode LUT entries built from a WILLIS_KEYS column, for instance
+// #define X(code, x11, win, appkit) WILLIS_KEYS_LUT(x11, code)
+#define WILLIS_KEYS_LUT(native, code) WILLIS_KEYS_LUT_##native(code)
+#define WILLIS_KEYS_LUT_WILLIS_NATIVE(keycode) [keycode] = WILLIS_KEYS_LUT_CODE
+#define WILLIS_KEYS_LUT_WILLIS_NATIVE_NONE(code)
+#define WILLIS_KEYS_LUT_CODE(code) code,
+
+// statistics counters can be updated by an input thread while they are read
+#define WILLIS_STATS_ADD(context, counter, value) \
+	__atomic_add_fetch(&((context)->stats.counter), (value), __ATOMIC_RELAXED)
 
 struct willis
 {
-	char* error_messages[WILLIS_ERROR_COUNT];
 	void* backend_data;
 	struct willis_config_backend backend_callbacks;
+	bool utf8_alloc;
+	bool coalesce;
+	bool keymap_cache;
+	bool compose_cache;
+	enum willis_compose_loading compose_loading;
+	bool compose_ready;
+	size_t coalesced;
+	struct willis_queue* queue;
+	struct willis_recorder* recorder;
+	struct willis_latency* latency;
+	struct willis_stats stats;
 
-	char* event_code_names[WILLIS_CODE_COUNT];
-	char* event_state_names[WILLIS_STATE_COUNT];
+	// pressed keys and buttons, and their snapshot from the previous frame
+	uint64_t keys_down[WILLIS_KEYS_WORDS];
+	uint64_t keys_prev[WILLIS_KEYS_WORDS];
 };
 
+#if defined(WILLIS_STATIC_BACKEND)
+void WILLIS_BACKEND(context, init)(
+	struct willis* context,
+	struct willis_error_info* error);
+
+void WILLIS_BACKEND(context, start)(
+	struct willis* context,
+	void* data,
+	struct willis_error_info* error);
+
+void WILLIS_BACKEND(context, handle_event)(
+	struct willis* context,
+	void* event,
+	struct willis_event_info* event_info,
+	struct willis_error_info* error);
+
+#if defined(WILLIS_STATIC_BACKEND_BATCH)
+size_t WILLIS_BACKEND(context, handle_events)(
+	struct willis* context,
+	void** events,
+	size_t count,
+	struct willis_event_info* event_infos,
+	struct willis_error_info* error);
+#endif
+
+bool WILLIS_BACKEND(context, mouse_grab)(
+	struct willis* context,
+	struct willis_error_info* error);
+
+bool WILLIS_BACKEND(context, mouse_ungrab)(
+	struct willis* context,
+	struct willis_error_info* error);
+
+#if defined(WILLIS_STATIC_BACKEND_GRAB_POLL)
+bool WILLIS_BACKEND(context, mouse_grab_poll)(
+	struct willis* context,
+	struct willis_error_info* error);
+#endif
+
+#if defined(WILLIS_STATIC_BACKEND_WINDOWS)
+void WILLIS_BACKEND(context, window_attach)(
+	struct willis* context,
+	uintptr_t window,
+	struct willis_error_info* error);
+
+void WILLIS_BACKEND(context, window_detach)(
+	struct willis* context,
+	uintptr_t window,
+	struct willis_error_info* error);
+#endif
+
+void WILLIS_BACKEND(context, stop)(
+	struct willis* context,
+	struct willis_error_info* error);
+
+void WILLIS_BACKEND(context, clean)(
+	struct willis* context,
+	struct willis_error_info* error);
+#endif
+
+// batched translation keeps the events willis_handle_event reports as well:
+// input events, and key presses without an event code that have some text
+static inline bool willis_event_batched(
+	struct willis_event_info* event_info)
+{
+	return (event_info->event_code != WILLIS_NONE) || (event_info->utf8_size > 0);
+}
+
+// fills the utf-8 fields of the event info with the given string
+void willis_utf8_store(
+	struct willis* context,
+	struct willis_event_info* event_info,
+	const char* string,
+	size_t size,
+	struct willis_error_info* error);
+
+// counts a translated event in the statistics
+void willis_stats_event(
+	struct willis* context,
+	struct willis_event_info* event_info);
+
+// updates the pressed keys bitset with a translated event
+void willis_keys_update(
+	struct willis* context,
+	struct willis_event_info* event_info);
+
 #endif
@@ -0,0 +1,222 @@
+#define _XOPEN_SOURCE 700
+#include "include/willis.h"
+#include "common/willis_private.h"
+#include "common/willis_queue.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <sched.h>
+#endif
+
+// motion events are refused above this fill level with WILLIS_QUEUE_DROP_MOTION
+// so the remaining slots stay available for key and button events
+#define WILLIS_QUEUE_MOTION_WATERMARK(capacity) ((capacity) - ((capacity) / 4))
+
+static inline void queue_yield(void)
+{
+#ifdef _WIN32
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+}
+
+struct willis_queue* willis_queue_init(
+	struct willis* context,
+	size_t capacity,
+	enum willis_queue_overflow overflow,
+	struct willis_error_info* error)
+{
+	if ((capacity < 2) || (capacity > (SIZE_MAX / 2)))
+	{
+		willis_error_throw(context, error, WILLIS_ERROR_DOMAIN);
+		return NULL;
+	}
+
+	// round the capacity up to a power of two to wrap indices with a mask
+	size_t size = 1;
+
+	while (size < capacity)
+	{
+		size <<= 1;
+	}
+
+	WILLIS_STATS_ADD(context, allocations, 2);
+	struct willis_queue* queue = malloc(sizeof (struct willis_queue));
+
+	if (queue == NULL)
+	{
+		willis_error_throw(context, error, WILLIS_ERROR_ALLOC);
+		return NULL;
+	}
+
+	struct willis_queue zero = {0};
+	*queue = zero;
+
+	queue->slots = malloc(size * (sizeof (struct willis_queue_slot)));
+
+	if (queue->slots == NULL)
+	{
+		free(queue);
+		willis_error_throw(context, error, WILLIS_ERROR_ALLOC);
+		return NULL;
+	}
+
+	queue->mask = size - 1;
+	queue->overflow = overflow;
+
+	willis_error_ok(error);
+	return queue;
+}
+
+// producer side
+bool willis_queue_push(
+	struct willis_queue* queue,
+	struct willis_event_info* event_info)
+{
+	size_t capacity = queue->mask + 1;
+	size_t write = __atomic_load_n(&(queue->write), __ATOMIC_RELAXED);
+	size_t read = __atomic_load_n(&(queue->read), __ATOMIC_ACQUIRE);
+
+	if ((queue->overflow == WILLIS_QUEUE_DROP_MOTION)
+	&& (event_info->event_code == WILLIS_MOUSE_MOTION)
+	&& ((write - read) >= WILLIS_QUEUE_MOTION_WATERMARK(capacity)))
+	{
+		__atomic_add_fetch(&(queue->dropped), 1, __ATOMIC_RELAXED);
+		return false;
+	}
+
+	while ((write - read) >= capacity)
+	{
+		if (queue->overflow == WILLIS_QUEUE_BLOCK)
+		{
+			queue_yield();
+			read = __atomic_load_n(&(queue->read), __ATOMIC_ACQUIRE);
+			continue;
+		}
+
+		// the consumer may be advancing the read index at the same time,
+		// in which case the exchange fails and updates our copy instead
+		if (__atomic_compare_exchange_n(
+			&(queue->read),
+			&read,
+			read + 1,
+			false,
+			__ATOMIC_ACQ_REL,
+			__ATOMIC_ACQUIRE))
+		{
+			free(queue->slots[read & queue->mask].event_info.utf8_string);
+			__atomic_add_fetch(&(queue->dropped), 1, __ATOMIC_RELAXED);
+			++read;
+		}
+	}
+
+	struct willis_queue_slot* slot = &(queue->slots[write & queue->mask]);
+	slot->time = willis_get_time_ns();
+	slot->event_info = *event_info;
+
+	__atomic_store_n(&(queue->write), write + 1, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+// consumer side
+bool willis_queue_pop_until(
+	struct willis_queue* queue,
+	uint64_t cutoff,
+	struct willis_event_info* event_info)
+{
+	size_t read = __atomic_load_n(&(queue->read), __ATOMIC_ACQUIRE);
+	size_t write;
+	struct willis_queue_slot slot;
+
+	while (true)
+	{
+		write = __atomic_load_n(&(queue->write), __ATOMIC_ACQUIRE);
+
+		if (read == write)
+		{
+			return false;
+		}
+
+		// HACK
+		// the producer can drop this slot and overwrite it while we copy it,
+		// so the copy is only trusted once the read index is confirmed below
+		slot = queue->slots[read & queue->mask];
+
+		if (slot.time > cutoff)
+		{
+			size_t check;
+
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			check = __atomic_load_n(&(queue->read), __ATOMIC_RELAXED);
+
+			if (check == read)
+			{
+				return false;
+			}
+
+			read = check;
+			continue;
+		}
+
+		if (__atomic_compare_exchange_n(
+			&(queue->read),
+			&read,
+			read + 1,
+			false,
+			__ATOMIC_ACQ_REL,
+			__ATOMIC_ACQUIRE))
+		{
+			*event_info = slot.event_info;
+			return true;
+		}
+	}
+}
+
+bool willis_queue_pop(
+	struct willis_queue* queue,
+	struct willis_event_info* event_info)
+{
+	return willis_queue_pop_until(queue, UINT64_MAX, event_info);
+}
+
+size_t willis_queue_get_dropped(
+	struct willis_queue* queue)
+{
+	return __atomic_load_n(&(queue->dropped), __ATOMIC_RELAXED);
+}
+
+void willis_queue_clean(
+	struct willis* context,
+	struct willis_queue* queue,
+	struct willis_error_info* error)
+{
+	if (queue == NULL)
+	{
+		willis_error_throw(context, error, WILLIS_ERROR_NULL);
+		return;
+	}
+
+	if (context->queue == queue)
+	{
+		context->queue = NULL;
+	}
+
+	// free the heap strings of the events nobody consumed
+	for (size_t i = queue->read; i != queue->write; ++i)
+	{
+		free(queue->slots[i & queue->mask].event_info.utf8_string);
+	}
+
+	free(queue->slots);
+	free(queue);
+
+	willis_error_ok(error);
+}
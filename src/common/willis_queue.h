@@ -0,0 +1,35 @@
+#ifndef H_WILLIS_QUEUE
+#define H_WILLIS_QUEUE
+
+#include "include/willis.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// we keep the indices on separate cache lines to avoid false sharing
+// between the producer and consumer threads
+#define WILLIS_QUEUE_CACHE_LINE 64
+
+struct willis_queue_slot
+{
+	uint64_t time;
+	struct willis_event_info event_info;
+};
+
+struct willis_queue
+{
+	// only written by the producer
+	size_t write;
+	char pad_write[WILLIS_QUEUE_CACHE_LINE - sizeof (size_t)];
+
+	// written by the consumer, and by the producer when dropping events
+	size_t read;
+	char pad_read[WILLIS_QUEUE_CACHE_LINE - sizeof (size_t)];
+
+	size_t dropped;
+	size_t mask;
+	enum willis_queue_overflow overflow;
+	struct willis_queue_slot* slots;
+};
+
+#endif
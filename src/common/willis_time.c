@@ -0,0 +1,44 @@
+#define _XOPEN_SOURCE 700
+#include "include/willis.h"
+
+#include <stdint.h>
+
+#if defined(_WIN32)
+	#include <windows.h>
+#elif defined(__APPLE__)
+	#include <mach/mach_time.h>
+#else
+	#include <time.h>
+#endif
+
+uint64_t willis_get_time_ns(void)
+{
+#if defined(_WIN32)
+	LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+
+	// split the conversion to avoid overflowing the intermediate product
+	uint64_t seconds = counter.QuadPart / frequency.QuadPart;
+	uint64_t remainder = counter.QuadPart % frequency.QuadPart;
+
+	return (seconds * 1000000000) + ((remainder * 1000000000) / frequency.QuadPart);
+#elif defined(__APPLE__)
+	static mach_timebase_info_data_t timebase = {0};
+
+	if (timebase.denom == 0)
+	{
+		mach_timebase_info(&timebase);
+	}
+
+	return (mach_absolute_time() * timebase.numer) / timebase.denom;
+#else
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+
+	return (((uint64_t) time.tv_sec) * 1000000000) + time.tv_nsec;
+#endif
+}
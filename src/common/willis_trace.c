@@ -0,0 +1,504 @@
+#define _XOPEN_SOURCE 700
+#include "include/willis.h"
+#include "common/willis_private.h"
+#include "common/willis_trace.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <time.h>
+	#include <unistd.h>
+#endif
+
+// records are read in place, which only works on little-endian hosts
+static inline bool trace_little_endian(void)
+{
+	uint16_t value = 1;
+	uint8_t byte;
+
+	memcpy(&byte, &value, 1);
+
+	return byte == 1;
+}
+
+static inline void trace_sleep_until(
+	uint64_t deadline)
+{
+	uint64_t now = willis_get_time_ns();
+
+	if (now >= deadline)
+	{
+		return;
+	}
+
+#ifdef _WIN32
+	Sleep((deadline - now) / 1000000);
+#else
+	struct timespec duration =
+	{
+		.tv_sec = (deadline - now) / 1000000000,
+		.tv_nsec = (deadline - now) % 1000000000,
+	};
+
+	nanosleep(&duration, NULL);
+#endif
+}
+
+// recorder
+struct willis_recorder* willis_recorder_init(
+	struct willis* context,
+	const char* path,
+	struct willis_error_info* error)
+{
+	if (trace_little_endian() == false)
+	{
+		willis_error_throw(context, error, WILLIS_ERROR_DOMAIN);
+		return NULL;
+	}
+
+	struct willis_recorder* recorder = malloc(sizeof (struct willis_recorder));
+
+	if (recorder == NULL)
+	{
+		willis_error_throw(context, error, WILLIS_ERROR_ALLOC);
+		return NULL;
+	}
+
+	struct willis_recorder zero = {0};
+	*recorder = zero;
+
+	recorder->file = fopen(path, "wb");
+
+	if (recorder->file == NULL)
+	{
+		free(recorder);
+		willis_error_throw(context, error, WILLIS_ERROR_FD);
+		return NULL;
+	}
+
+	// the header is written again with the final counts when closing
+	struct willis_trace_header header = {0};
+
+	if (fwrite(&header, sizeof (header), 1, recorder->file) != 1)
+	{
+		fclose(recorder->file);
+		free(recorder);
+		willis_error_throw(context, error, WILLIS_ERROR_FD);
+		return NULL;
+	}
+
+	willis_error_ok(error);
+	return recorder;
+}
+
+void willis_recorder_write(
+	struct willis* context,
+	struct willis_event_info* event_info)
+{
+	struct willis_recorder* recorder = context->recorder;
+
+	if ((event_info->event_code == WILLIS_NONE) || (recorder->failed == true))
+	{
+		return;
+	}
+
+	struct willis_trace_record record =
+	{
+		.time_ns = event_info->time_ns,
+		.time_native_ns = event_info->time_native_ns,
+		.diff_x = event_info->diff_x,
+		.diff_y = event_info->diff_y,
+		.mouse_x = event_info->mouse_x,
+		.mouse_y = event_info->mouse_y,
+		.mouse_wheel_steps = event_info->mouse_wheel_steps,
+		.event_code = event_info->event_code,
+		.event_state = event_info->event_state,
+		.utf8_offset = 0,
+		.utf8_size = 0,
+	};
+
+	// the text is in the inline buffer unless it overflowed it
+	const char* utf8 = event_info->utf8_buffer;
+
+	if (event_info->utf8_overflow == true)
+	{
+		utf8 = event_info->utf8_string;
+	}
+
+	if ((utf8 != NULL) && (event_info->utf8_size > 0))
+	{
+		size_t size = event_info->utf8_size;
+
+		if ((recorder->arena_size + size) > recorder->arena_capacity)
+		{
+			size_t capacity = (recorder->arena_capacity * 2) + size;
+			char* arena = realloc(recorder->arena, capacity);
+
+			if (arena == NULL)
+			{
+				recorder->failed = true;
+				return;
+			}
+
+			WILLIS_STATS_ADD(context, allocations, 1);
+			recorder->arena = arena;
+			recorder->arena_capacity = capacity;
+		}
+
+		memcpy(recorder->arena + recorder->arena_size, utf8, size);
+		record.utf8_offset = recorder->arena_size;
+		record.utf8_size = size;
+		recorder->arena_size += size;
+	}
+
+	if (fwrite(&record, sizeof (record), 1, recorder->file) != 1)
+	{
+		recorder->failed = true;
+		return;
+	}
+
+	++(recorder->record_count);
+}
+
+void willis_set_recorder(
+	struct willis* context,
+	struct willis_recorder* recorder,
+	struct willis_error_info* error)
+{
+	context->recorder = recorder;
+	willis_error_ok(error);
+}
+
+void willis_recorder_clean(
+	struct willis* context,
+	struct willis_recorder* recorder,
+	struct willis_error_info* error)
+{
+	if (recorder == NULL)
+	{
+		willis_error_throw(context, error, WILLIS_ERROR_NULL);
+		return;
+	}
+
+	if (context->recorder == recorder)
+	{
+		context->recorder = NULL;
+	}
+
+	// append the arena and finalize the header
+	struct willis_trace_header header =
+	{
+		.version = WILLIS_TRACE_VERSION,
+		.record_size = sizeof (struct willis_trace_record),
+		.reserved = 0,
+		.record_count = recorder->record_count,
+		.arena_offset =
+			(sizeof (struct willis_trace_header))
+			+ (recorder->record_count * (sizeof (struct willis_trace_record))),
+	};
+
+	memcpy(header.magic, WILLIS_TRACE_MAGIC, 4);
+
+	bool failed = recorder->failed;
+
+	if ((failed == false) && (recorder->arena_size > 0))
+	{
+		failed =
+			fwrite(recorder->arena, recorder->arena_size, 1, recorder->file) != 1;
+	}
+
+	if (failed == false)
+	{
+		failed =
+			(fseek(recorder->file, 0, SEEK_SET) != 0)
+			|| (fwrite(&header, sizeof (header), 1, recorder->file) != 1);
+	}
+
+	if (fclose(recorder->file) != 0)
+	{
+		failed = true;
+	}
+
+	free(recorder->arena);
+	free(recorder);
+
+	if (failed == true)
+	{
+		willis_error_throw(context, error, WILLIS_ERROR_FD);
+		return;
+	}
+
+	willis_error_ok(error);
+}
+
+// reader
+static void trace_unmap(
+	struct willis_trace* trace)
+{
+#ifdef _WIN32
+	UnmapViewOfFile(trace->map);
+	CloseHandle(trace->mapping);
+	CloseHandle(trace->file);
+#else
+	munmap(trace->map, trace->map_size);
+#endif
+}
+
+static bool trace_map(
+	struct willis_trace* trace,
+	const char* path)
+{
+#ifdef _WIN32
+	LARGE_INTEGER size;
+
+	trace->file =
+		CreateFileA(
+			path,
+			GENERIC_READ,
+			FILE_SHARE_READ,
+			NULL,
+			OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL,
+			NULL);
+
+	if (trace->file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	if ((GetFileSizeEx(trace->file, &size) == 0) || (size.QuadPart == 0))
+	{
+		CloseHandle(trace->file);
+		return false;
+	}
+
+	trace->map_size = size.QuadPart;
+	trace->mapping = CreateFileMappingA(trace->file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+	if (trace->mapping == NULL)
+	{
+		CloseHandle(trace->file);
+		return false;
+	}
+
+	trace->map = MapViewOfFile(trace->mapping, FILE_MAP_READ, 0, 0, 0);
+
+	if (trace->map == NULL)
+	{
+		CloseHandle(trace->mapping);
+		CloseHandle(trace->file);
+		return false;
+	}
+#else
+	struct stat info;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	if ((fstat(fd, &info) != 0) || (info.st_size == 0))
+	{
+		close(fd);
+		return false;
+	}
+
+	trace->map_size = info.st_size;
+	trace->map = mmap(NULL, trace->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (trace->map == MAP_FAILED)
+	{
+		return false;
+	}
+#endif
+
+	return true;
+}
+
+struct willis_trace* willis_trace_init(
+	struct willis* context,
+	const char* path,
+	struct willis_error_info* error)
+{
+	if (trace_little_endian() == false)
+	{
+		willis_error_throw(context, error, WILLIS_ERROR_DOMAIN);
+		return NULL;
+	}
+
+	struct willis_trace* trace = malloc(sizeof (struct willis_trace));
+
+	if (trace == NULL)
+	{
+		willis_error_throw(context, error, WILLIS_ERROR_ALLOC);
+		return NULL;
+	}
+
+	struct willis_trace zero = {0};
+	*trace = zero;
+
+	if (trace_map(trace, path) == false)
+	{
+		free(trace);
+		willis_error_throw(context, error, WILLIS_ERROR_FD);
+		return NULL;
+	}
+
+	// validate the header before trusting any offset
+	const struct willis_trace_header* header = trace->map;
+	size_t records_size = 0;
+	bool valid = trace->map_size >= (sizeof (struct willis_trace_header));
+
+	if (valid == true)
+	{
+		valid =
+			(memcmp(header->magic, WILLIS_TRACE_MAGIC, 4) == 0)
+			&& (header->version == WILLIS_TRACE_VERSION)
+			&& (header->record_size == (sizeof (struct willis_trace_record)))
+			&& (header->record_count
+				<= (trace->map_size / (sizeof (struct willis_trace_record))));
+	}
+
+	if (valid == true)
+	{
+		records_size = header->record_count * (sizeof (struct willis_trace_record));
+
+		valid =
+			header->arena_offset
+				== ((sizeof (struct willis_trace_header)) + records_size)
+			&& (header->arena_offset <= trace->map_size);
+	}
+
+	if (valid == false)
+	{
+		trace_unmap(trace);
+		free(trace);
+		willis_error_throw(context, error, WILLIS_ERROR_DOMAIN);
+		return NULL;
+	}
+
+	trace->records =
+		(const struct willis_trace_record*)
+			(((const char*) trace->map) + (sizeof (struct willis_trace_header)));
+	trace->record_count = header->record_count;
+	trace->arena = ((const char*) trace->map) + header->arena_offset;
+	trace->arena_size = trace->map_size - header->arena_offset;
+
+	willis_error_ok(error);
+	return trace;
+}
+
+const struct willis_trace_record* willis_trace_get_records(
+	struct willis_trace* trace,
+	size_t* count)
+{
+	*count = trace->record_count;
+	return trace->records;
+}
+
+const char* willis_trace_get_utf8(
+	struct willis_trace* trace,
+	const struct willis_trace_record* record)
+{
+	if ((record->utf8_size == 0)
+	|| (record->utf8_offset > trace->arena_size)
+	|| (record->utf8_size > (trace->arena_size - record->utf8_offset)))
+	{
+		return NULL;
+	}
+
+	return trace->arena + record->utf8_offset;
+}
+
+bool willis_trace_replay(
+	struct willis_trace* trace,
+	double speed,
+	struct willis_event_info* event_info)
+{
+	if (trace->next >= trace->record_count)
+	{
+		return false;
+	}
+
+	const struct willis_trace_record* record = &(trace->records[trace->next]);
+
+	if (trace->next == 0)
+	{
+		trace->replay_start = willis_get_time_ns();
+	}
+
+	// wait for the scaled time of the record, or not at all
+	if (speed > 0.0)
+	{
+		uint64_t offset = record->time_ns - trace->records[0].time_ns;
+
+		trace_sleep_until(trace->replay_start + (uint64_t) (offset / speed));
+	}
+
+	struct willis_event_info zero = {0};
+	*event_info = zero;
+
+	event_info->event_code = record->event_code;
+	event_info->event_state = record->event_state;
+	event_info->mouse_wheel_steps = record->mouse_wheel_steps;
+	event_info->mouse_x = record->mouse_x;
+	event_info->mouse_y = record->mouse_y;
+	event_info->diff_x = record->diff_x;
+	event_info->diff_y = record->diff_y;
+	event_info->time_native_ns = record->time_native_ns;
+	event_info->time_ns = willis_get_time_ns();
+
+	// texts too long for the inline buffer are not replayed
+	const char* utf8 = willis_trace_get_utf8(trace, record);
+
+	event_info->utf8_size = record->utf8_size;
+
+	if ((utf8 != NULL) && (record->utf8_size < WILLIS_UTF8_BUFFER_SIZE))
+	{
+		memcpy(event_info->utf8_buffer, utf8, record->utf8_size);
+		event_info->utf8_buffer[record->utf8_size] = '\0';
+	}
+	else if (record->utf8_size > 0)
+	{
+		event_info->utf8_overflow = true;
+	}
+
+	++(trace->next);
+
+	return true;
+}
+
+void willis_trace_rewind(
+	struct willis_trace* trace)
+{
+	trace->next = 0;
+}
+
+void willis_trace_clean(
+	struct willis* context,
+	struct willis_trace* trace,
+	struct willis_error_info* error)
+{
+	if (trace == NULL)
+	{
+		willis_error_throw(context, error, WILLIS_ERROR_NULL);
+		return;
+	}
+
+	trace_unmap(trace);
+	free(trace);
+
+	willis_error_ok(error);
+}
@@ -0,0 +1,62 @@
+#ifndef H_WILLIS_TRACE
+#define H_WILLIS_TRACE
+
+#include "include/willis.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// file layout: header, fixed-size records, then the utf-8 arena
+// all values are stored in little-endian order
+#define WILLIS_TRACE_MAGIC "WLTR"
+#define WILLIS_TRACE_VERSION 1
+
+struct willis_trace_header
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t reserved;
+	uint64_t record_count;
+	uint64_t arena_offset;
+};
+
+struct willis_recorder
+{
+	FILE* file;
+	uint64_t record_count;
+
+	char* arena;
+	size_t arena_size;
+	size_t arena_capacity;
+
+	bool failed;
+};
+
+struct willis_trace
+{
+	void* map;
+	size_t map_size;
+#ifdef _WIN32
+	void* file;
+	void* mapping;
+#endif
+
+	const struct willis_trace_record* records;
+	size_t record_count;
+	const char* arena;
+	size_t arena_size;
+
+	// replay cursor
+	size_t next;
+	uint64_t replay_start;
+};
+
+// appends a translated event to the attached recorder
+void willis_recorder_write(
+	struct willis* context,
+	struct willis_event_info* event_info);
+
+#endif
@@ -6,6 +6,13 @@
 #include <stdint.h>
 
 struct willis;
+struct willis_queue;
+struct willis_recorder;
+struct willis_trace;
+
+// inline utf-8 storage size, enough for any keysym and composed sequence
+// (the terminating NUL byte is stored in the buffer as well)
+#define WILLIS_UTF8_BUFFER_SIZE 64
 
 enum willis_error
 {
@@ -54,151 +61,151 @@ enum willis_error
 	WILLIS_ERROR_WAYLAND_POINTER_GET,
 	WILLIS_ERROR_WAYLAND_KEYBOARD_GET,
 
+	// new codes are appended so the values of the existing ones don't change
+	WILLIS_ERROR_X11_CONNECT,
+	WILLIS_ERROR_X11_XINPUT_VERSION,
+	WILLIS_ERROR_X11_THREAD_START,
+
+	WILLIS_ERROR_X11_XINPUT_QUERY_DEVICE,
+
+	WILLIS_ERROR_XKB_KEYMAP_NEW,
+	WILLIS_ERROR_XKB_STATE_NEW,
+
+	WILLIS_ERROR_WINDOW_LIMIT,
+	WILLIS_ERROR_WINDOW_UNKNOWN,
+	WILLIS_ERROR_WINDOW_UNSUPPORTED,
+
 	WILLIS_ERROR_COUNT,
 };
 
+// event codes and their native keycodes, used to generate the enum below,
+// the code names and the keycode translation tables of every backend:
+// X(event code, X11 keycode, win32 virtual-key code, macOS virtual keycode)
+// native keycodes are given as WILLIS_NATIVE(keycode) or WILLIS_NATIVE_NONE
+//
+// WILLIS_NONE must stay the first one so it is zero, this way sparse LUTs
+// can help detecting invalid inputs (this is used when translating keycodes),
+// the mouse events come next, followed by the keyboard keys in the order
+// of a standard PC keyboard, new keys are appended so the values of the
+// existing codes don't change (scroll lock and pause do not exist on macOS)
+#define WILLIS_KEYS(X) \
+	X(WILLIS_NONE,                 WILLIS_NATIVE_NONE, WILLIS_NATIVE_NONE,           WILLIS_NATIVE_NONE) \
+	X(WILLIS_MOUSE_CLICK_LEFT,     WILLIS_NATIVE_NONE, WILLIS_NATIVE_NONE,           WILLIS_NATIVE_NONE) \
+	X(WILLIS_MOUSE_CLICK_RIGHT,    WILLIS_NATIVE_NONE, WILLIS_NATIVE_NONE,           WILLIS_NATIVE_NONE) \
+	X(WILLIS_MOUSE_CLICK_MIDDLE,   WILLIS_NATIVE_NONE, WILLIS_NATIVE_NONE,           WILLIS_NATIVE_NONE) \
+	X(WILLIS_MOUSE_WHEEL_UP,       WILLIS_NATIVE_NONE, WILLIS_NATIVE_NONE,           WILLIS_NATIVE_NONE) \
+	X(WILLIS_MOUSE_WHEEL_DOWN,     WILLIS_NATIVE_NONE, WILLIS_NATIVE_NONE,           WILLIS_NATIVE_NONE) \
+	X(WILLIS_MOUSE_MOTION,         WILLIS_NATIVE_NONE, WILLIS_NATIVE_NONE,           WILLIS_NATIVE_NONE) \
+	X(WILLIS_KEY_ESCAPE,           WILLIS_NATIVE(9),   WILLIS_NATIVE(VK_ESCAPE),     WILLIS_NATIVE(kVK_Escape)) \
+	X(WILLIS_KEY_F1,               WILLIS_NATIVE(67),  WILLIS_NATIVE(VK_F1),         WILLIS_NATIVE(kVK_F1)) \
+	X(WILLIS_KEY_F2,               WILLIS_NATIVE(68),  WILLIS_NATIVE(VK_F2),         WILLIS_NATIVE(kVK_F2)) \
+	X(WILLIS_KEY_F3,               WILLIS_NATIVE(69),  WILLIS_NATIVE(VK_F3),         WILLIS_NATIVE(kVK_F3)) \
+	X(WILLIS_KEY_F4,               WILLIS_NATIVE(70),  WILLIS_NATIVE(VK_F4),         WILLIS_NATIVE(kVK_F4)) \
+	X(WILLIS_KEY_F5,               WILLIS_NATIVE(71),  WILLIS_NATIVE(VK_F5),         WILLIS_NATIVE(kVK_F5)) \
+	X(WILLIS_KEY_F6,               WILLIS_NATIVE(72),  WILLIS_NATIVE(VK_F6),         WILLIS_NATIVE(kVK_F6)) \
+	X(WILLIS_KEY_F7,               WILLIS_NATIVE(73),  WILLIS_NATIVE(VK_F7),         WILLIS_NATIVE(kVK_F7)) \
+	X(WILLIS_KEY_F8,               WILLIS_NATIVE(74),  WILLIS_NATIVE(VK_F8),         WILLIS_NATIVE(kVK_F8)) \
+	X(WILLIS_KEY_F9,               WILLIS_NATIVE(75),  WILLIS_NATIVE(VK_F9),         WILLIS_NATIVE(kVK_F9)) \
+	X(WILLIS_KEY_F10,              WILLIS_NATIVE(76),  WILLIS_NATIVE(VK_F10),        WILLIS_NATIVE(kVK_F10)) \
+	X(WILLIS_KEY_F11,              WILLIS_NATIVE(95),  WILLIS_NATIVE(VK_F11),        WILLIS_NATIVE(kVK_F11)) \
+	X(WILLIS_KEY_F12,              WILLIS_NATIVE(96),  WILLIS_NATIVE(VK_F12),        WILLIS_NATIVE(kVK_F12)) \
+	X(WILLIS_KEY_GRAVE,            WILLIS_NATIVE(49),  WILLIS_NATIVE(VK_OEM_3),      WILLIS_NATIVE(kVK_ANSI_Grave)) \
+	X(WILLIS_KEY_1,                WILLIS_NATIVE(10),  WILLIS_NATIVE('1'),           WILLIS_NATIVE(kVK_ANSI_1)) \
+	X(WILLIS_KEY_2,                WILLIS_NATIVE(11),  WILLIS_NATIVE('2'),           WILLIS_NATIVE(kVK_ANSI_2)) \
+	X(WILLIS_KEY_3,                WILLIS_NATIVE(12),  WILLIS_NATIVE('3'),           WILLIS_NATIVE(kVK_ANSI_3)) \
+	X(WILLIS_KEY_4,                WILLIS_NATIVE(13),  WILLIS_NATIVE('4'),           WILLIS_NATIVE(kVK_ANSI_4)) \
+	X(WILLIS_KEY_5,                WILLIS_NATIVE(14),  WILLIS_NATIVE('5'),           WILLIS_NATIVE(kVK_ANSI_5)) \
+	X(WILLIS_KEY_6,                WILLIS_NATIVE(15),  WILLIS_NATIVE('6'),           WILLIS_NATIVE(kVK_ANSI_6)) \
+	X(WILLIS_KEY_7,                WILLIS_NATIVE(16),  WILLIS_NATIVE('7'),           WILLIS_NATIVE(kVK_ANSI_7)) \
+	X(WILLIS_KEY_8,                WILLIS_NATIVE(17),  WILLIS_NATIVE('8'),           WILLIS_NATIVE(kVK_ANSI_8)) \
+	X(WILLIS_KEY_9,                WILLIS_NATIVE(18),  WILLIS_NATIVE('9'),           WILLIS_NATIVE(kVK_ANSI_9)) \
+	X(WILLIS_KEY_0,                WILLIS_NATIVE(19),  WILLIS_NATIVE('0'),           WILLIS_NATIVE(kVK_ANSI_0)) \
+	X(WILLIS_KEY_HYPHEN_MINUS,     WILLIS_NATIVE(20),  WILLIS_NATIVE(VK_OEM_MINUS),  WILLIS_NATIVE(kVK_ANSI_Minus)) \
+	X(WILLIS_KEY_EQUALS,           WILLIS_NATIVE(21),  WILLIS_NATIVE(VK_OEM_PLUS),   WILLIS_NATIVE(kVK_ANSI_Equal)) \
+	X(WILLIS_KEY_BACKSPACE,        WILLIS_NATIVE(22),  WILLIS_NATIVE(VK_BACK),       WILLIS_NATIVE(kVK_Delete)) \
+	X(WILLIS_KEY_TAB,              WILLIS_NATIVE(23),  WILLIS_NATIVE(VK_TAB),        WILLIS_NATIVE(kVK_Tab)) \
+	X(WILLIS_KEY_Q,                WILLIS_NATIVE(24),  WILLIS_NATIVE('Q'),           WILLIS_NATIVE(kVK_ANSI_Q)) \
+	X(WILLIS_KEY_W,                WILLIS_NATIVE(25),  WILLIS_NATIVE('W'),           WILLIS_NATIVE(kVK_ANSI_W)) \
+	X(WILLIS_KEY_E,                WILLIS_NATIVE(26),  WILLIS_NATIVE('E'),           WILLIS_NATIVE(kVK_ANSI_E)) \
+	X(WILLIS_KEY_R,                WILLIS_NATIVE(27),  WILLIS_NATIVE('R'),           WILLIS_NATIVE(kVK_ANSI_R)) \
+	X(WILLIS_KEY_T,                WILLIS_NATIVE(28),  WILLIS_NATIVE('T'),           WILLIS_NATIVE(kVK_ANSI_T)) \
+	X(WILLIS_KEY_Y,                WILLIS_NATIVE(29),  WILLIS_NATIVE('Y'),           WILLIS_NATIVE(kVK_ANSI_Y)) \
+	X(WILLIS_KEY_U,                WILLIS_NATIVE(30),  WILLIS_NATIVE('U'),           WILLIS_NATIVE(kVK_ANSI_U)) \
+	X(WILLIS_KEY_I,                WILLIS_NATIVE(31),  WILLIS_NATIVE('I'),           WILLIS_NATIVE(kVK_ANSI_I)) \
+	X(WILLIS_KEY_O,                WILLIS_NATIVE(32),  WILLIS_NATIVE('O'),           WILLIS_NATIVE(kVK_ANSI_O)) \
+	X(WILLIS_KEY_P,                WILLIS_NATIVE(33),  WILLIS_NATIVE('P'),           WILLIS_NATIVE(kVK_ANSI_P)) \
+	X(WILLIS_KEY_BRACKET_LEFT,     WILLIS_NATIVE(34),  WILLIS_NATIVE(VK_OEM_4),      WILLIS_NATIVE(kVK_ANSI_LeftBracket)) \
+	X(WILLIS_KEY_BRACKET_RIGHT,    WILLIS_NATIVE(35),  WILLIS_NATIVE(VK_OEM_6),      WILLIS_NATIVE(kVK_ANSI_RightBracket)) \
+	X(WILLIS_KEY_ANTISLASH,        WILLIS_NATIVE(51),  WILLIS_NATIVE(VK_OEM_5),      WILLIS_NATIVE(kVK_ANSI_Backslash)) \
+	X(WILLIS_KEY_CAPS_LOCK,        WILLIS_NATIVE(66),  WILLIS_NATIVE(VK_CAPITAL),    WILLIS_NATIVE(kVK_CapsLock)) \
+	X(WILLIS_KEY_A,                WILLIS_NATIVE(38),  WILLIS_NATIVE('A'),           WILLIS_NATIVE(kVK_ANSI_A)) \
+	X(WILLIS_KEY_S,                WILLIS_NATIVE(39),  WILLIS_NATIVE('S'),           WILLIS_NATIVE(kVK_ANSI_S)) \
+	X(WILLIS_KEY_D,                WILLIS_NATIVE(40),  WILLIS_NATIVE('D'),           WILLIS_NATIVE(kVK_ANSI_D)) \
+	X(WILLIS_KEY_F,                WILLIS_NATIVE(41),  WILLIS_NATIVE('F'),           WILLIS_NATIVE(kVK_ANSI_F)) \
+	X(WILLIS_KEY_G,                WILLIS_NATIVE(42),  WILLIS_NATIVE('G'),           WILLIS_NATIVE(kVK_ANSI_G)) \
+	X(WILLIS_KEY_H,                WILLIS_NATIVE(43),  WILLIS_NATIVE('H'),           WILLIS_NATIVE(kVK_ANSI_H)) \
+	X(WILLIS_KEY_J,                WILLIS_NATIVE(44),  WILLIS_NATIVE('J'),           WILLIS_NATIVE(kVK_ANSI_J)) \
+	X(WILLIS_KEY_K,                WILLIS_NATIVE(45),  WILLIS_NATIVE('K'),           WILLIS_NATIVE(kVK_ANSI_K)) \
+	X(WILLIS_KEY_L,                WILLIS_NATIVE(46),  WILLIS_NATIVE('L'),           WILLIS_NATIVE(kVK_ANSI_L)) \
+	X(WILLIS_KEY_SEMICOLON,        WILLIS_NATIVE(47),  WILLIS_NATIVE(VK_OEM_1),      WILLIS_NATIVE(kVK_ANSI_Semicolon)) \
+	X(WILLIS_KEY_APOSTROPHE,       WILLIS_NATIVE(48),  WILLIS_NATIVE(VK_OEM_7),      WILLIS_NATIVE(kVK_ANSI_Quote)) \
+	X(WILLIS_KEY_ENTER,            WILLIS_NATIVE(36),  WILLIS_NATIVE(VK_RETURN),     WILLIS_NATIVE(kVK_Return)) \
+	X(WILLIS_KEY_SHIFT_LEFT,       WILLIS_NATIVE(50),  WILLIS_NATIVE(VK_SHIFT),      WILLIS_NATIVE(kVK_Shift)) \
+	X(WILLIS_KEY_Z,                WILLIS_NATIVE(52),  WILLIS_NATIVE('Z'),           WILLIS_NATIVE(kVK_ANSI_Z)) \
+	X(WILLIS_KEY_X,                WILLIS_NATIVE(53),  WILLIS_NATIVE('X'),           WILLIS_NATIVE(kVK_ANSI_X)) \
+	X(WILLIS_KEY_C,                WILLIS_NATIVE(54),  WILLIS_NATIVE('C'),           WILLIS_NATIVE(kVK_ANSI_C)) \
+	X(WILLIS_KEY_V,                WILLIS_NATIVE(55),  WILLIS_NATIVE('V'),           WILLIS_NATIVE(kVK_ANSI_V)) \
+	X(WILLIS_KEY_B,                WILLIS_NATIVE(56),  WILLIS_NATIVE('B'),           WILLIS_NATIVE(kVK_ANSI_B)) \
+	X(WILLIS_KEY_N,                WILLIS_NATIVE(57),  WILLIS_NATIVE('N'),           WILLIS_NATIVE(kVK_ANSI_N)) \
+	X(WILLIS_KEY_M,                WILLIS_NATIVE(58),  WILLIS_NATIVE('M'),           WILLIS_NATIVE(kVK_ANSI_M)) \
+	X(WILLIS_KEY_COMMA,            WILLIS_NATIVE(59),  WILLIS_NATIVE(VK_OEM_COMMA),  WILLIS_NATIVE(kVK_ANSI_Comma)) \
+	X(WILLIS_KEY_PERIOD,           WILLIS_NATIVE(60),  WILLIS_NATIVE(VK_OEM_PERIOD), WILLIS_NATIVE(kVK_ANSI_Period)) \
+	X(WILLIS_KEY_SLASH,            WILLIS_NATIVE(61),  WILLIS_NATIVE(VK_OEM_2),      WILLIS_NATIVE(kVK_ANSI_Slash)) \
+	X(WILLIS_KEY_SHIFT_RIGHT,      WILLIS_NATIVE(62),  WILLIS_NATIVE_NONE,           WILLIS_NATIVE(kVK_RightShift)) \
+	X(WILLIS_KEY_CTRL_LEFT,        WILLIS_NATIVE(37),  WILLIS_NATIVE(VK_CONTROL),    WILLIS_NATIVE(kVK_Control)) \
+	X(WILLIS_KEY_MOD_LEFT,         WILLIS_NATIVE(133), WILLIS_NATIVE(VK_LWIN),       WILLIS_NATIVE(kVK_Command)) \
+	X(WILLIS_KEY_ALT_LEFT,         WILLIS_NATIVE(64),  WILLIS_NATIVE(VK_MENU),       WILLIS_NATIVE(kVK_Option)) \
+	X(WILLIS_KEY_SPACE,            WILLIS_NATIVE(65),  WILLIS_NATIVE(VK_SPACE),      WILLIS_NATIVE(kVK_Space)) \
+	X(WILLIS_KEY_ALT_RIGHT,        WILLIS_NATIVE(108), WILLIS_NATIVE(VK_OEM_102),    WILLIS_NATIVE(kVK_RightOption)) \
+	X(WILLIS_KEY_MOD_RIGHT,        WILLIS_NATIVE(134), WILLIS_NATIVE(VK_RWIN),       WILLIS_NATIVE(kVK_RightCommand)) \
+	X(WILLIS_KEY_MENU,             WILLIS_NATIVE(135), WILLIS_NATIVE(VK_APPS),       WILLIS_NATIVE(0x6E)) \
+	X(WILLIS_KEY_CTRL_RIGHT,       WILLIS_NATIVE(105), WILLIS_NATIVE_NONE,           WILLIS_NATIVE(kVK_RightControl)) \
+	X(WILLIS_KEY_PRINT_SCREEN,     WILLIS_NATIVE(107), WILLIS_NATIVE(VK_SNAPSHOT),   WILLIS_NATIVE(kVK_F13)) \
+	X(WILLIS_KEY_INSERT,           WILLIS_NATIVE(118), WILLIS_NATIVE(VK_INSERT),     WILLIS_NATIVE(kVK_Help)) \
+	X(WILLIS_KEY_DELETE,           WILLIS_NATIVE(119), WILLIS_NATIVE(VK_DELETE),     WILLIS_NATIVE(kVK_ForwardDelete)) \
+	X(WILLIS_KEY_HOME,             WILLIS_NATIVE(110), WILLIS_NATIVE(VK_HOME),       WILLIS_NATIVE(kVK_Home)) \
+	X(WILLIS_KEY_END,              WILLIS_NATIVE(115), WILLIS_NATIVE(VK_END),        WILLIS_NATIVE(kVK_End)) \
+	X(WILLIS_KEY_PAGE_UP,          WILLIS_NATIVE(112), WILLIS_NATIVE(VK_PRIOR),      WILLIS_NATIVE(kVK_PageUp)) \
+	X(WILLIS_KEY_PAGE_DOWN,        WILLIS_NATIVE(117), WILLIS_NATIVE(VK_NEXT),       WILLIS_NATIVE(kVK_PageDown)) \
+	X(WILLIS_KEY_UP,               WILLIS_NATIVE(111), WILLIS_NATIVE(VK_UP),         WILLIS_NATIVE(kVK_UpArrow)) \
+	X(WILLIS_KEY_DOWN,             WILLIS_NATIVE(116), WILLIS_NATIVE(VK_DOWN),       WILLIS_NATIVE(kVK_DownArrow)) \
+	X(WILLIS_KEY_LEFT,             WILLIS_NATIVE(113), WILLIS_NATIVE(VK_LEFT),       WILLIS_NATIVE(kVK_LeftArrow)) \
+	X(WILLIS_KEY_RIGHT,            WILLIS_NATIVE(114), WILLIS_NATIVE(VK_RIGHT),      WILLIS_NATIVE(kVK_RightArrow)) \
+	X(WILLIS_KEY_NUM_LOCK,         WILLIS_NATIVE(77),  WILLIS_NATIVE(VK_NUMLOCK),    WILLIS_NATIVE(kVK_ANSI_KeypadClear)) \
+	X(WILLIS_KEY_NUM_SLASH,        WILLIS_NATIVE(106), WILLIS_NATIVE(VK_DIVIDE),     WILLIS_NATIVE(kVK_ANSI_KeypadDivide)) \
+	X(WILLIS_KEY_NUM_ASTERISK,     WILLIS_NATIVE(63),  WILLIS_NATIVE(VK_MULTIPLY),   WILLIS_NATIVE(kVK_ANSI_KeypadMultiply)) \
+	X(WILLIS_KEY_NUM_HYPHEN_MINUS, WILLIS_NATIVE(82),  WILLIS_NATIVE(VK_SUBTRACT),   WILLIS_NATIVE(kVK_ANSI_KeypadMinus)) \
+	X(WILLIS_KEY_NUM_PLUS,         WILLIS_NATIVE(86),  WILLIS_NATIVE(VK_ADD),        WILLIS_NATIVE(kVK_ANSI_KeypadPlus)) \
+	X(WILLIS_KEY_NUM_ENTER,        WILLIS_NATIVE(104), WILLIS_NATIVE_NONE,           WILLIS_NATIVE(kVK_ANSI_KeypadEnter)) \
+	X(WILLIS_KEY_NUM_DELETE,       WILLIS_NATIVE(91),  WILLIS_NATIVE(VK_DECIMAL),    WILLIS_NATIVE(kVK_ANSI_KeypadDecimal)) \
+	X(WILLIS_KEY_NUM_0,            WILLIS_NATIVE(90),  WILLIS_NATIVE(VK_NUMPAD0),    WILLIS_NATIVE(kVK_ANSI_Keypad0)) \
+	X(WILLIS_KEY_NUM_1,            WILLIS_NATIVE(87),  WILLIS_NATIVE(VK_NUMPAD1),    WILLIS_NATIVE(kVK_ANSI_Keypad1)) \
+	X(WILLIS_KEY_NUM_2,            WILLIS_NATIVE(88),  WILLIS_NATIVE(VK_NUMPAD2),    WILLIS_NATIVE(kVK_ANSI_Keypad2)) \
+	X(WILLIS_KEY_NUM_3,            WILLIS_NATIVE(89),  WILLIS_NATIVE(VK_NUMPAD3),    WILLIS_NATIVE(kVK_ANSI_Keypad3)) \
+	X(WILLIS_KEY_NUM_4,            WILLIS_NATIVE(83),  WILLIS_NATIVE(VK_NUMPAD4),    WILLIS_NATIVE(kVK_ANSI_Keypad4)) \
+	X(WILLIS_KEY_NUM_5,            WILLIS_NATIVE(84),  WILLIS_NATIVE(VK_NUMPAD5),    WILLIS_NATIVE(kVK_ANSI_Keypad5)) \
+	X(WILLIS_KEY_NUM_6,            WILLIS_NATIVE(85),  WILLIS_NATIVE(VK_NUMPAD6),    WILLIS_NATIVE(kVK_ANSI_Keypad6)) \
+	X(WILLIS_KEY_NUM_7,            WILLIS_NATIVE(79),  WILLIS_NATIVE(VK_NUMPAD7),    WILLIS_NATIVE(kVK_ANSI_Keypad7)) \
+	X(WILLIS_KEY_NUM_8,            WILLIS_NATIVE(80),  WILLIS_NATIVE(VK_NUMPAD8),    WILLIS_NATIVE(kVK_ANSI_Keypad8)) \
+	X(WILLIS_KEY_NUM_9,            WILLIS_NATIVE(81),  WILLIS_NATIVE(VK_NUMPAD9),    WILLIS_NATIVE(kVK_ANSI_Keypad9)) \
+	X(WILLIS_KEY_SCROLL_LOCK,      WILLIS_NATIVE(78),  WILLIS_NATIVE(VK_SCROLL),     WILLIS_NATIVE_NONE) \
+	X(WILLIS_KEY_PAUSE,            WILLIS_NATIVE(127), WILLIS_NATIVE(VK_PAUSE),      WILLIS_NATIVE_NONE)
+
 enum willis_event_code
 {
-	// we must set this one to zero, this way sparse LUTs can help detecting
-	// invalid inputs (this is used when translating X11 keycodes for example)
-	WILLIS_NONE = 0,
-
-	// state-triggered switches
-	WILLIS_MOUSE_CLICK_LEFT,
-	WILLIS_MOUSE_CLICK_RIGHT,
-	WILLIS_MOUSE_CLICK_MIDDLE,
-
-	// edge-triggered switches
-	WILLIS_MOUSE_WHEEL_UP,
-	WILLIS_MOUSE_WHEEL_DOWN,
-
-	// position events
-	WILLIS_MOUSE_MOTION,
-
-	// important keys
-	WILLIS_KEY_ESCAPE,
-
-	// function keys
-	WILLIS_KEY_F1,
-	WILLIS_KEY_F2,
-	WILLIS_KEY_F3,
-	WILLIS_KEY_F4,
-	WILLIS_KEY_F5,
-	WILLIS_KEY_F6,
-	WILLIS_KEY_F7,
-	WILLIS_KEY_F8,
-	WILLIS_KEY_F9,
-	WILLIS_KEY_F10,
-	WILLIS_KEY_F11,
-	WILLIS_KEY_F12,
-
-	// helpful keys
-	WILLIS_KEY_GRAVE,
-	WILLIS_KEY_1,
-	WILLIS_KEY_2,
-	WILLIS_KEY_3,
-	WILLIS_KEY_4,
-	WILLIS_KEY_5,
-	WILLIS_KEY_6,
-	WILLIS_KEY_7,
-	WILLIS_KEY_8,
-	WILLIS_KEY_9,
-	WILLIS_KEY_0,
-	WILLIS_KEY_HYPHEN_MINUS,
-	WILLIS_KEY_EQUALS,
-	WILLIS_KEY_BACKSPACE,
-
-	WILLIS_KEY_TAB,
-	WILLIS_KEY_Q,
-	WILLIS_KEY_W,
-	WILLIS_KEY_E,
-	WILLIS_KEY_R,
-	WILLIS_KEY_T,
-	WILLIS_KEY_Y,
-	WILLIS_KEY_U,
-	WILLIS_KEY_I,
-	WILLIS_KEY_O,
-	WILLIS_KEY_P,
-	WILLIS_KEY_BRACKET_LEFT,
-	WILLIS_KEY_BRACKET_RIGHT,
-	WILLIS_KEY_ANTISLASH,
-
-	WILLIS_KEY_CAPS_LOCK,
-	WILLIS_KEY_A,
-	WILLIS_KEY_S,
-	WILLIS_KEY_D,
-	WILLIS_KEY_F,
-	WILLIS_KEY_G,
-	WILLIS_KEY_H,
-	WILLIS_KEY_J,
-	WILLIS_KEY_K,
-	WILLIS_KEY_L,
-	WILLIS_KEY_SEMICOLON,
-	WILLIS_KEY_APOSTROPHE,
-	WILLIS_KEY_ENTER,
-
-	WILLIS_KEY_SHIFT_LEFT,
-	WILLIS_KEY_Z,
-	WILLIS_KEY_X,
-	WILLIS_KEY_C,
-	WILLIS_KEY_V,
-	WILLIS_KEY_B,
-	WILLIS_KEY_N,
-	WILLIS_KEY_M,
-	WILLIS_KEY_COMMA,
-	WILLIS_KEY_PERIOD,
-	WILLIS_KEY_SLASH,
-	WILLIS_KEY_SHIFT_RIGHT,
-
-	WILLIS_KEY_CTRL_LEFT,
-	WILLIS_KEY_MOD_LEFT,
-	WILLIS_KEY_ALT_LEFT,
-	WILLIS_KEY_SPACE,
-	WILLIS_KEY_ALT_RIGHT,
-	WILLIS_KEY_MOD_RIGHT,
-	WILLIS_KEY_MENU,
-	WILLIS_KEY_CTRL_RIGHT,
-
-	// mostly useless keys
-	WILLIS_KEY_PRINT_SCREEN,
-
-#if 0
-	// these do not even exist on macOS
-	WILLIS_KEY_SCROLL_LOCK,
-	WILLIS_KEY_PAUSE,
-#endif
-
-	WILLIS_KEY_INSERT,
-	WILLIS_KEY_DELETE,
-	WILLIS_KEY_HOME,
-	WILLIS_KEY_END,
-	WILLIS_KEY_PAGE_UP,
-	WILLIS_KEY_PAGE_DOWN,
-
-	WILLIS_KEY_UP,
-	WILLIS_KEY_DOWN,
-	WILLIS_KEY_LEFT,
-	WILLIS_KEY_RIGHT,
-
-	// definitely useless keys
-	WILLIS_KEY_NUM_LOCK,
-	WILLIS_KEY_NUM_SLASH,
-	WILLIS_KEY_NUM_ASTERISK,
-
-	WILLIS_KEY_NUM_HYPHEN_MINUS,
-	WILLIS_KEY_NUM_PLUS,
-	WILLIS_KEY_NUM_ENTER,
-	WILLIS_KEY_NUM_DELETE,
-	WILLIS_KEY_NUM_0,
-	WILLIS_KEY_NUM_1,
-	WILLIS_KEY_NUM_2,
-	WILLIS_KEY_NUM_3,
-	WILLIS_KEY_NUM_4,
-	WILLIS_KEY_NUM_5,
-	WILLIS_KEY_NUM_6,
-	WILLIS_KEY_NUM_7,
-	WILLIS_KEY_NUM_8,
-	WILLIS_KEY_NUM_9,
+#define WILLIS_KEYS_ENUM(code, x11, win, appkit) code,
+	WILLIS_KEYS(WILLIS_KEYS_ENUM)
+#undef WILLIS_KEYS_ENUM
 
 	WILLIS_CODE_COUNT,
 };
@@ -215,6 +222,42 @@ enum willis_event_state
 	WILLIS_STATE_COUNT,
 };
 
+enum willis_queue_overflow
+{
+	WILLIS_QUEUE_DROP_OLDEST = 0,
+	WILLIS_QUEUE_DROP_MOTION,
+	WILLIS_QUEUE_BLOCK,
+};
+
+enum willis_compose_loading
+{
+	// when willis starts
+	WILLIS_COMPOSE_LOAD_START = 0,
+	// in a thread started by willis, composition is available once it ends
+	WILLIS_COMPOSE_LOAD_BACKGROUND,
+	// when the first key is pressed
+	WILLIS_COMPOSE_LOAD_LAZY,
+};
+
+enum willis_latency_class
+{
+	WILLIS_LATENCY_KEY = 0,
+	WILLIS_LATENCY_BUTTON,
+	WILLIS_LATENCY_MOTION,
+
+	WILLIS_LATENCY_CLASS_COUNT,
+};
+
+enum willis_latency_stage
+{
+	// from the windowing system timestamp to the end of the translation
+	WILLIS_LATENCY_DELIVERY = 0,
+	// time spent translating the event in the backend
+	WILLIS_LATENCY_TRANSLATION,
+
+	WILLIS_LATENCY_STAGE_COUNT,
+};
+
 struct willis_error_info
 {
 	enum willis_error code;
@@ -229,8 +272,13 @@ struct willis_event_info
 	enum willis_event_state event_state;
 
 	// utf-8 input string for key events
+	// the heap copy must be freed by the caller (NULL without text) and can be disabled
+	// with willis_set_utf8_alloc, the inline buffer is always filled
+	// unless the string was too long for it, which sets utf8_overflow
 	char* utf8_string;
 	size_t utf8_size;
+	char utf8_buffer[WILLIS_UTF8_BUFFER_SIZE];
+	bool utf8_overflow;
 
 	// mouse wheel
 	int mouse_wheel_steps;
@@ -240,6 +288,78 @@ struct willis_event_info
 	int mouse_y;
 	int64_t diff_x; // signed fixed-point (Q31.32)
 	int64_t diff_y; // signed fixed-point (Q31.32)
+	// raw motion events only hold the diffs, the other ones the position
+	bool mouse_raw;
+
+	// timestamps in nanoseconds, the native one comes from the windowing
+	// system's clock (0 when unavailable) and the other one is the
+	// willis_get_time_ns monotonic time taken when the event was translated
+	uint64_t time_native_ns;
+	uint64_t time_ns;
+
+	// index of the seat the event comes from (Wayland), 0 otherwise
+	uint32_t seat;
+	// id of the XInput2 device the event comes from (X11), 0 otherwise
+	uint32_t device;
+	// window the event was sent to, as an xcb_window_t (X11) or a wl_surface
+	// pointer (Wayland), 0 when unknown and on the other backends
+	uintptr_t window;
+};
+
+// fixed-size event record of the binary trace format,
+// the utf-8 text is stored in a separate arena at the end of the file
+struct willis_trace_record
+{
+	uint64_t time_ns;
+	uint64_t time_native_ns;
+	int64_t diff_x;
+	int64_t diff_y;
+	int32_t mouse_x;
+	int32_t mouse_y;
+	int32_t mouse_wheel_steps;
+	uint16_t event_code;
+	uint8_t event_state;
+	uint8_t reserved;
+	uint32_t utf8_offset;
+	uint32_t utf8_size;
+};
+
+// structure-of-arrays output for batched event translation,
+// any of these arrays can be NULL if the corresponding data is not needed
+struct willis_event_soa
+{
+	enum willis_event_code* codes;
+	enum willis_event_state* states;
+	int64_t* diff_x;
+	int64_t* diff_y;
+};
+
+// monotonically increasing runtime counters
+struct willis_stats
+{
+	// translated input events for each event code
+	uint64_t events[WILLIS_CODE_COUNT];
+	// translated events that were not input events
+	uint64_t events_ignored;
+
+	uint64_t utf8_bytes;
+	uint64_t allocations;
+	uint64_t keymap_rebuilds;
+	uint64_t keymap_cache_hits;
+	uint64_t compose_feeds;
+	uint64_t compose_results;
+
+	uint64_t x11_round_trips;
+	uint64_t wayland_callbacks;
+};
+
+// latencies in nanoseconds
+struct willis_latency_info
+{
+	uint64_t count;
+	uint64_t p50;
+	uint64_t p99;
+	uint64_t max;
 };
 
 struct willis_config_backend
@@ -261,6 +381,14 @@ struct willis_config_backend
 		struct willis_event_info* event_info,
 		struct willis_error_info* error);
 
+	// optional, events are translated one by one when NULL
+	size_t (*handle_events)(
+		struct willis* context,
+		void** events,
+		size_t count,
+		struct willis_event_info* event_infos,
+		struct willis_error_info* error);
+
 	bool (*mouse_grab)(
 		struct willis* context,
 		struct willis_error_info* error);
@@ -269,6 +397,22 @@ struct willis_config_backend
 		struct willis* context,
 		struct willis_error_info* error);
 
+	// optional, grabbing and ungrabbing complete immediately when NULL
+	bool (*mouse_grab_poll)(
+		struct willis* context,
+		struct willis_error_info* error);
+
+	// optional, a context only serves the window it was started with when NULL
+	void (*window_attach)(
+		struct willis* context,
+		uintptr_t window,
+		struct willis_error_info* error);
+
+	void (*window_detach)(
+		struct willis* context,
+		uintptr_t window,
+		struct willis_error_info* error);
+
 	void (*stop)(
 		struct willis* context,
 		struct willis_error_info* error);
@@ -293,6 +437,91 @@ void willis_handle_event(
 	struct willis_event_info* event_info,
 	struct willis_error_info* error);
 
+size_t willis_handle_events(
+	struct willis* context,
+	void** events,
+	size_t count,
+	struct willis_event_info* event_infos,
+	struct willis_error_info* error);
+
+size_t willis_handle_events_soa(
+	struct willis* context,
+	void** events,
+	size_t count,
+	struct willis_event_info* event_infos,
+	struct willis_event_soa* event_soa,
+	struct willis_error_info* error);
+
+void willis_set_utf8_alloc(
+	struct willis* context,
+	bool utf8_alloc,
+	struct willis_error_info* error);
+
+// merges consecutive motion events and wheel steps in willis_handle_events
+void willis_set_coalesce(
+	struct willis* context,
+	bool coalesce,
+	struct willis_error_info* error);
+
+// keeps the key tables of the keymaps in $XDG_CACHE_HOME/willis under X11 and
+// Wayland, so the keymap can be compiled on demand when it is met again
+void willis_set_keymap_cache(
+	struct willis* context,
+	bool keymap_cache,
+	struct willis_error_info* error);
+
+// keeps the compose sequences of the locale in $XDG_CACHE_HOME/willis under X11
+// and Wayland, the file being mapped read-only and shared between processes
+void willis_set_compose_cache(
+	struct willis* context,
+	bool compose_cache,
+	struct willis_error_info* error);
+
+// chooses when the compose table of the locale is loaded under X11 and Wayland,
+// keys are translated without composition until then
+void willis_set_compose_loading(
+	struct willis* context,
+	enum willis_compose_loading compose_loading,
+	struct willis_error_info* error);
+
+// tells whether loading the compose table is over (always true on Windows and
+// macOS, where composition is handled by the system)
+bool willis_compose_ready(
+	struct willis* context);
+
+// coalesces an array of event infos in place and returns the new count,
+// events are never reordered relative to key and button events
+size_t willis_coalesce_events(
+	struct willis* context,
+	struct willis_event_info* event_infos,
+	size_t count);
+
+// total number of events merged by the coalescing stage
+size_t willis_get_coalesced(
+	struct willis* context);
+
+void willis_set_queue(
+	struct willis* context,
+	struct willis_queue* queue,
+	struct willis_error_info* error);
+
+// pressed keys and buttons, the edges are computed against
+// the state saved by the last call to willis_key_snapshot
+void willis_key_snapshot(
+	struct willis* context);
+
+bool willis_key_is_down(
+	struct willis* context,
+	enum willis_event_code event_code);
+
+bool willis_key_pressed_since(
+	struct willis* context,
+	enum willis_event_code event_code);
+
+bool willis_key_released_since(
+	struct willis* context,
+	enum willis_event_code event_code);
+
 const char* willis_get_event_code_name(
 	struct willis* context,
 	enum willis_event_code event_code,
@@ -311,6 +540,25 @@ bool willis_mouse_ungrab(
 	struct willis* context,
 	struct willis_error_info* error);
 
+// returns false while the last grab or ungrab is still in progress,
+// and then true with the error set if it failed
+bool willis_mouse_grab_poll(
+	struct willis* context,
+	struct willis_error_info* error);
+
+// adds a window (xcb_window_t) or surface (wl_surface pointer) to the ones
+// served by the context under X11 and Wayland, sharing its keyboard state,
+// keymaps and mouse grab
+void willis_window_attach(
+	struct willis* context,
+	uintptr_t window,
+	struct willis_error_info* error);
+
+void willis_window_detach(
+	struct willis* context,
+	uintptr_t window,
+	struct willis_error_info* error);
+
 void willis_stop(
 	struct willis* context,
 	struct willis_error_info* error);
@@ -319,6 +567,108 @@ void willis_clean(
 	struct willis* context,
 	struct willis_error_info* error);
 
+// single-producer single-consumer event ring,
+// push from the input thread and pop from the render thread
+struct willis_queue* willis_queue_init(
+	struct willis* context,
+	size_t capacity,
+	enum willis_queue_overflow overflow,
+	struct willis_error_info* error);
+
+bool willis_queue_push(
+	struct willis_queue* queue,
+	struct willis_event_info* event_info);
+
+bool willis_queue_pop(
+	struct willis_queue* queue,
+	struct willis_event_info* event_info);
+
+// only returns events pushed at or before the given willis_get_time_ns time
+bool willis_queue_pop_until(
+	struct willis_queue* queue,
+	uint64_t cutoff,
+	struct willis_event_info* event_info);
+
+size_t willis_queue_get_dropped(
+	struct willis_queue* queue);
+
+void willis_queue_clean(
+	struct willis* context,
+	struct willis_queue* queue,
+	struct willis_error_info* error);
+
+void willis_get_stats(
+	struct willis* context,
+	struct willis_stats* stats,
+	struct willis_error_info* error);
+
+// per-class latency histograms, disabled by default
+void willis_set_latency(
+	struct willis* context,
+	bool latency,
+	struct willis_error_info* error);
+
+void willis_latency_get(
+	struct willis* context,
+	enum willis_latency_class latency_class,
+	enum willis_latency_stage stage,
+	struct willis_latency_info* latency_info,
+	struct willis_error_info* error);
+
+void willis_latency_reset(
+	struct willis* context,
+	struct willis_error_info* error);
+
+// binary event traces, the recorder captures the events
+// translated by willis_handle_event and willis_handle_events
+struct willis_recorder* willis_recorder_init(
+	struct willis* context,
+	const char* path,
+	struct willis_error_info* error);
+
+void willis_set_recorder(
+	struct willis* context,
+	struct willis_recorder* recorder,
+	struct willis_error_info* error);
+
+void willis_recorder_clean(
+	struct willis* context,
+	struct willis_recorder* recorder,
+	struct willis_error_info* error);
+
+// the trace file is mapped in memory and its records are read in place
+struct willis_trace* willis_trace_init(
+	struct willis* context,
+	const char* path,
+	struct willis_error_info* error);
+
+const struct willis_trace_record* willis_trace_get_records(
+	struct willis_trace* trace,
+	size_t* count);
+
+// returns NULL for records without text (the text is not NUL-terminated)
+const char* willis_trace_get_utf8(
+	struct willis_trace* trace,
+	const struct willis_trace_record* record);
+
+// returns the next event once its time has come, scaled by the given speed,
+// or immediately when the speed is 0, and false at the end of the trace
+bool willis_trace_replay(
+	struct willis_trace* trace,
+	double speed,
+	struct willis_event_info* event_info);
+
+void willis_trace_rewind(
+	struct willis_trace* trace);
+
+void willis_trace_clean(
+	struct willis* context,
+	struct willis_trace* trace,
+	struct willis_error_info* error);
+
+// monotonic clock in nanoseconds
+uint64_t willis_get_time_ns(void);
+
 void willis_error_log(
 	struct willis* context,
 	struct willis_error_info* error);
@@ -10,6 +10,24 @@ struct willis_x11_data
 	xcb_connection_t* conn;
 	xcb_window_t window;
 	xcb_window_t root;
+
+	// also read keys and buttons from xinput2 raw events while the mouse
+	// is grabbed, dropping the duplicated core and device events
+	bool raw_input_grab;
+
+	// list the xinput2 slave devices to select raw events on each of them
+	// while grabbed, keyboards with their own layout get their own keymap
+	bool input_devices;
+
+	// optional input thread reading events from its own xcb connection,
+	// which are then only delivered through the attached willis queue
+	bool input_thread;
+	// display name given to xcb_connect, NULL to use $DISPLAY
+	const char* input_thread_display;
+	// SCHED_FIFO priority, 0 keeps the default scheduling policy
+	int input_thread_priority;
+	bool input_thread_affinity;
+	int input_thread_cpu;
 };
 
 #if !defined(WILLIS_SHARED)
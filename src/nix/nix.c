@@ -1,126 +1,24 @@
 #include "include/willis.h"
 #include "common/willis_private.h"
 #include "nix/nix.h"
+#include "nix/nix_registry.h"
 
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <locale.h>
+#include <pthread.h>
 #include <xkbcommon/xkbcommon.h>
 #include <xkbcommon/xkbcommon-compose.h>
 
-// sparse LUT for keycode translation
+// sparse LUT for keycode translation, generated from the WILLIS_KEYS table
 static const enum willis_event_code keycode_table[256] =
 {
-[  9] = WILLIS_KEY_ESCAPE,
-		WILLIS_KEY_1,
-		WILLIS_KEY_2,
-		WILLIS_KEY_3,
-		WILLIS_KEY_4,
-		WILLIS_KEY_5,
-		WILLIS_KEY_6,
-		WILLIS_KEY_7,
-		WILLIS_KEY_8,
-		WILLIS_KEY_9,
-		WILLIS_KEY_0,
-		WILLIS_KEY_HYPHEN_MINUS,
-		WILLIS_KEY_EQUALS,
-		WILLIS_KEY_BACKSPACE,
-		WILLIS_KEY_TAB,
-		WILLIS_KEY_Q,
-		WILLIS_KEY_W,
-		WILLIS_KEY_E,
-		WILLIS_KEY_R,
-		WILLIS_KEY_T,
-		WILLIS_KEY_Y,
-		WILLIS_KEY_U,
-		WILLIS_KEY_I,
-		WILLIS_KEY_O,
-		WILLIS_KEY_P,
-		WILLIS_KEY_BRACKET_LEFT,
-		WILLIS_KEY_BRACKET_RIGHT,
-		WILLIS_KEY_ENTER,
-		WILLIS_KEY_CTRL_LEFT,
-		WILLIS_KEY_A,
-		WILLIS_KEY_S,
-		WILLIS_KEY_D,
-		WILLIS_KEY_F,
-		WILLIS_KEY_G,
-		WILLIS_KEY_H,
-		WILLIS_KEY_J,
-		WILLIS_KEY_K,
-		WILLIS_KEY_L,
-		WILLIS_KEY_SEMICOLON,
-		WILLIS_KEY_APOSTROPHE,
-		WILLIS_KEY_GRAVE,
-		WILLIS_KEY_SHIFT_LEFT,
-		WILLIS_KEY_ANTISLASH,
-		WILLIS_KEY_Z,
-		WILLIS_KEY_X,
-		WILLIS_KEY_C,
-		WILLIS_KEY_V,
-		WILLIS_KEY_B,
-		WILLIS_KEY_N,
-		WILLIS_KEY_M,
-		WILLIS_KEY_COMMA,
-		WILLIS_KEY_PERIOD,
-		WILLIS_KEY_SLASH,
-		WILLIS_KEY_SHIFT_RIGHT,
-		WILLIS_KEY_NUM_ASTERISK,
-		WILLIS_KEY_ALT_LEFT,
-		WILLIS_KEY_SPACE,
-		WILLIS_KEY_CAPS_LOCK,
-		WILLIS_KEY_F1,
-		WILLIS_KEY_F2,
-		WILLIS_KEY_F3,
-		WILLIS_KEY_F4,
-		WILLIS_KEY_F5,
-		WILLIS_KEY_F6,
-		WILLIS_KEY_F7,
-		WILLIS_KEY_F8,
-		WILLIS_KEY_F9,
-		WILLIS_KEY_F10,
-		WILLIS_KEY_NUM_LOCK,
-#if 0
-		WILLIS_KEY_SCROLL_LOCK,
-#endif
-[ 79] = WILLIS_KEY_NUM_7,
-		WILLIS_KEY_NUM_8,
-		WILLIS_KEY_NUM_9,
-		WILLIS_KEY_NUM_HYPHEN_MINUS,
-		WILLIS_KEY_NUM_4,
-		WILLIS_KEY_NUM_5,
-		WILLIS_KEY_NUM_6,
-		WILLIS_KEY_NUM_PLUS,
-		WILLIS_KEY_NUM_1,
-		WILLIS_KEY_NUM_2,
-		WILLIS_KEY_NUM_3,
-		WILLIS_KEY_NUM_0,
-		WILLIS_KEY_NUM_DELETE,
-[ 95] = WILLIS_KEY_F11,
-		WILLIS_KEY_F12,
-[104] = WILLIS_KEY_NUM_ENTER,
-		WILLIS_KEY_CTRL_RIGHT,
-		WILLIS_KEY_NUM_SLASH,
-		WILLIS_KEY_PRINT_SCREEN,
-		WILLIS_KEY_ALT_RIGHT,
-[110] = WILLIS_KEY_HOME,
-		WILLIS_KEY_UP,
-		WILLIS_KEY_PAGE_UP,
-		WILLIS_KEY_LEFT,
-		WILLIS_KEY_RIGHT,
-		WILLIS_KEY_END,
-		WILLIS_KEY_DOWN,
-		WILLIS_KEY_PAGE_DOWN,
-		WILLIS_KEY_INSERT,
-		WILLIS_KEY_DELETE,
-#if 0
-[127] = WILLIS_KEY_PAUSE,
-#endif
-[133] = WILLIS_KEY_MOD_LEFT,
-		WILLIS_KEY_MOD_RIGHT,
-		WILLIS_KEY_MENU,
+#define NIX_KEYCODE(code, x11, win, appkit) WILLIS_KEYS_LUT(x11, code)
+	WILLIS_KEYS(NIX_KEYCODE)
+#undef NIX_KEYCODE
 };
 
 
@@ -129,6 +27,14 @@ static inline bool null_or_empty(const char* str)
 	return (str == NULL) || ((*str) == '\0');
 }
 
+// the trie replaces the compose table when it comes from the disk cache
+static inline bool compose_loaded(
+	struct willis_xkb* xkb_common)
+{
+	return (xkb_common->compose_table != NULL)
+		|| (xkb_common->compose_trie.header != NULL);
+}
+
 void willis_xkb_init_locale(
 	struct willis_xkb* xkb_common)
 {
@@ -152,16 +58,171 @@ void willis_xkb_init_locale(
 	xkb_common->locale = locale;
 }
 
-void willis_xkb_init_compose(
-	struct willis_xkb* xkb_common)
+// returns false if the set could not be built
+static bool compose_prefix_init(
+	uint64_t* compose_prefix,
+	struct xkb_compose_table* compose_table)
+{
+	memset(
+		compose_prefix,
+		0,
+		(WILLIS_XKB_COMPOSE_PREFIX_BITS / 64) * (sizeof (uint64_t)));
+
+#if defined(WILLIS_XKB_COMPOSE_ITERATOR)
+	if (compose_table == NULL)
+	{
+		return false;
+	}
+
+	struct xkb_compose_table_iterator* iter =
+		xkb_compose_table_iterator_new(
+			compose_table);
+
+	// without the set every key goes through the compose state
+	if (iter == NULL)
+	{
+		return false;
+	}
+
+	struct xkb_compose_table_entry* entry =
+		xkb_compose_table_iterator_next(iter);
+
+	while (entry != NULL)
+	{
+		size_t length = 0;
+
+		const xkb_keysym_t* sequence =
+			xkb_compose_table_entry_sequence(
+				entry,
+				&length);
+
+		if (length > 0)
+		{
+			uint32_t bit = sequence[0] % WILLIS_XKB_COMPOSE_PREFIX_BITS;
+			compose_prefix[bit / 64] |= UINT64_C(1) << (bit % 64);
+		}
+
+		entry = xkb_compose_table_iterator_next(iter);
+	}
+
+	xkb_compose_table_iterator_free(iter);
+
+	return true;
+#else
+	// the compose table can't be listed before xkbcommon 1.6
+	return false;
+#endif
+}
+
+// false positives only mean the compose state is fed for nothing
+static inline bool compose_prefix(
+	struct willis_xkb* xkb_common,
+	xkb_keysym_t keysym)
 {
-	// initialize compose table (might be NULL)
-	xkb_common->compose_table =
+	uint32_t bit = keysym % WILLIS_XKB_COMPOSE_PREFIX_BITS;
+
+	return (xkb_common->compose_prefix_ok == false)
+		|| ((xkb_common->compose_prefix[bit / 64] & (UINT64_C(1) << (bit % 64))) != 0);
+}
+
+// sets the bits of the keysyms starting a sequence, the children of the root
+static bool compose_prefix_trie(
+	uint64_t* compose_prefix,
+	const struct willis_xkb_trie* compose_trie)
+{
+	memset(
+		compose_prefix,
+		0,
+		(WILLIS_XKB_COMPOSE_PREFIX_BITS / 64) * (sizeof (uint64_t)));
+
+	const struct willis_xkb_trie_node* root = &(compose_trie->nodes[0]);
+
+	for (uint32_t i = 0; i < root->children_count; ++i)
+	{
+		uint32_t bit =
+			compose_trie->nodes[root->children + i].keysym
+			% WILLIS_XKB_COMPOSE_PREFIX_BITS;
+
+		compose_prefix[bit / 64] |= UINT64_C(1) << (bit % 64);
+	}
+
+	return true;
+}
+
+// loads the compose table, or its trie when the compose cache is enabled:
+// the trie is mapped from the disk cache, or built and written there first
+static void compose_new(
+	struct xkb_context* context,
+	const char* locale,
+	bool cache,
+	struct xkb_compose_table** compose_table,
+	struct willis_xkb_trie* compose_trie,
+	uint64_t* compose_prefix,
+	bool* compose_prefix_ok)
+{
+	uint64_t hash = 0;
+
+	*compose_table = NULL;
+
+	if (cache == true)
+	{
+		hash = willis_xkb_trie_hash(locale);
+
+		if (willis_xkb_trie_load(compose_trie, hash) == true)
+		{
+			*compose_prefix_ok = compose_prefix_trie(compose_prefix, compose_trie);
+			return;
+		}
+	}
+
+	// might be NULL
+	*compose_table =
 		xkb_compose_table_new_from_locale(
-			xkb_common->context,
-			xkb_common->locale,
+			context,
+			locale,
 			XKB_COMPOSE_COMPILE_NO_FLAGS);
 
+	if ((cache == true)
+	&& (*compose_table != NULL)
+	&& (willis_xkb_trie_build(compose_trie, *compose_table, hash) == true))
+	{
+		// the mapped copy is shared with the other processes
+		willis_xkb_trie_save(compose_trie);
+		willis_xkb_trie_load(compose_trie, hash);
+
+		xkb_compose_table_unref(*compose_table);
+		*compose_table = NULL;
+
+		*compose_prefix_ok = compose_prefix_trie(compose_prefix, compose_trie);
+		return;
+	}
+
+	*compose_prefix_ok = compose_prefix_init(compose_prefix, *compose_table);
+}
+
+// the registry lock must be held, compose states reference their table
+static void compose_use(
+	struct willis_xkb* xkb_common,
+	struct willis_xkb_compose_shared* compose)
+{
+	xkb_common->compose_shared = compose;
+	xkb_common->composing = false;
+	xkb_common->compose_node = 0;
+
+	if (compose == NULL)
+	{
+		return;
+	}
+
+	xkb_common->compose_table = compose->table;
+	xkb_common->compose_trie = compose->trie;
+	xkb_common->compose_prefix_ok = compose->prefix_ok;
+
+	memcpy(
+		xkb_common->compose_prefix,
+		compose->prefix,
+		sizeof (xkb_common->compose_prefix));
+
 	// initialize compose state (might be NULL)
 	if (xkb_common->compose_table != NULL)
 	{
@@ -170,68 +231,807 @@ void willis_xkb_init_compose(
 				xkb_common->compose_table,
 				XKB_COMPOSE_STATE_NO_FLAGS);
 	}
+}
+
+// parses the compose file of the locale without holding the registry lock,
+// and returns the compose objects shared for it with a new user, or NULL
+static struct willis_xkb_compose_shared* compose_load(
+	const char* locale,
+	bool cache)
+{
+	willis_xkb_registry_lock();
+
+	// the other willis contexts of the process might have loaded it already
+	struct willis_xkb_compose_shared* compose =
+		willis_xkb_registry_compose_get(
+			locale,
+			cache);
+
+	willis_xkb_registry_unlock();
+
+	if (compose != NULL)
+	{
+		return compose;
+	}
+
+	// xkb contexts are not thread-safe so this one is only used here,
+	// the compose table keeps its own reference to it
+	struct xkb_context* context =
+		xkb_context_new(
+			XKB_CONTEXT_NO_FLAGS);
+
+	if (context == NULL)
+	{
+		return NULL;
+	}
+
+	struct xkb_compose_table* compose_table;
+	struct willis_xkb_trie compose_trie = {0};
+	uint64_t compose_prefix[WILLIS_XKB_COMPOSE_PREFIX_BITS / 64];
+	bool compose_prefix_ok;
+
+	compose_new(
+		context,
+		locale,
+		cache,
+		&compose_table,
+		&compose_trie,
+		compose_prefix,
+		&compose_prefix_ok);
+
+	xkb_context_unref(context);
+
+	willis_xkb_registry_lock();
+
+	// another willis context might have been faster
+	compose =
+		willis_xkb_registry_compose_get(
+			locale,
+			cache);
+
+	if (compose == NULL)
+	{
+		compose =
+			willis_xkb_registry_compose_add(
+				locale,
+				cache,
+				compose_table,
+				&compose_trie,
+				compose_prefix,
+				compose_prefix_ok);
+	}
 	else
 	{
-		xkb_common->compose_state = NULL;
+		xkb_compose_table_unref(compose_table); // ok to unref if NULL
+		willis_xkb_trie_clean(&compose_trie);
 	}
+
+	willis_xkb_registry_unlock();
+
+	return compose;
 }
 
-enum willis_event_code willis_xkb_translate_keycode(
-	uint8_t keycode)
+void willis_xkb_init_compose(
+	struct willis_xkb* xkb_common)
 {
-	// xcb_keycode_t is a u8, so it shoudn't be able to trigger a buffer overflow
-	return keycode_table[keycode];
+	struct willis_xkb_compose_shared* compose =
+		compose_load(
+			xkb_common->locale,
+			xkb_common->compose_cache);
+
+	willis_xkb_registry_lock();
+	compose_use(xkb_common, compose);
+	willis_xkb_registry_unlock();
 }
 
-void willis_xkb_utf8_simple(
+// only uses the xkb struct fields the key translation leaves alone until done
+static void* compose_thread(
+	void* data)
+{
+	struct willis_xkb* xkb_common = data;
+
+	xkb_common->compose_shared_thread =
+		compose_load(
+			xkb_common->locale,
+			xkb_common->compose_cache);
+
+	__atomic_store_n(&(xkb_common->compose_thread_done), true, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+void willis_xkb_load_compose(
+	struct willis* context,
+	struct willis_xkb* xkb_common)
+{
+	xkb_common->compose_table = NULL;
+	xkb_common->compose_state = NULL;
+	xkb_common->compose_trie = (struct willis_xkb_trie) {0};
+	xkb_common->compose_shared = NULL;
+	xkb_common->compose_prefix_ok = false;
+	xkb_common->composing = false;
+	xkb_common->compose_node = 0;
+	xkb_common->compose_cache = context->compose_cache;
+
+	switch (context->compose_loading)
+	{
+		case WILLIS_COMPOSE_LOAD_BACKGROUND:
+		{
+			xkb_common->compose_shared_thread = NULL;
+			xkb_common->compose_thread_done = false;
+
+			int error_posix =
+				pthread_create(
+					&(xkb_common->compose_thread),
+					NULL,
+					compose_thread,
+					xkb_common);
+
+			// loaded right away if the thread can't be started
+			if (error_posix != 0)
+			{
+				break;
+			}
+
+			xkb_common->compose_thread_started = true;
+			xkb_common->compose_pending = true;
+			__atomic_store_n(&(context->compose_ready), false, __ATOMIC_RELEASE);
+			return;
+		}
+		case WILLIS_COMPOSE_LOAD_LAZY:
+		{
+			xkb_common->compose_pending = true;
+			__atomic_store_n(&(context->compose_ready), false, __ATOMIC_RELEASE);
+			return;
+		}
+		default:
+		{
+			break;
+		}
+	}
+
+	willis_xkb_init_compose(xkb_common);
+}
+
+static void compose_install(
+	struct willis* context,
+	struct willis_xkb* xkb_common)
+{
+	if (xkb_common->compose_thread_started == true)
+	{
+		pthread_join(xkb_common->compose_thread, NULL);
+		xkb_common->compose_thread_started = false;
+
+		willis_xkb_registry_lock();
+		compose_use(xkb_common, xkb_common->compose_shared_thread);
+		willis_xkb_registry_unlock();
+
+		xkb_common->compose_shared_thread = NULL;
+	}
+	else
+	{
+		willis_xkb_init_compose(xkb_common);
+	}
+
+	xkb_common->compose_pending = false;
+	__atomic_store_n(&(context->compose_ready), true, __ATOMIC_RELEASE);
+}
+
+void willis_xkb_share_compose(
+	struct willis_xkb* xkb_common,
+	struct willis_xkb* source)
+{
+	xkb_common->compose_source = source;
+	xkb_common->compose_table = source->compose_table;
+	xkb_common->compose_trie = source->compose_trie;
+	xkb_common->composing = false;
+	xkb_common->compose_node = 0;
+
+	// the set is written by the compose thread until the table is there
+	if (compose_loaded(source) == true)
+	{
+		memcpy(
+			xkb_common->compose_prefix,
+			source->compose_prefix,
+			sizeof (xkb_common->compose_prefix));
+
+		xkb_common->compose_prefix_ok = source->compose_prefix_ok;
+	}
+
+	if ((xkb_common->compose_table != NULL) && (xkb_common->compose_state == NULL))
+	{
+		willis_xkb_registry_lock();
+
+		xkb_common->compose_state =
+			xkb_compose_state_new(
+				xkb_common->compose_table,
+				XKB_COMPOSE_STATE_NO_FLAGS);
+
+		willis_xkb_registry_unlock();
+	}
+}
+
+void willis_xkb_clean(
+	struct willis_xkb* xkb_common)
+{
+	// the compose thread takes the registry lock
+	if (xkb_common->compose_thread_started == true)
+	{
+		pthread_join(xkb_common->compose_thread, NULL);
+		xkb_common->compose_thread_started = false;
+	}
+
+	willis_xkb_cache_clean(xkb_common);
+	willis_xkb_keymap_pending_clean(xkb_common);
+
+	willis_xkb_registry_lock();
+
+	xkb_compose_state_unref(xkb_common->compose_state); // ok to unref if NULL
+	xkb_state_unref(xkb_common->state); // ok to unref if NULL
+	xkb_keymap_unref(xkb_common->keymap); // ok to unref if NULL
+
+	// structs sharing the compose table of a source also use its context
+	if (xkb_common->compose_source == NULL)
+	{
+		willis_xkb_registry_compose_release(xkb_common->compose_shared_thread);
+		willis_xkb_registry_compose_release(xkb_common->compose_shared);
+
+		if (xkb_common->context != NULL)
+		{
+			willis_xkb_registry_context_release();
+		}
+	}
+
+	willis_xkb_registry_unlock();
+
+	xkb_common->context = NULL;
+	xkb_common->keymap = NULL;
+	xkb_common->state = NULL;
+	xkb_common->compose_table = NULL;
+	xkb_common->compose_state = NULL;
+	xkb_common->compose_trie = (struct willis_xkb_trie) {0};
+	xkb_common->compose_shared = NULL;
+	xkb_common->compose_shared_thread = NULL;
+	xkb_common->compose_source = NULL;
+	xkb_common->compose_pending = false;
+	xkb_common->compose_prefix_ok = false;
+	xkb_common->composing = false;
+	xkb_common->compose_node = 0;
+}
+
+uint64_t willis_xkb_hash(
+	const void* data,
+	size_t size,
+	uint64_t hash)
+{
+	const unsigned char* bytes = data;
+
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001b3;
+	}
+
+	return hash;
+}
+
+// forwards the last modifiers and layout received to the state
+static void mask_apply(
+	struct willis_xkb* xkb_common)
+{
+	if (xkb_common->state != NULL)
+	{
+		xkb_state_update_mask(
+			xkb_common->state,
+			xkb_common->mods_depressed,
+			xkb_common->mods_latched,
+			xkb_common->mods_locked,
+			xkb_common->group_depressed,
+			xkb_common->group_latched,
+			xkb_common->group_locked);
+	}
+}
+
+void willis_xkb_keymap_set(
+	struct willis_xkb* xkb_common,
+	struct xkb_keymap* keymap,
+	struct xkb_state* state,
+	uint64_t hash)
+{
+	struct willis_xkb_table table = {0};
+
+	// the tables loaded from the disk cache for this keymap are kept
+	if ((xkb_common->keymap_compile != NULL)
+	&& (xkb_common->table.header != NULL)
+	&& (xkb_common->table.header->hash == hash))
+	{
+		willis_xkb_table_ref(&table, &(xkb_common->table));
+	}
+	else
+	{
+		// keys are translated by xkbcommon alone if this fails
+		willis_xkb_table_build(&table, keymap, hash);
+	}
+
+	willis_xkb_keymap_pending_clean(xkb_common);
+
+	willis_xkb_registry_lock();
+	xkb_state_unref(xkb_common->state); // ok to unref if NULL
+	xkb_keymap_unref(xkb_common->keymap); // ok to unref if NULL
+	willis_xkb_registry_unlock();
+
+	xkb_common->keymap = keymap;
+	xkb_common->state = state;
+	xkb_common->table = table;
+
+	mask_apply(xkb_common);
+}
+
+bool willis_xkb_cache_use(
+	struct willis_xkb* xkb_common,
+	uint64_t hash)
+{
+	for (size_t i = 0; i < WILLIS_XKB_CACHE_SIZE; ++i)
+	{
+		struct willis_xkb_cache_entry* entry = &(xkb_common->cache[i]);
+
+		if ((entry->keymap != NULL) && (entry->hash == hash))
+		{
+			willis_xkb_keymap_pending_clean(xkb_common);
+
+			// the cache keeps its own references
+			willis_xkb_registry_lock();
+			xkb_state_unref(xkb_common->state); // ok to unref if NULL
+			xkb_keymap_unref(xkb_common->keymap); // ok to unref if NULL
+			xkb_common->keymap = xkb_keymap_ref(entry->keymap);
+			xkb_common->state = xkb_state_ref(entry->state);
+			willis_xkb_registry_unlock();
+
+			willis_xkb_table_ref(&(xkb_common->table), &(entry->table));
+
+			// the cached state still holds the modifiers of its last use
+			mask_apply(xkb_common);
+			return true;
+		}
+	}
+
+	// keymaps compiled by the other willis contexts only need a state
+	struct xkb_state* state = NULL;
+
+	willis_xkb_registry_lock();
+
+	struct xkb_keymap* keymap =
+		willis_xkb_registry_keymap_get(
+			hash);
+
+	if (keymap != NULL)
+	{
+		state = xkb_state_new(keymap);
+
+		if (state == NULL)
+		{
+			xkb_keymap_unref(keymap);
+		}
+	}
+
+	willis_xkb_registry_unlock();
+
+	if (state == NULL)
+	{
+		return false;
+	}
+
+	willis_xkb_keymap_set(xkb_common, keymap, state, hash);
+	willis_xkb_cache_add(xkb_common, hash);
+
+	return true;
+}
+
+void willis_xkb_cache_add(
+	struct willis_xkb* xkb_common,
+	uint64_t hash)
+{
+	struct willis_xkb_cache_entry* entry =
+		&(xkb_common->cache[xkb_common->cache_next]);
+
+	willis_xkb_registry_lock();
+	xkb_state_unref(entry->state);
+	xkb_keymap_unref(entry->keymap);
+	entry->keymap = xkb_keymap_ref(xkb_common->keymap);
+	entry->state = xkb_state_ref(xkb_common->state);
+	willis_xkb_registry_keymap_add(hash, xkb_common->keymap);
+	willis_xkb_registry_unlock();
+
+	entry->hash = hash;
+	willis_xkb_table_ref(&(entry->table), &(xkb_common->table));
+
+	xkb_common->cache_next =
+		(xkb_common->cache_next + 1) % WILLIS_XKB_CACHE_SIZE;
+}
+
+void willis_xkb_cache_clean(
+	struct willis_xkb* xkb_common)
+{
+	willis_xkb_registry_lock();
+
+	for (size_t i = 0; i < WILLIS_XKB_CACHE_SIZE; ++i)
+	{
+		struct willis_xkb_cache_entry* entry = &(xkb_common->cache[i]);
+
+		xkb_state_unref(entry->state);
+		xkb_keymap_unref(entry->keymap);
+		willis_xkb_table_clean(&(entry->table));
+		entry->state = NULL;
+		entry->keymap = NULL;
+	}
+
+	willis_xkb_registry_unlock();
+
+	xkb_common->cache_next = 0;
+}
+
+void willis_xkb_update_mask(
+	struct willis_xkb* xkb_common,
+	uint32_t mods_depressed,
+	uint32_t mods_latched,
+	uint32_t mods_locked,
+	uint32_t group_depressed,
+	uint32_t group_latched,
+	uint32_t group_locked)
+{
+	xkb_common->mods_depressed = mods_depressed;
+	xkb_common->mods_latched = mods_latched;
+	xkb_common->mods_locked = mods_locked;
+	xkb_common->group_depressed = group_depressed;
+	xkb_common->group_latched = group_latched;
+	xkb_common->group_locked = group_locked;
+
+	// the layout is wrapped around when looked up, X11 can send negative ones
+	xkb_common->mods = mods_depressed | mods_latched | mods_locked;
+	xkb_common->group =
+		(int32_t) group_depressed
+		+ (int32_t) group_latched
+		+ (int32_t) group_locked;
+
+	mask_apply(xkb_common);
+}
+
+bool willis_xkb_keymap_load_table(
+	struct willis* context,
+	struct willis_xkb* xkb_common,
+	uint64_t hash,
+	void (*keymap_compile)(
+		struct willis* context,
+		struct willis_xkb* xkb_common,
+		struct willis_error_info* error))
+{
+	struct willis_xkb_table table = {0};
+
+	if ((context->keymap_cache == false)
+	|| (willis_xkb_table_load(&table, hash) == false))
+	{
+		return false;
+	}
+
+	willis_xkb_keymap_pending_clean(xkb_common);
+
+	// the previous keymap does not apply anymore
+	willis_xkb_registry_lock();
+	xkb_state_unref(xkb_common->state); // ok to unref if NULL
+	xkb_keymap_unref(xkb_common->keymap); // ok to unref if NULL
+	willis_xkb_registry_unlock();
+
+	xkb_common->state = NULL;
+	xkb_common->keymap = NULL;
+
+	xkb_common->table = table;
+	xkb_common->keymap_hash = hash;
+	xkb_common->keymap_compile = keymap_compile;
+
+	WILLIS_STATS_ADD(context, keymap_cache_hits, 1);
+
+	return true;
+}
+
+bool willis_xkb_keymap_load_text(
+	struct willis* context,
+	struct willis_xkb* xkb_common,
+	const char* text,
+	size_t size,
+	uint64_t hash)
+{
+	if (context->keymap_cache == false)
+	{
+		return false;
+	}
+
+	char* copy = malloc(size + 1);
+
+	if (copy == NULL)
+	{
+		return false;
+	}
+
+	bool loaded =
+		willis_xkb_keymap_load_table(
+			context,
+			xkb_common,
+			hash,
+			willis_xkb_keymap_compile_text);
+
+	if (loaded == false)
+	{
+		free(copy);
+		return false;
+	}
+
+	memcpy(copy, text, size);
+	copy[size] = '\0';
+	xkb_common->keymap_text = copy;
+
+	return true;
+}
+
+static void text_clean(
+	struct willis_xkb* xkb_common)
+{
+	free(xkb_common->keymap_text);
+	xkb_common->keymap_text = NULL;
+	xkb_common->keymap_compile = NULL;
+}
+
+void willis_xkb_keymap_compile_text(
 	struct willis* context,
 	struct willis_xkb* xkb_common,
-	xkb_keycode_t keycode,
-	char** utf8_string,
-	size_t* utf8_size,
 	struct willis_error_info* error)
 {
-	if (xkb_common->state == NULL)
+	uint64_t hash = xkb_common->keymap_hash;
+
+	// another willis context might have compiled it since
+	if (willis_xkb_cache_use(xkb_common, hash) == true)
 	{
-		*utf8_string = NULL;
-		*utf8_size = 0;
 		willis_error_ok(error);
 		return;
 	}
 
-	*utf8_size = xkb_state_key_get_utf8(xkb_common->state, keycode, NULL, 0);
-	*utf8_string = malloc(*utf8_size + 1);
+	// the shared xkb context is changed by the compilation
+	willis_xkb_registry_lock();
+
+	struct xkb_keymap* keymap =
+		xkb_keymap_new_from_string(
+			xkb_common->context,
+			xkb_common->keymap_text,
+			XKB_KEYMAP_FORMAT_TEXT_V1,
+			XKB_KEYMAP_COMPILE_NO_FLAGS);
 
-	if (*utf8_string == NULL)
+	willis_xkb_registry_unlock();
+
+	// only the tables are used from now on, instead of trying again every time
+	if (keymap == NULL)
+	{
+		text_clean(xkb_common);
+		willis_error_throw(context, error, WILLIS_ERROR_XKB_KEYMAP_NEW);
+		return;
+	}
+
+	struct xkb_state* state = xkb_state_new(keymap);
+
+	if (state == NULL)
 	{
-		*utf8_string = NULL;
-		*utf8_size = 0;
-		willis_error_throw(context, error, WILLIS_ERROR_ALLOC);
+		// the last reference to the keymap releases the shared context
+		willis_xkb_registry_lock();
+		xkb_keymap_unref(keymap);
+		willis_xkb_registry_unlock();
+
+		text_clean(xkb_common);
+		willis_error_throw(context, error, WILLIS_ERROR_XKB_STATE_NEW);
 		return;
 	}
 
-	xkb_state_key_get_utf8(
-		xkb_common->state,
+	willis_xkb_keymap_set(xkb_common, keymap, state, hash);
+	willis_xkb_cache_add(xkb_common, hash);
+	WILLIS_STATS_ADD(context, keymap_rebuilds, 1);
+	willis_error_ok(error);
+}
+
+void willis_xkb_keymap_save(
+	struct willis* context,
+	struct willis_xkb* xkb_common)
+{
+	// tables mapped from the disk cache are already there
+	if ((context->keymap_cache == true)
+	&& (xkb_common->table.storage != NULL)
+	&& (xkb_common->table.storage->mapped == false))
+	{
+		willis_xkb_table_save(&(xkb_common->table));
+	}
+}
+
+void willis_xkb_keymap_pending_clean(
+	struct willis_xkb* xkb_common)
+{
+	willis_xkb_table_clean(&(xkb_common->table));
+	text_clean(xkb_common);
+}
+
+enum willis_event_code willis_xkb_translate_keycode(
+	uint8_t keycode)
+{
+	// xcb_keycode_t is a u8, so it shoudn't be able to trigger a buffer overflow
+	return keycode_table[keycode];
+}
+
+static void utf8_none(
+	struct willis_event_info* event_info)
+{
+	event_info->utf8_string = NULL;
+	event_info->utf8_size = 0;
+	event_info->utf8_buffer[0] = '\0';
+	event_info->utf8_overflow = false;
+}
+
+// most keys are translated with the tables, without calling xkbcommon
+static inline const struct willis_xkb_table_level* table_level(
+	struct willis_xkb* xkb_common,
+	xkb_keycode_t keycode)
+{
+	return willis_xkb_table_lookup(
+		&(xkb_common->table),
 		keycode,
-		*utf8_string,
-		*utf8_size + 1);
+		xkb_common->mods,
+		xkb_common->group);
+}
 
+// compiles the keymap the tables were loaded for, returns false without state
+static bool keymap_ready(
+	struct willis* context,
+	struct willis_xkb* xkb_common,
+	struct willis_error_info* error)
+{
 	willis_error_ok(error);
+
+	if ((xkb_common->state == NULL) && (xkb_common->keymap_compile != NULL))
+	{
+		xkb_common->keymap_compile(context, xkb_common, error);
+
+		if (willis_error_get_code(error) != WILLIS_ERROR_OK)
+		{
+			return false;
+		}
+	}
+
+	return (xkb_common->state != NULL);
 }
 
-void willis_xkb_utf8_compose(
+void willis_xkb_utf8_simple(
 	struct willis* context,
 	struct willis_xkb* xkb_common,
 	xkb_keycode_t keycode,
-	char** utf8_string,
-	size_t* utf8_size,
+	struct willis_event_info* event_info,
 	struct willis_error_info* error)
 {
-	// get keysym
-	xkb_keysym_t keysym =
-		xkb_state_key_get_one_sym(
+	const struct willis_xkb_table_level* level =
+		table_level(xkb_common, keycode);
+
+	if (level != NULL)
+	{
+		willis_utf8_store(
+			context,
+			event_info,
+			level->utf8,
+			level->utf8_size,
+			error);
+
+		return;
+	}
+
+	if (keymap_ready(context, xkb_common, error) == false)
+	{
+		utf8_none(event_info);
+		return;
+	}
+
+	// write directly in the inline buffer, in a single call most of the time
+	int size =
+		xkb_state_key_get_utf8(
 			xkb_common->state,
-			keycode);
+			keycode,
+			event_info->utf8_buffer,
+			WILLIS_UTF8_BUFFER_SIZE);
+
+	if (size < WILLIS_UTF8_BUFFER_SIZE)
+	{
+		willis_utf8_store(
+			context,
+			event_info,
+			event_info->utf8_buffer,
+			size,
+			error);
+
+		return;
+	}
+
+	// the string did not fit, only the legacy heap copy can hold it
+	utf8_none(event_info);
+	event_info->utf8_size = size;
+	event_info->utf8_overflow = true;
+	WILLIS_STATS_ADD(context, utf8_bytes, size);
+
+	if (context->utf8_alloc == true)
+	{
+		WILLIS_STATS_ADD(context, allocations, 1);
+		event_info->utf8_string = malloc(size + 1);
+
+		if (event_info->utf8_string == NULL)
+		{
+			willis_error_throw(context, error, WILLIS_ERROR_ALLOC);
+			return;
+		}
+
+		xkb_state_key_get_utf8(
+			xkb_common->state,
+			keycode,
+			event_info->utf8_string,
+			size + 1);
+	}
+
+	willis_error_ok(error);
+}
+
+// same rules as xkbcommon, modifiers being ignored and sequences restarting
+// from the root once composed
+static bool compose_feed_trie(
+	struct willis_xkb* xkb_common,
+	xkb_keysym_t keysym,
+	enum xkb_compose_status* status)
+{
+	const struct willis_xkb_trie* trie = &(xkb_common->compose_trie);
+
+	if (((keysym >= XKB_KEY_Shift_L) && (keysym <= XKB_KEY_Hyper_R))
+	|| ((keysym >= XKB_KEY_ISO_Lock) && (keysym <= XKB_KEY_ISO_Level5_Lock))
+	|| (keysym == XKB_KEY_Mode_switch)
+	|| (keysym == XKB_KEY_Num_Lock))
+	{
+		return false;
+	}
+
+	uint32_t node = xkb_common->compose_node;
+
+	if (trie->nodes[node].children_count == 0)
+	{
+		node = 0;
+	}
+
+	uint32_t next = willis_xkb_trie_next(trie, node, keysym);
+
+	if (next == 0)
+	{
+		*status = (node == 0) ? XKB_COMPOSE_NOTHING : XKB_COMPOSE_CANCELLED;
+	}
+	else if (trie->nodes[next].children_count == 0)
+	{
+		*status = XKB_COMPOSE_COMPOSED;
+	}
+	else
+	{
+		*status = XKB_COMPOSE_COMPOSING;
+	}
+
+	xkb_common->compose_node = next;
+
+	return true;
+}
+
+// returns false if the keysym was ignored
+static bool compose_feed(
+	struct willis_xkb* xkb_common,
+	xkb_keysym_t keysym,
+	enum xkb_compose_status* status)
+{
+	if (xkb_common->compose_trie.header != NULL)
+	{
+		return compose_feed_trie(xkb_common, keysym, status);
+	}
 
 	enum xkb_compose_feed_result result =
 		xkb_compose_state_feed(
@@ -240,40 +1040,147 @@ void willis_xkb_utf8_compose(
 
 	if (result != XKB_COMPOSE_FEED_ACCEPTED)
 	{
-		*utf8_string = NULL;
-		*utf8_size = 0;
-		willis_error_ok(error);
-		return;
+		return false;
 	}
 
-	// get composition status
-	enum xkb_compose_status status =
+	*status =
 		xkb_compose_state_get_status(
 			xkb_common->compose_state);
 
+	return true;
+}
+
+void willis_xkb_utf8_compose(
+	struct willis* context,
+	struct willis_xkb* xkb_common,
+	xkb_keycode_t keycode,
+	struct willis_event_info* event_info,
+	struct willis_error_info* error)
+{
+	xkb_keysym_t keysym;
+
+	// get keysym
+	const struct willis_xkb_table_level* level =
+		table_level(xkb_common, keycode);
+
+	if (level != NULL)
+	{
+		keysym = level->keysym;
+	}
+	else if (keymap_ready(context, xkb_common, error) == true)
+	{
+		keysym =
+			xkb_state_key_get_one_sym(
+				xkb_common->state,
+				keycode);
+	}
+	else
+	{
+		utf8_none(event_info);
+		return;
+	}
+
+	// ordinary typing never reaches the compose state
+	if ((xkb_common->composing == false)
+	&& (compose_prefix(xkb_common, keysym) == false))
+	{
+		if (level != NULL)
+		{
+			willis_utf8_store(
+				context,
+				event_info,
+				level->utf8,
+				level->utf8_size,
+				error);
+		}
+		else
+		{
+			willis_xkb_utf8_simple(
+				context,
+				xkb_common,
+				keycode,
+				event_info,
+				error);
+		}
+
+		return;
+	}
+
+	enum xkb_compose_status status;
+	bool accepted = compose_feed(xkb_common, keysym, &status);
+
+	WILLIS_STATS_ADD(context, compose_feeds, 1);
+
+	if (accepted == false)
+	{
+		utf8_none(event_info);
+		willis_error_ok(error);
+		return;
+	}
+
+	xkb_common->composing = (status == XKB_COMPOSE_COMPOSING);
+
 	// use composed utf-8 value
 	if (status == XKB_COMPOSE_COMPOSED)
 	{
-		*utf8_size =
+		WILLIS_STATS_ADD(context, compose_results, 1);
+
+		// the text is read from the trie, in the mapped cache file
+		if (xkb_common->compose_trie.header != NULL)
+		{
+			const struct willis_xkb_trie_node* node =
+				&(xkb_common->compose_trie.nodes[xkb_common->compose_node]);
+
+			willis_utf8_store(
+				context,
+				event_info,
+				xkb_common->compose_trie.utf8 + node->utf8_offset,
+				node->utf8_size,
+				error);
+
+			return;
+		}
+
+		int size =
 			xkb_compose_state_get_utf8(
 				xkb_common->compose_state,
-				NULL,
-				0);
-
-		*utf8_string = malloc(*utf8_size + 1);
+				event_info->utf8_buffer,
+				WILLIS_UTF8_BUFFER_SIZE);
 
-		if (*utf8_string == NULL)
+		if (size < WILLIS_UTF8_BUFFER_SIZE)
 		{
-			*utf8_string = NULL;
-			*utf8_size = 0;
-			willis_error_throw(context, error, WILLIS_ERROR_ALLOC);
+			willis_utf8_store(
+				context,
+				event_info,
+				event_info->utf8_buffer,
+				size,
+				error);
+
 			return;
 		}
 
-		xkb_compose_state_get_utf8(
-			xkb_common->compose_state,
-			*utf8_string,
-			*utf8_size + 1);
+		// the string did not fit, only the legacy heap copy can hold it
+		utf8_none(event_info);
+		event_info->utf8_size = size;
+		event_info->utf8_overflow = true;
+		WILLIS_STATS_ADD(context, utf8_bytes, size);
+
+		if (context->utf8_alloc == true)
+		{
+			WILLIS_STATS_ADD(context, allocations, 1);
+			event_info->utf8_string = malloc(size + 1);
+
+			if (event_info->utf8_string == NULL)
+			{
+				willis_error_throw(context, error, WILLIS_ERROR_ALLOC);
+				return;
+			}
+
+			xkb_compose_state_get_utf8(
+				xkb_common->compose_state,
+				event_info->utf8_string,
+				size + 1);
+		}
 	}
 	// use simple utf-8 value
 	else if (status == XKB_COMPOSE_NOTHING)
@@ -282,12 +1189,69 @@ void willis_xkb_utf8_compose(
 			context,
 			xkb_common,
 			keycode,
-			utf8_string,
-			utf8_size,
+			event_info,
 			error);
 
 		return;
 	}
+	// composing or cancelled
+	else
+	{
+		utf8_none(event_info);
+	}
 
 	willis_error_ok(error);
 }
+
+void willis_xkb_utf8(
+	struct willis* context,
+	struct willis_xkb* xkb_common,
+	xkb_keycode_t keycode,
+	struct willis_event_info* event_info,
+	struct willis_error_info* error)
+{
+	struct willis_xkb* source = xkb_common->compose_source;
+
+	if (source == NULL)
+	{
+		source = xkb_common;
+	}
+
+	// install the compose table once it can be used
+	if ((source->compose_pending == true)
+	&& ((source->compose_thread_started == false)
+		|| (__atomic_load_n(&(source->compose_thread_done), __ATOMIC_ACQUIRE) == true)))
+	{
+		compose_install(context, source);
+	}
+
+	// the compose table was loaded after this xkb struct got it
+	if ((source != xkb_common)
+	&& (compose_loaded(xkb_common) == false)
+	&& (compose_loaded(source) == true))
+	{
+		willis_xkb_share_compose(xkb_common, source);
+	}
+
+	// use compose functions if available
+	if ((xkb_common->compose_state != NULL)
+	|| (xkb_common->compose_trie.header != NULL))
+	{
+		willis_xkb_utf8_compose(
+			context,
+			xkb_common,
+			keycode,
+			event_info,
+			error);
+	}
+	// use simple keycode translation otherwise
+	else
+	{
+		willis_xkb_utf8_simple(
+			context,
+			xkb_common,
+			keycode,
+			event_info,
+			error);
+	}
+}
@@ -2,10 +2,29 @@
 #define H_WILLIS_INTERNAL_NIX
 
 #include "willis.h"
+#include "nix/nix_table.h"
 
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <xkbcommon/xkbcommon.h>
 
+#define WILLIS_XKB_CACHE_SIZE 4
+#define WILLIS_XKB_COMPOSE_PREFIX_BITS 4096
+#define WILLIS_XKB_HASH_INIT 0xcbf29ce484222325
+
+struct willis_xkb_compose_shared;
+
+// keymaps already built and their states, keyed by a hash of their description
+struct willis_xkb_cache_entry
+{
+	uint64_t hash;
+	struct xkb_keymap* keymap;
+	struct xkb_state* state;
+	struct willis_xkb_table table;
+};
+
 struct willis_xkb
 {
 	struct xkb_context* context;
@@ -14,6 +33,56 @@ struct willis_xkb
 	const char* locale;
 	struct xkb_compose_table* compose_table;
 	struct xkb_compose_state* compose_state;
+
+	// keysyms able to start a compose sequence, hashed to one bit each:
+	// other keys skip the compose state while no sequence is in progress
+	uint64_t compose_prefix[WILLIS_XKB_COMPOSE_PREFIX_BITS / 64];
+	bool compose_prefix_ok;
+	bool composing;
+
+	// trie mapped from the disk cache and used instead of the compose table,
+	// with the node of the sequence in progress
+	bool compose_cache;
+	struct willis_xkb_trie compose_trie;
+	uint32_t compose_node;
+
+	// registry entry the compose table and trie belong to
+	struct willis_xkb_compose_shared* compose_shared;
+
+	// compose table loaded on the first key press or by a thread, the struct
+	// loading it being the source of the ones sharing it
+	struct willis_xkb* compose_source;
+	bool compose_pending;
+	bool compose_thread_started;
+	bool compose_thread_done;
+	pthread_t compose_thread;
+	struct willis_xkb_compose_shared* compose_shared_thread;
+
+	struct willis_xkb_cache_entry cache[WILLIS_XKB_CACHE_SIZE];
+	size_t cache_next;
+
+	// tables of the current keymap translating most key presses, when they
+	// come from the disk cache the keymap is only compiled by this callback
+	// once a key they can't translate is pressed
+	struct willis_xkb_table table;
+	void (*keymap_compile)(
+		struct willis* context,
+		struct willis_xkb* xkb_common,
+		struct willis_error_info* error);
+	char* keymap_text;
+	uint64_t keymap_hash;
+
+	// last modifiers and layout received, applied when the state is created
+	uint32_t mods_depressed;
+	uint32_t mods_latched;
+	uint32_t mods_locked;
+	uint32_t group_depressed;
+	uint32_t group_latched;
+	uint32_t group_locked;
+
+	// effective modifiers and layout, used for the table lookups
+	uint32_t mods;
+	int32_t group;
 };
 
 void willis_xkb_init_locale(
@@ -22,6 +91,95 @@ void willis_xkb_init_locale(
 void willis_xkb_init_compose(
 	struct willis_xkb* xkb_common);
 
+// loads the compose table now or later, as chosen with willis_set_compose_loading
+void willis_xkb_load_compose(
+	struct willis* context,
+	struct willis_xkb* xkb_common);
+
+// releases everything the xkb struct holds, waiting for the compose thread:
+// structs sharing the compose table of a source leave its context alone
+void willis_xkb_clean(
+	struct willis_xkb* xkb_common);
+
+// uses the compose table of source, with a compose state of its own
+void willis_xkb_share_compose(
+	struct willis_xkb* xkb_common,
+	struct willis_xkb* source);
+
+// fnv-1a, chained by passing the previous result as hash
+uint64_t willis_xkb_hash(
+	const void* data,
+	size_t size,
+	uint64_t hash);
+
+// makes the cached keymap and state current, or a keymap compiled by another
+// willis context with a new state, returns false if missing
+bool willis_xkb_cache_use(
+	struct willis_xkb* xkb_common,
+	uint64_t hash);
+
+// makes a compiled keymap and its state current and derives its tables,
+// the last modifiers and layout received are applied to the state
+void willis_xkb_keymap_set(
+	struct willis_xkb* xkb_common,
+	struct xkb_keymap* keymap,
+	struct xkb_state* state,
+	uint64_t hash);
+
+// caches the current keymap, state and tables, evicting the oldest entry,
+// and offers the keymap to the other willis contexts
+void willis_xkb_cache_add(
+	struct willis_xkb* xkb_common,
+	uint64_t hash);
+
+void willis_xkb_cache_clean(
+	struct willis_xkb* xkb_common);
+
+// forwards the modifiers and layout to the state, or keeps them until it exists
+void willis_xkb_update_mask(
+	struct willis_xkb* xkb_common,
+	uint32_t mods_depressed,
+	uint32_t mods_latched,
+	uint32_t mods_locked,
+	uint32_t group_depressed,
+	uint32_t group_latched,
+	uint32_t group_locked);
+
+// uses the tables of the disk cache if they exist and drops the current keymap,
+// the callback compiles it when a key the tables can't translate is pressed
+bool willis_xkb_keymap_load_table(
+	struct willis* context,
+	struct willis_xkb* xkb_common,
+	uint64_t hash,
+	void (*keymap_compile)(
+		struct willis* context,
+		struct willis_xkb* xkb_common,
+		struct willis_error_info* error));
+
+// uses the tables of the disk cache if they exist, the keymap text is then
+// kept to be compiled later by willis_xkb_keymap_compile_text
+bool willis_xkb_keymap_load_text(
+	struct willis* context,
+	struct willis_xkb* xkb_common,
+	const char* text,
+	size_t size,
+	uint64_t hash);
+
+void willis_xkb_keymap_compile_text(
+	struct willis* context,
+	struct willis_xkb* xkb_common,
+	struct willis_error_info* error);
+
+// writes the tables of the current keymap in the disk cache if enabled
+void willis_xkb_keymap_save(
+	struct willis* context,
+	struct willis_xkb* xkb_common);
+
+// drops the tables of the current keymap and the keymap text waiting to be
+// compiled
+void willis_xkb_keymap_pending_clean(
+	struct willis_xkb* xkb_common);
+
 enum willis_event_code willis_xkb_translate_keycode(
 	uint8_t keycode);
 
@@ -29,16 +187,22 @@ void willis_xkb_utf8_simple(
 	struct willis* context,
 	struct willis_xkb* xkb_common,
 	xkb_keycode_t keycode,
-	char** utf8_string,
-	size_t* utf8_size,
+	struct willis_event_info* event_info,
 	struct willis_error_info* error);
 
 void willis_xkb_utf8_compose(
 	struct willis* context,
 	struct willis_xkb* xkb_common,
 	xkb_keycode_t keycode,
-	char** utf8_string,
-	size_t* utf8_size,
+	struct willis_event_info* event_info,
+	struct willis_error_info* error);
+
+// translates a pressed key, composing text once the compose table is loaded
+void willis_xkb_utf8(
+	struct willis* context,
+	struct willis_xkb* xkb_common,
+	xkb_keycode_t keycode,
+	struct willis_event_info* event_info,
 	struct willis_error_info* error);
 
 #endif
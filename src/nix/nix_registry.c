@@ -0,0 +1,231 @@
+#include "include/willis.h"
+#include "nix/nix.h"
+#include "nix/nix_registry.h"
+#include "nix/nix_table.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xkbcommon/xkbcommon.h>
+#include <xkbcommon/xkbcommon-compose.h>
+
+struct registry_keymap
+{
+	uint64_t hash;
+	struct xkb_keymap* keymap;
+};
+
+// one for the whole process, whatever the number of willis contexts
+static struct
+{
+	pthread_mutex_t lock;
+
+	struct xkb_context* context;
+	size_t context_users;
+
+	struct registry_keymap keymaps[WILLIS_XKB_REGISTRY_KEYMAPS];
+	size_t keymaps_next;
+
+	struct willis_xkb_compose_shared* compose;
+} xkb_registry =
+{
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+void willis_xkb_registry_lock(void)
+{
+	pthread_mutex_lock(&(xkb_registry.lock));
+}
+
+void willis_xkb_registry_unlock(void)
+{
+	pthread_mutex_unlock(&(xkb_registry.lock));
+}
+
+struct xkb_context* willis_xkb_registry_context_acquire(void)
+{
+	if (xkb_registry.context == NULL)
+	{
+		xkb_registry.context =
+			xkb_context_new(
+				XKB_CONTEXT_NO_FLAGS);
+
+		if (xkb_registry.context == NULL)
+		{
+			return NULL;
+		}
+	}
+
+	++(xkb_registry.context_users);
+
+	return xkb_registry.context;
+}
+
+void willis_xkb_registry_context_release(void)
+{
+	--(xkb_registry.context_users);
+
+	if (xkb_registry.context_users > 0)
+	{
+		return;
+	}
+
+	// the keymaps reference the context, they are not needed anymore
+	for (size_t i = 0; i < WILLIS_XKB_REGISTRY_KEYMAPS; ++i)
+	{
+		xkb_keymap_unref(xkb_registry.keymaps[i].keymap); // ok to unref if NULL
+		xkb_registry.keymaps[i].keymap = NULL;
+	}
+
+	xkb_registry.keymaps_next = 0;
+
+	xkb_context_unref(xkb_registry.context);
+	xkb_registry.context = NULL;
+}
+
+struct xkb_keymap* willis_xkb_registry_keymap_get(
+	uint64_t hash)
+{
+	for (size_t i = 0; i < WILLIS_XKB_REGISTRY_KEYMAPS; ++i)
+	{
+		struct registry_keymap* entry = &(xkb_registry.keymaps[i]);
+
+		if ((entry->keymap != NULL) && (entry->hash == hash))
+		{
+			return xkb_keymap_ref(entry->keymap);
+		}
+	}
+
+	return NULL;
+}
+
+void willis_xkb_registry_keymap_add(
+	uint64_t hash,
+	struct xkb_keymap* keymap)
+{
+	// nothing is kept once the last willis context is gone
+	if ((xkb_registry.context == NULL) || (keymap == NULL))
+	{
+		return;
+	}
+
+	for (size_t i = 0; i < WILLIS_XKB_REGISTRY_KEYMAPS; ++i)
+	{
+		if ((xkb_registry.keymaps[i].keymap != NULL)
+		&& (xkb_registry.keymaps[i].hash == hash))
+		{
+			return;
+		}
+	}
+
+	// the willis contexts using the evicted keymap keep their references
+	struct registry_keymap* entry =
+		&(xkb_registry.keymaps[xkb_registry.keymaps_next]);
+
+	xkb_keymap_unref(entry->keymap); // ok to unref if NULL
+	entry->hash = hash;
+	entry->keymap = xkb_keymap_ref(keymap);
+
+	xkb_registry.keymaps_next =
+		(xkb_registry.keymaps_next + 1) % WILLIS_XKB_REGISTRY_KEYMAPS;
+}
+
+struct willis_xkb_compose_shared* willis_xkb_registry_compose_get(
+	const char* locale,
+	bool cache)
+{
+	struct willis_xkb_compose_shared* compose = xkb_registry.compose;
+
+	while (compose != NULL)
+	{
+		if ((compose->cache == cache) && (strcmp(compose->locale, locale) == 0))
+		{
+			++(compose->users);
+			return compose;
+		}
+
+		compose = compose->next;
+	}
+
+	return NULL;
+}
+
+struct willis_xkb_compose_shared* willis_xkb_registry_compose_add(
+	const char* locale,
+	bool cache,
+	struct xkb_compose_table* table,
+	struct willis_xkb_trie* trie,
+	const uint64_t* prefix,
+	bool prefix_ok)
+{
+	size_t locale_size = strlen(locale) + 1;
+
+	struct willis_xkb_compose_shared* compose =
+		malloc(sizeof (struct willis_xkb_compose_shared));
+
+	char* locale_copy = malloc(locale_size);
+
+	if ((compose == NULL) || (locale_copy == NULL))
+	{
+		free(locale_copy);
+		free(compose);
+		xkb_compose_table_unref(table); // ok to unref if NULL
+		willis_xkb_trie_clean(trie);
+		return NULL;
+	}
+
+	memcpy(locale_copy, locale, locale_size);
+
+	compose->locale = locale_copy;
+	compose->cache = cache;
+	compose->users = 1;
+	compose->table = table;
+	compose->trie = *trie;
+	compose->prefix_ok = prefix_ok;
+
+	memcpy(
+		compose->prefix,
+		prefix,
+		sizeof (compose->prefix));
+
+	compose->next = xkb_registry.compose;
+	xkb_registry.compose = compose;
+
+	// the trie storage belongs to the registry now
+	*trie = (struct willis_xkb_trie) {0};
+
+	return compose;
+}
+
+void willis_xkb_registry_compose_release(
+	struct willis_xkb_compose_shared* compose)
+{
+	if (compose == NULL)
+	{
+		return;
+	}
+
+	--(compose->users);
+
+	if (compose->users > 0)
+	{
+		return;
+	}
+
+	struct willis_xkb_compose_shared** link = &(xkb_registry.compose);
+
+	while (*link != compose)
+	{
+		link = &((*link)->next);
+	}
+
+	*link = compose->next;
+
+	xkb_compose_table_unref(compose->table); // ok to unref if NULL
+	willis_xkb_trie_clean(&(compose->trie));
+	free(compose->locale);
+	free(compose);
+}
@@ -0,0 +1,70 @@
+#ifndef H_WILLIS_INTERNAL_NIX_REGISTRY
+#define H_WILLIS_INTERNAL_NIX_REGISTRY
+
+#include "nix/nix.h"
+#include "nix/nix_table.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <xkbcommon/xkbcommon.h>
+#include <xkbcommon/xkbcommon-compose.h>
+
+// compiled keymaps kept for the other willis contexts, the oldest is evicted
+#define WILLIS_XKB_REGISTRY_KEYMAPS 16
+
+// compose table or trie of a locale, shared by the willis contexts using it
+struct willis_xkb_compose_shared
+{
+	char* locale;
+	bool cache;
+	size_t users;
+
+	struct xkb_compose_table* table;
+	struct willis_xkb_trie trie;
+	uint64_t prefix[WILLIS_XKB_COMPOSE_PREFIX_BITS / 64];
+	bool prefix_ok;
+
+	struct willis_xkb_compose_shared* next;
+};
+
+// xkbcommon objects are not thread-safe, not even their reference counts:
+// the ones shared by the willis contexts of the process are only used with
+// this lock held, and so are all the functions below
+void willis_xkb_registry_lock(void);
+void willis_xkb_registry_unlock(void);
+
+// returns the xkb context of the process, created by the first willis context
+struct xkb_context* willis_xkb_registry_context_acquire(void);
+
+// the last release frees the context and the keymaps kept with it
+void willis_xkb_registry_context_release(void);
+
+// returns a new reference to the keymap compiled for this hash, or NULL
+struct xkb_keymap* willis_xkb_registry_keymap_get(
+	uint64_t hash);
+
+// keeps a reference to a compiled keymap for the other willis contexts
+void willis_xkb_registry_keymap_add(
+	uint64_t hash,
+	struct xkb_keymap* keymap);
+
+// returns the compose objects loaded for the locale with a new user, or NULL
+struct willis_xkb_compose_shared* willis_xkb_registry_compose_get(
+	const char* locale,
+	bool cache);
+
+// takes ownership of the compose objects, which are released on failure
+struct willis_xkb_compose_shared* willis_xkb_registry_compose_add(
+	const char* locale,
+	bool cache,
+	struct xkb_compose_table* table,
+	struct willis_xkb_trie* trie,
+	const uint64_t* prefix,
+	bool prefix_ok);
+
+// the last user frees the compose objects, ok to release NULL
+void willis_xkb_registry_compose_release(
+	struct willis_xkb_compose_shared* compose);
+
+#endif
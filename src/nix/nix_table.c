@@ -0,0 +1,1182 @@
+#define _XOPEN_SOURCE 700
+#include "include/willis.h"
+#include "common/willis_private.h"
+#include "nix/nix.h"
+#include "nix/nix_table.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <xkbcommon/xkbcommon.h>
+
+// given by the build scripts, tables are rebuilt when xkbcommon changes
+#if !defined(WILLIS_XKB_VERSION)
+	#define WILLIS_XKB_VERSION "unknown"
+#endif
+
+#define TABLE_PATH_SIZE 4096
+
+static void table_key(
+	struct willis_xkb_table_key* key,
+	struct xkb_keymap* keymap,
+	xkb_keycode_t keycode,
+	xkb_layout_index_t layout)
+{
+	xkb_layout_index_t layouts =
+		xkb_keymap_num_layouts_for_key(
+			keymap,
+			keycode);
+
+	// keys without symbols have no text
+	if (layouts == 0)
+	{
+		return;
+	}
+
+	// groups out of range wrap around
+	layout %= layouts;
+
+	xkb_level_index_t levels =
+		xkb_keymap_num_levels_for_key(
+			keymap,
+			keycode,
+			layout);
+
+	if (levels > WILLIS_XKB_TABLE_LEVELS)
+	{
+		key->flags |= WILLIS_XKB_TABLE_COMPLEX;
+		return;
+	}
+
+	for (xkb_level_index_t level = 0; level < levels; ++level)
+	{
+		struct willis_xkb_table_level* entry = &(key->levels[level]);
+		const xkb_keysym_t* keysyms = NULL;
+
+		int keysyms_count =
+			xkb_keymap_key_get_syms_by_level(
+				keymap,
+				keycode,
+				layout,
+				level,
+				&keysyms);
+
+		if (keysyms_count > 1)
+		{
+			key->flags |= WILLIS_XKB_TABLE_COMPLEX;
+			return;
+		}
+
+		if (keysyms_count == 1)
+		{
+			char utf8[WILLIS_XKB_TABLE_UTF8];
+
+			int size =
+				xkb_keysym_to_utf8(
+					keysyms[0],
+					utf8,
+					sizeof (utf8));
+
+			if (size < 0)
+			{
+				key->flags |= WILLIS_XKB_TABLE_COMPLEX;
+				return;
+			}
+
+			// the size includes the terminating null byte
+			entry->keysym = keysyms[0];
+
+			if (size > 1)
+			{
+				entry->utf8_size = size - 1;
+				memcpy(entry->utf8, utf8, size - 1);
+			}
+		}
+
+		xkb_mod_mask_t masks[WILLIS_XKB_TABLE_ENTRIES];
+
+		size_t masks_count =
+			xkb_keymap_key_get_mods_for_level(
+				keymap,
+				keycode,
+				layout,
+				level,
+				masks,
+				WILLIS_XKB_TABLE_ENTRIES);
+
+		for (size_t i = 0; i < masks_count; ++i)
+		{
+			if (key->entries_count >= WILLIS_XKB_TABLE_ENTRIES)
+			{
+				key->flags |= WILLIS_XKB_TABLE_COMPLEX;
+				return;
+			}
+
+			key->entries_mods[key->entries_count] = masks[i];
+			key->entries_level[key->entries_count] = level;
+			key->mods |= masks[i];
+			++(key->entries_count);
+		}
+	}
+}
+
+static struct willis_xkb_table_storage* storage_new(
+	void* data,
+	size_t size,
+	bool mapped)
+{
+	struct willis_xkb_table_storage* storage =
+		malloc(sizeof (struct willis_xkb_table_storage));
+
+	if (storage == NULL)
+	{
+		return NULL;
+	}
+
+	storage->data = data;
+	storage->size = size;
+	storage->mapped = mapped;
+	storage->refs = 1;
+
+	return storage;
+}
+
+static void storage_release(
+	struct willis_xkb_table_storage* storage)
+{
+	if (storage == NULL)
+	{
+		return;
+	}
+
+	--(storage->refs);
+
+	if (storage->refs > 0)
+	{
+		return;
+	}
+
+	if (storage->mapped == true)
+	{
+		munmap(storage->data, storage->size);
+	}
+	else
+	{
+		free(storage->data);
+	}
+
+	free(storage);
+}
+
+bool willis_xkb_table_build(
+	struct willis_xkb_table* table,
+	struct xkb_keymap* keymap,
+	uint64_t hash)
+{
+	xkb_keycode_t keycode_min = xkb_keymap_min_keycode(keymap);
+	xkb_keycode_t keycode_max = xkb_keymap_max_keycode(keymap);
+	xkb_layout_index_t layouts = xkb_keymap_num_layouts(keymap);
+
+	if ((layouts == 0) || (keycode_max < keycode_min))
+	{
+		return false;
+	}
+
+	size_t keycode_count = keycode_max - keycode_min + 1;
+
+	size_t size =
+		(sizeof (struct willis_xkb_table_header))
+		+ (keycode_count * layouts * (sizeof (struct willis_xkb_table_key)));
+
+	// zeroed so the cache files do not hold uninitialized padding
+	void* data = calloc(1, size);
+
+	if (data == NULL)
+	{
+		return false;
+	}
+
+	struct willis_xkb_table_header* header = data;
+	struct willis_xkb_table_key* keys =
+		(struct willis_xkb_table_key*) (header + 1);
+
+	memcpy(header->magic, WILLIS_XKB_TABLE_MAGIC, 4);
+	header->version = WILLIS_XKB_TABLE_VERSION;
+	header->key_size = sizeof (struct willis_xkb_table_key);
+	header->keycode_min = keycode_min;
+	header->keycode_count = keycode_count;
+	header->layouts = layouts;
+	header->hash = hash;
+	strncpy(header->xkb_version, WILLIS_XKB_VERSION, sizeof (header->xkb_version) - 1);
+
+	const char* mods_transform[2] =
+	{
+		XKB_MOD_NAME_CAPS,
+		XKB_MOD_NAME_CTRL,
+	};
+
+	for (size_t i = 0; i < 2; ++i)
+	{
+		xkb_mod_index_t mod =
+			xkb_keymap_mod_get_index(
+				keymap,
+				mods_transform[i]);
+
+		if (mod < 32)
+		{
+			header->mods_transform |= UINT32_C(1) << mod;
+		}
+	}
+
+	for (size_t i = 0; i < keycode_count; ++i)
+	{
+		for (xkb_layout_index_t layout = 0; layout < layouts; ++layout)
+		{
+			table_key(
+				&(keys[(i * layouts) + layout]),
+				keymap,
+				keycode_min + i,
+				layout);
+		}
+	}
+
+	struct willis_xkb_table_storage* storage = storage_new(data, size, false);
+
+	if (storage == NULL)
+	{
+		free(data);
+		return false;
+	}
+
+	willis_xkb_table_clean(table);
+
+	table->header = header;
+	table->keys = keys;
+	table->storage = storage;
+
+	return true;
+}
+
+// $XDG_CACHE_HOME/willis/<name>-<hash>.bin, the hash including the version
+static bool table_path(
+	char* path,
+	const char* name,
+	uint64_t hash,
+	bool folders)
+{
+	const char* cache = getenv("XDG_CACHE_HOME");
+	const char* suffix = "";
+
+	if ((cache == NULL) || (cache[0] == '\0'))
+	{
+		cache = getenv("HOME");
+		suffix = "/.cache";
+
+		if ((cache == NULL) || (cache[0] == '\0'))
+		{
+			return false;
+		}
+	}
+
+	hash =
+		willis_xkb_hash(
+			WILLIS_XKB_VERSION,
+			strlen(WILLIS_XKB_VERSION),
+			hash);
+
+	int size;
+
+	if (folders == true)
+	{
+		size = snprintf(path, TABLE_PATH_SIZE, "%s%s", cache, suffix);
+
+		if ((size < 0) || (size >= TABLE_PATH_SIZE))
+		{
+			return false;
+		}
+
+		// failures show up when opening the file
+		mkdir(path, 0700);
+
+		size = snprintf(path, TABLE_PATH_SIZE, "%s%s/willis", cache, suffix);
+
+		if ((size < 0) || (size >= TABLE_PATH_SIZE))
+		{
+			return false;
+		}
+
+		mkdir(path, 0700);
+	}
+
+	size =
+		snprintf(
+			path,
+			TABLE_PATH_SIZE,
+			"%s%s/willis/%s-%016" PRIx64 ".bin",
+			cache,
+			suffix,
+			name,
+			hash);
+
+	return (size > 0) && (size < TABLE_PATH_SIZE);
+}
+
+// maps a cache file read-only, so its pages are shared between processes
+static struct willis_xkb_table_storage* file_map(
+	const char* name,
+	uint64_t hash,
+	size_t size_min)
+{
+	char path[TABLE_PATH_SIZE];
+
+	if (table_path(path, name, hash, false) == false)
+	{
+		return NULL;
+	}
+
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+	{
+		return NULL;
+	}
+
+	struct stat file_stat;
+
+	if ((fstat(fd, &file_stat) != 0)
+	|| (file_stat.st_size < (off_t) size_min))
+	{
+		close(fd);
+		return NULL;
+	}
+
+	size_t size = file_stat.st_size;
+	void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED)
+	{
+		return NULL;
+	}
+
+	struct willis_xkb_table_storage* storage = storage_new(data, size, true);
+
+	if (storage == NULL)
+	{
+		munmap(data, size);
+	}
+
+	return storage;
+}
+
+static void file_save(
+	const char* name,
+	uint64_t hash,
+	const struct willis_xkb_table_storage* storage)
+{
+	char path[TABLE_PATH_SIZE];
+	char path_tmp[TABLE_PATH_SIZE];
+
+	if (table_path(path, name, hash, true) == false)
+	{
+		return;
+	}
+
+	// written aside and renamed so readers never see a partial file
+	int size =
+		snprintf(
+			path_tmp,
+			TABLE_PATH_SIZE,
+			"%s.%ld",
+			path,
+			(long) getpid());
+
+	if ((size < 0) || (size >= TABLE_PATH_SIZE))
+	{
+		return;
+	}
+
+	int fd = open(path_tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+	if (fd < 0)
+	{
+		return;
+	}
+
+	const char* data = storage->data;
+	size_t written = 0;
+
+	while (written < storage->size)
+	{
+		ssize_t count = write(fd, data + written, storage->size - written);
+
+		if (count <= 0)
+		{
+			close(fd);
+			unlink(path_tmp);
+			return;
+		}
+
+		written += count;
+	}
+
+	close(fd);
+
+	if (rename(path_tmp, path) != 0)
+	{
+		unlink(path_tmp);
+	}
+}
+
+bool willis_xkb_table_load(
+	struct willis_xkb_table* table,
+	uint64_t hash)
+{
+	struct willis_xkb_table_storage* storage =
+		file_map(
+			"keymap",
+			hash,
+			sizeof (struct willis_xkb_table_header));
+
+	if (storage == NULL)
+	{
+		return false;
+	}
+
+	// anything unexpected means the file comes from another build
+	const struct willis_xkb_table_header* header = storage->data;
+	const struct willis_xkb_table_key* keys =
+		(const struct willis_xkb_table_key*) (header + 1);
+
+	// divided instead of multiplied so a corrupt header can't overflow it
+	size_t keys_count =
+		(storage->size - (sizeof (struct willis_xkb_table_header)))
+		/ (sizeof (struct willis_xkb_table_key));
+
+	bool valid =
+		(memcmp(header->magic, WILLIS_XKB_TABLE_MAGIC, 4) == 0)
+		&& (header->version == WILLIS_XKB_TABLE_VERSION)
+		&& (header->key_size == sizeof (struct willis_xkb_table_key))
+		&& (header->hash == hash)
+		&& (header->layouts != 0)
+		&& (strncmp(header->xkb_version, WILLIS_XKB_VERSION, sizeof (header->xkb_version)) == 0)
+		&& (storage->size
+			== ((sizeof (struct willis_xkb_table_header))
+				+ (keys_count * (sizeof (struct willis_xkb_table_key)))))
+		&& ((keys_count % header->layouts) == 0)
+		&& ((keys_count / header->layouts) == header->keycode_count);
+
+	// lookups use the entries and the text sizes without checking them
+	for (size_t i = 0; (valid == true) && (i < keys_count); ++i)
+	{
+		valid = (keys[i].entries_count <= WILLIS_XKB_TABLE_ENTRIES);
+
+		for (uint32_t k = 0; (valid == true) && (k < keys[i].entries_count); ++k)
+		{
+			valid = (keys[i].entries_level[k] < WILLIS_XKB_TABLE_LEVELS);
+		}
+
+		for (uint32_t k = 0; (valid == true) && (k < WILLIS_XKB_TABLE_LEVELS); ++k)
+		{
+			valid = (keys[i].levels[k].utf8_size <= (WILLIS_XKB_TABLE_UTF8 - 1));
+		}
+	}
+
+	if (valid == false)
+	{
+		storage_release(storage);
+		return false;
+	}
+
+	willis_xkb_table_clean(table);
+
+	table->header = header;
+	table->keys = keys;
+	table->storage = storage;
+
+	return true;
+}
+
+void willis_xkb_table_save(
+	const struct willis_xkb_table* table)
+{
+	if (table->header != NULL)
+	{
+		file_save("keymap", table->header->hash, table->storage);
+	}
+}
+
+void willis_xkb_table_ref(
+	struct willis_xkb_table* table,
+	const struct willis_xkb_table* source)
+{
+	// the storage of the source is referenced before it can be released
+	if (source->storage != NULL)
+	{
+		++(source->storage->refs);
+	}
+
+	willis_xkb_table_clean(table);
+	*table = *source;
+}
+
+const struct willis_xkb_table_level* willis_xkb_table_lookup(
+	const struct willis_xkb_table* table,
+	xkb_keycode_t keycode,
+	uint32_t mods,
+	int32_t group)
+{
+	const struct willis_xkb_table_header* header = table->header;
+
+	if ((header == NULL)
+	|| (keycode < header->keycode_min)
+	|| ((keycode - header->keycode_min) >= header->keycode_count))
+	{
+		return NULL;
+	}
+
+	// out of range layouts wrap around, like in xkbcommon
+	int32_t layouts = header->layouts;
+	group %= layouts;
+
+	if (group < 0)
+	{
+		group += layouts;
+	}
+
+	const struct willis_xkb_table_key* key =
+		&(table->keys[
+			((keycode - header->keycode_min) * header->layouts)
+			+ group]);
+
+	if (((key->flags & WILLIS_XKB_TABLE_COMPLEX) != 0)
+	|| ((mods & ~(key->mods) & header->mods_transform) != 0))
+	{
+		return NULL;
+	}
+
+	// same level selection as xkb key types
+	uint32_t mods_key = mods & key->mods;
+	uint32_t level = 0;
+
+	for (uint32_t i = 0; i < key->entries_count; ++i)
+	{
+		if (key->entries_mods[i] == mods_key)
+		{
+			level = key->entries_level[i];
+			break;
+		}
+	}
+
+	return &(key->levels[level]);
+}
+
+void willis_xkb_table_clean(
+	struct willis_xkb_table* table)
+{
+	storage_release(table->storage);
+
+	table->header = NULL;
+	table->keys = NULL;
+	table->storage = NULL;
+}
+
+// hashes a path with the size and modification time of the file, if any
+static uint64_t file_hash(
+	const char* path,
+	uint64_t hash)
+{
+	struct stat file_stat;
+
+	hash = willis_xkb_hash(path, strlen(path), hash);
+
+	if (stat(path, &file_stat) != 0)
+	{
+		return hash;
+	}
+
+	int64_t values[3] =
+	{
+		file_stat.st_size,
+		file_stat.st_mtime,
+		file_stat.st_ino,
+	};
+
+	return willis_xkb_hash(values, sizeof (values), hash);
+}
+
+static bool path_join(
+	char* path,
+	const char* folder,
+	const char* name)
+{
+	int size = snprintf(path, TABLE_PATH_SIZE, "%s/%s", folder, name);
+
+	return (size > 0) && (size < TABLE_PATH_SIZE);
+}
+
+// finds the compose file of the locale in compose.dir like xkbcommon does,
+// except that aliases of the locale name are not resolved
+static bool compose_file_system(
+	char* path,
+	const char* folder,
+	const char* locale)
+{
+	if (path_join(path, folder, "compose.dir") == false)
+	{
+		return false;
+	}
+
+	FILE* file = fopen(path, "r");
+
+	if (file == NULL)
+	{
+		return false;
+	}
+
+	char line[512];
+	bool found = false;
+
+	while ((found == false) && (fgets(line, sizeof (line), file) != NULL))
+	{
+		char* separator = strchr(line, ':');
+
+		if ((line[0] == '#') || (separator == NULL))
+		{
+			continue;
+		}
+
+		char* name = separator + 1;
+
+		*separator = '\0';
+		name += strspn(name, " \t");
+		name[strcspn(name, " \t\r\n")] = '\0';
+
+		if (strcmp(name, locale) == 0)
+		{
+			found = path_join(path, folder, line);
+		}
+	}
+
+	fclose(file);
+
+	return found;
+}
+
+uint64_t willis_xkb_trie_hash(
+	const char* locale)
+{
+	char path[TABLE_PATH_SIZE];
+	const char* home = getenv("HOME");
+	const char* config = getenv("XDG_CONFIG_HOME");
+	const char* compose = getenv("XCOMPOSEFILE");
+	const char* folder = getenv("XLOCALEDIR");
+
+	uint64_t hash =
+		willis_xkb_hash(
+			locale,
+			strlen(locale),
+			WILLIS_XKB_HASH_INIT);
+
+	// user compose files, any of them is used instead of the system one
+	if (compose != NULL)
+	{
+		hash = file_hash(compose, hash);
+	}
+
+	if ((config != NULL) && (config[0] != '\0'))
+	{
+		if (path_join(path, config, "XCompose") == true)
+		{
+			hash = file_hash(path, hash);
+		}
+	}
+	else if ((home != NULL) && (path_join(path, home, ".config/XCompose") == true))
+	{
+		hash = file_hash(path, hash);
+	}
+
+	if ((home != NULL) && (path_join(path, home, ".XCompose") == true))
+	{
+		hash = file_hash(path, hash);
+	}
+
+	// system compose file of the locale
+	if ((folder == NULL) || (folder[0] == '\0'))
+	{
+		folder = "/usr/share/X11/locale";
+	}
+
+	if (path_join(path, folder, "compose.dir") == true)
+	{
+		hash = file_hash(path, hash);
+	}
+
+	if (path_join(path, folder, "locale.alias") == true)
+	{
+		hash = file_hash(path, hash);
+	}
+
+	if (compose_file_system(path, folder, locale) == true)
+	{
+		hash = file_hash(path, hash);
+	}
+
+	return hash;
+}
+
+struct trie_entry
+{
+	xkb_keysym_t sequence[WILLIS_XKB_TRIE_DEPTH];
+	uint32_t count;
+	uint32_t result;
+	uint32_t utf8_offset;
+	uint32_t utf8_size;
+};
+
+// entries covered by a node while the trie is built
+struct trie_range
+{
+	uint32_t first;
+	uint32_t end;
+	uint32_t depth;
+};
+
+static int trie_entry_compare(
+	const void* a,
+	const void* b)
+{
+	const struct trie_entry* entry_a = a;
+	const struct trie_entry* entry_b = b;
+	uint32_t count = entry_a->count;
+
+	if (entry_b->count < count)
+	{
+		count = entry_b->count;
+	}
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		if (entry_a->sequence[i] != entry_b->sequence[i])
+		{
+			return (entry_a->sequence[i] < entry_b->sequence[i]) ? -1 : 1;
+		}
+	}
+
+	return (entry_a->count > entry_b->count) - (entry_a->count < entry_b->count);
+}
+
+// reads the sequences of the compose table and the text they produce
+static bool trie_collect(
+	struct xkb_compose_table* compose_table,
+	struct trie_entry** entries,
+	size_t* entries_count,
+	char** utf8,
+	size_t* utf8_size)
+{
+	*entries = NULL;
+	*entries_count = 0;
+	*utf8 = NULL;
+	*utf8_size = 0;
+
+#if defined(WILLIS_XKB_COMPOSE_ITERATOR)
+	size_t entries_max = 0;
+	size_t utf8_max = 0;
+
+	struct xkb_compose_table_iterator* iter =
+		xkb_compose_table_iterator_new(
+			compose_table);
+
+	if (iter == NULL)
+	{
+		return false;
+	}
+
+	struct xkb_compose_table_entry* entry =
+		xkb_compose_table_iterator_next(iter);
+
+	while (entry != NULL)
+	{
+		size_t count = 0;
+
+		const xkb_keysym_t* sequence =
+			xkb_compose_table_entry_sequence(
+				entry,
+				&count);
+
+		if ((count == 0) || (count > WILLIS_XKB_TRIE_DEPTH))
+		{
+			entry = xkb_compose_table_iterator_next(iter);
+			continue;
+		}
+
+		xkb_keysym_t result =
+			xkb_compose_table_entry_keysym(
+				entry);
+
+		const char* text =
+			xkb_compose_table_entry_utf8(
+				entry);
+
+		char text_keysym[WILLIS_XKB_TABLE_UTF8];
+		size_t text_size = strlen(text);
+
+		// xkbcommon falls back to the text of the keysym
+		if ((text_size == 0) && (result != XKB_KEY_NoSymbol))
+		{
+			int size =
+				xkb_keysym_to_utf8(
+					result,
+					text_keysym,
+					sizeof (text_keysym));
+
+			if (size > 0)
+			{
+				text = text_keysym;
+				text_size = size - 1;
+			}
+		}
+
+		if (*entries_count == entries_max)
+		{
+			entries_max = (entries_max == 0) ? 1024 : (2 * entries_max);
+
+			struct trie_entry* grown =
+				realloc(*entries, entries_max * (sizeof (struct trie_entry)));
+
+			if (grown == NULL)
+			{
+				xkb_compose_table_iterator_free(iter);
+				return false;
+			}
+
+			*entries = grown;
+		}
+
+		while ((*utf8_size + text_size) > utf8_max)
+		{
+			utf8_max = (utf8_max == 0) ? 16384 : (2 * utf8_max);
+
+			char* grown = realloc(*utf8, utf8_max);
+
+			if (grown == NULL)
+			{
+				xkb_compose_table_iterator_free(iter);
+				return false;
+			}
+
+			*utf8 = grown;
+		}
+
+		struct trie_entry* copy = &((*entries)[*entries_count]);
+
+		memcpy(copy->sequence, sequence, count * (sizeof (xkb_keysym_t)));
+		copy->count = count;
+		copy->result = result;
+		copy->utf8_offset = *utf8_size;
+		copy->utf8_size = text_size;
+		memcpy(*utf8 + *utf8_size, text, text_size);
+
+		++(*entries_count);
+		*utf8_size += text_size;
+
+		entry = xkb_compose_table_iterator_next(iter);
+	}
+
+	xkb_compose_table_iterator_free(iter);
+
+	return true;
+#else
+	// the compose table can't be listed before xkbcommon 1.6
+	return false;
+#endif
+}
+
+// lays the nodes out breadth first, so the children of a node are contiguous
+static size_t trie_nodes(
+	struct willis_xkb_trie_node* nodes,
+	struct trie_range* ranges,
+	const struct trie_entry* entries,
+	size_t entries_count)
+{
+	size_t nodes_count = 1;
+
+	ranges[0].first = 0;
+	ranges[0].end = entries_count;
+	ranges[0].depth = 0;
+
+	for (size_t i = 0; i < nodes_count; ++i)
+	{
+		struct trie_range range = ranges[i];
+		const struct trie_entry* first = &(entries[range.first]);
+
+		// a sequence can't end here and go on, the shortest one is kept
+		if ((range.depth > 0) && (first->count == range.depth))
+		{
+			nodes[i].utf8_offset = first->utf8_offset;
+			nodes[i].utf8_size = first->utf8_size;
+			nodes[i].result = first->result;
+			continue;
+		}
+
+		uint32_t child = range.first;
+
+		nodes[i].children = nodes_count;
+
+		while (child < range.end)
+		{
+			xkb_keysym_t keysym = entries[child].sequence[range.depth];
+			uint32_t end = child + 1;
+
+			while ((end < range.end)
+			&& (entries[end].sequence[range.depth] == keysym))
+			{
+				++end;
+			}
+
+			nodes[nodes_count].keysym = keysym;
+			ranges[nodes_count].first = child;
+			ranges[nodes_count].end = end;
+			ranges[nodes_count].depth = range.depth + 1;
+
+			++nodes_count;
+			++(nodes[i].children_count);
+			child = end;
+		}
+	}
+
+	return nodes_count;
+}
+
+bool willis_xkb_trie_build(
+	struct willis_xkb_trie* trie,
+	struct xkb_compose_table* compose_table,
+	uint64_t hash)
+{
+	struct trie_entry* entries;
+	size_t entries_count;
+	char* utf8;
+	size_t utf8_size;
+
+	bool collected =
+		trie_collect(
+			compose_table,
+			&entries,
+			&entries_count,
+			&utf8,
+			&utf8_size);
+
+	if (collected == false)
+	{
+		free(entries);
+		free(utf8);
+		return false;
+	}
+
+	qsort(
+		entries,
+		entries_count,
+		sizeof (struct trie_entry),
+		trie_entry_compare);
+
+	// one node for each keysym at most, plus the root
+	size_t nodes_max = 1;
+
+	for (size_t i = 0; i < entries_count; ++i)
+	{
+		nodes_max += entries[i].count;
+	}
+
+	struct willis_xkb_trie_node* nodes =
+		calloc(nodes_max, sizeof (struct willis_xkb_trie_node));
+
+	struct trie_range* ranges =
+		malloc(nodes_max * (sizeof (struct trie_range)));
+
+	if ((nodes == NULL) || (ranges == NULL))
+	{
+		free(ranges);
+		free(nodes);
+		free(entries);
+		free(utf8);
+		return false;
+	}
+
+	size_t nodes_count = trie_nodes(nodes, ranges, entries, entries_count);
+
+	free(ranges);
+	free(entries);
+
+	size_t size =
+		(sizeof (struct willis_xkb_trie_header))
+		+ (nodes_count * (sizeof (struct willis_xkb_trie_node)))
+		+ utf8_size;
+
+	// zeroed so the cache files do not hold uninitialized padding
+	void* data = calloc(1, size);
+
+	if (data == NULL)
+	{
+		free(nodes);
+		free(utf8);
+		return false;
+	}
+
+	struct willis_xkb_trie_header* header = data;
+	struct willis_xkb_trie_node* nodes_data =
+		(struct willis_xkb_trie_node*) (header + 1);
+	char* utf8_data = (char*) (nodes_data + nodes_count);
+
+	memcpy(header->magic, WILLIS_XKB_TRIE_MAGIC, 4);
+	header->version = WILLIS_XKB_TRIE_VERSION;
+	header->node_size = sizeof (struct willis_xkb_trie_node);
+	header->nodes_count = nodes_count;
+	header->utf8_size = utf8_size;
+	header->hash = hash;
+	strncpy(header->xkb_version, WILLIS_XKB_VERSION, sizeof (header->xkb_version) - 1);
+
+	memcpy(nodes_data, nodes, nodes_count * (sizeof (struct willis_xkb_trie_node)));
+
+	if (utf8_size > 0)
+	{
+		memcpy(utf8_data, utf8, utf8_size);
+	}
+
+	free(nodes);
+	free(utf8);
+
+	struct willis_xkb_table_storage* storage = storage_new(data, size, false);
+
+	if (storage == NULL)
+	{
+		free(data);
+		return false;
+	}
+
+	willis_xkb_trie_clean(trie);
+
+	trie->header = header;
+	trie->nodes = nodes_data;
+	trie->utf8 = utf8_data;
+	trie->storage = storage;
+
+	return true;
+}
+
+bool willis_xkb_trie_load(
+	struct willis_xkb_trie* trie,
+	uint64_t hash)
+{
+	struct willis_xkb_table_storage* storage =
+		file_map(
+			"compose",
+			hash,
+			sizeof (struct willis_xkb_trie_header));
+
+	if (storage == NULL)
+	{
+		return false;
+	}
+
+	// anything unexpected means the file comes from another build
+	const struct willis_xkb_trie_header* header = storage->data;
+	const struct willis_xkb_trie_node* nodes =
+		(const struct willis_xkb_trie_node*) (header + 1);
+
+	size_t size_expected =
+		(sizeof (struct willis_xkb_trie_header))
+		+ (((size_t) header->nodes_count) * (sizeof (struct willis_xkb_trie_node)))
+		+ header->utf8_size;
+
+	bool valid =
+		(memcmp(header->magic, WILLIS_XKB_TRIE_MAGIC, 4) == 0)
+		&& (header->version == WILLIS_XKB_TRIE_VERSION)
+		&& (header->node_size == sizeof (struct willis_xkb_trie_node))
+		&& (header->hash == hash)
+		&& (header->nodes_count > 0)
+		&& (strncmp(header->xkb_version, WILLIS_XKB_VERSION, sizeof (header->xkb_version)) == 0)
+		&& (storage->size == size_expected);
+
+	// lookups follow the indices without checking them
+	for (uint32_t i = 0; (valid == true) && (i < header->nodes_count); ++i)
+	{
+		valid =
+			(nodes[i].children <= header->nodes_count)
+			&& (nodes[i].children_count <= (header->nodes_count - nodes[i].children))
+			&& (nodes[i].utf8_offset <= header->utf8_size)
+			&& (nodes[i].utf8_size <= (header->utf8_size - nodes[i].utf8_offset));
+	}
+
+	if (valid == false)
+	{
+		storage_release(storage);
+		return false;
+	}
+
+	willis_xkb_trie_clean(trie);
+
+	trie->header = header;
+	trie->nodes = nodes;
+	trie->utf8 = (const char*) (nodes + header->nodes_count);
+	trie->storage = storage;
+
+	return true;
+}
+
+void willis_xkb_trie_save(
+	const struct willis_xkb_trie* trie)
+{
+	if (trie->header != NULL)
+	{
+		file_save("compose", trie->header->hash, trie->storage);
+	}
+}
+
+uint32_t willis_xkb_trie_next(
+	const struct willis_xkb_trie* trie,
+	uint32_t node,
+	xkb_keysym_t keysym)
+{
+	uint32_t first = trie->nodes[node].children;
+	uint32_t end = first + trie->nodes[node].children_count;
+
+	while (first < end)
+	{
+		uint32_t middle = first + ((end - first) / 2);
+		xkb_keysym_t middle_keysym = trie->nodes[middle].keysym;
+
+		if (middle_keysym == keysym)
+		{
+			return middle;
+		}
+
+		if (middle_keysym < keysym)
+		{
+			first = middle + 1;
+		}
+		else
+		{
+			end = middle;
+		}
+	}
+
+	return 0;
+}
+
+void willis_xkb_trie_clean(
+	struct willis_xkb_trie* trie)
+{
+	storage_release(trie->storage);
+
+	trie->header = NULL;
+	trie->nodes = NULL;
+	trie->utf8 = NULL;
+	trie->storage = NULL;
+}
@@ -0,0 +1,169 @@
+#ifndef H_WILLIS_INTERNAL_NIX_TABLE
+#define H_WILLIS_INTERNAL_NIX_TABLE
+
+#include "willis.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <xkbcommon/xkbcommon.h>
+#include <xkbcommon/xkbcommon-compose.h>
+
+// keymap-derived lookup tables, stored as-is in the disk cache:
+// header, then one key entry for each keycode and layout
+#define WILLIS_XKB_TABLE_MAGIC "WLKT"
+#define WILLIS_XKB_TABLE_VERSION 1
+#define WILLIS_XKB_TABLE_LEVELS 4
+#define WILLIS_XKB_TABLE_ENTRIES 8
+#define WILLIS_XKB_TABLE_UTF8 8
+
+// the text of keys with this flag can only be computed by xkbcommon
+#define WILLIS_XKB_TABLE_COMPLEX 1
+
+struct willis_xkb_table_header
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t key_size;
+	uint32_t keycode_min;
+	uint32_t keycode_count;
+	uint32_t layouts;
+	// caps lock and control change the text of keys not using them
+	uint32_t mods_transform;
+	uint32_t reserved;
+	uint64_t hash;
+	char xkb_version[32];
+};
+
+struct willis_xkb_table_level
+{
+	uint32_t keysym;
+	uint8_t utf8_size;
+	char utf8[WILLIS_XKB_TABLE_UTF8 - 1];
+};
+
+struct willis_xkb_table_key
+{
+	uint32_t flags;
+	// modifiers taking part in the level selection
+	uint32_t mods;
+	uint32_t entries_count;
+	uint32_t entries_mods[WILLIS_XKB_TABLE_ENTRIES];
+	uint8_t entries_level[WILLIS_XKB_TABLE_ENTRIES];
+	struct willis_xkb_table_level levels[WILLIS_XKB_TABLE_LEVELS];
+};
+
+// mapped cache file or heap allocation, shared with the keymap cache entries
+struct willis_xkb_table_storage
+{
+	void* data;
+	size_t size;
+	bool mapped;
+	size_t refs;
+};
+
+struct willis_xkb_table
+{
+	const struct willis_xkb_table_header* header;
+	const struct willis_xkb_table_key* keys;
+	struct willis_xkb_table_storage* storage;
+};
+
+// derives the tables from a compiled keymap
+bool willis_xkb_table_build(
+	struct willis_xkb_table* table,
+	struct xkb_keymap* keymap,
+	uint64_t hash);
+
+// maps the tables of the given keymap hash from the disk cache
+bool willis_xkb_table_load(
+	struct willis_xkb_table* table,
+	uint64_t hash);
+
+// writes the tables in the disk cache, failures are ignored
+void willis_xkb_table_save(
+	const struct willis_xkb_table* table);
+
+// shares the tables of source, releasing the previous ones
+void willis_xkb_table_ref(
+	struct willis_xkb_table* table,
+	const struct willis_xkb_table* source);
+
+// returns NULL if the text of the key must be computed by xkbcommon
+const struct willis_xkb_table_level* willis_xkb_table_lookup(
+	const struct willis_xkb_table* table,
+	xkb_keycode_t keycode,
+	uint32_t mods,
+	int32_t group);
+
+void willis_xkb_table_clean(
+	struct willis_xkb_table* table);
+
+// compose sequences of the locale, stored as-is in the disk cache: header,
+// nodes (the first one being the root) then the composed text of the leaves
+#define WILLIS_XKB_TRIE_MAGIC "WLKC"
+#define WILLIS_XKB_TRIE_VERSION 1
+// longest sequence xkbcommon accepts
+#define WILLIS_XKB_TRIE_DEPTH 10
+
+struct willis_xkb_trie_header
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t node_size;
+	uint32_t nodes_count;
+	uint32_t utf8_size;
+	uint32_t reserved;
+	uint64_t hash;
+	char xkb_version[32];
+};
+
+// the children of a node are contiguous and sorted by keysym,
+// nodes without children are the end of a sequence
+struct willis_xkb_trie_node
+{
+	uint32_t keysym;
+	uint32_t children;
+	uint32_t children_count;
+	uint32_t utf8_offset;
+	uint32_t utf8_size;
+	uint32_t result;
+};
+
+struct willis_xkb_trie
+{
+	const struct willis_xkb_trie_header* header;
+	const struct willis_xkb_trie_node* nodes;
+	const char* utf8;
+	struct willis_xkb_table_storage* storage;
+};
+
+// hashes the locale and the size and modification time of the compose files
+uint64_t willis_xkb_trie_hash(
+	const char* locale);
+
+// derives the trie from a compose table (requires xkbcommon 1.6)
+bool willis_xkb_trie_build(
+	struct willis_xkb_trie* trie,
+	struct xkb_compose_table* compose_table,
+	uint64_t hash);
+
+// maps the trie of the given compose hash from the disk cache
+bool willis_xkb_trie_load(
+	struct willis_xkb_trie* trie,
+	uint64_t hash);
+
+// writes the trie in the disk cache, failures are ignored
+void willis_xkb_trie_save(
+	const struct willis_xkb_trie* trie);
+
+// returns the child of node for keysym, or 0 (the root) if there is none
+uint32_t willis_xkb_trie_next(
+	const struct willis_xkb_trie* trie,
+	uint32_t node,
+	xkb_keysym_t keysym);
+
+void willis_xkb_trie_clean(
+	struct willis_xkb_trie* trie);
+
+#endif
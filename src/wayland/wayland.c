@@ -2,6 +2,7 @@
 #include "common/willis_private.h"
 #include "include/willis_wayland.h"
 #include "nix/nix.h"
+#include "nix/nix_registry.h"
 #include "wayland/wayland.h"
 #include "wayland/wayland_helpers.h"
 
@@ -115,10 +116,10 @@ void willis_wayland_start(
 	// get the best locale setting available
 	willis_xkb_init_locale(backend->xkb_common);
 
-	// create the xkb context
-	backend->xkb_common->context =
-		xkb_context_new(
-			XKB_CONTEXT_NO_FLAGS);
+	// share the xkb context with the other willis contexts
+	willis_xkb_registry_lock();
+	backend->xkb_common->context = willis_xkb_registry_context_acquire();
+	willis_xkb_registry_unlock();
 
 	if (backend->xkb_common->context == NULL)
 	{
@@ -126,8 +127,8 @@ void willis_wayland_start(
 		return;
 	}
 
-	// prepare composition handling with xkb
-	willis_xkb_init_compose(backend->xkb_common);
+	// prepare composition handling with xkb, now or later
+	willis_xkb_load_compose(context, backend->xkb_common);
 
 	// add our registry handler callback
 	window_data->add_registry_handler(
@@ -169,76 +170,29 @@ void willis_wayland_handle_event(
 	willis_error_ok(error);
 }
 
-bool willis_wayland_mouse_grab(
+static bool seat_grab(
 	struct willis* context,
+	struct wayland_seat* seat,
 	struct willis_error_info* error)
 {
 	struct wayland_backend* backend = context->backend_data;
 	int error_posix;
 
-	// abort if already grabbed
-	if (backend->mouse_grabbed == true)
-	{
-		willis_error_ok(error);
-		return false;
-	}
-
-	// check we have everything we need
-	if (backend->pointer == NULL)
-	{
-		willis_error_throw(
-			context,
-			error,
-			WILLIS_ERROR_WAYLAND_POINTER_MISSING);
-
-		return false;
-	}
-
-	if (backend->pointer_relative_manager == NULL)
-	{
-		willis_error_throw(
-			context,
-			error,
-			WILLIS_ERROR_WAYLAND_POINTER_RELATIVE_MANAGER_MISSING);
-
-		return false;
-	}
-
-	if (backend->pointer_constraints_manager == NULL)
-	{
-		willis_error_throw(
-			context,
-			error,
-			WILLIS_ERROR_WAYLAND_POINTER_CONSTRAINTS_MANAGER_MISSING);
-
-		return false;
-	}
-
-	if (backend->pointer_surface == NULL)
-	{
-		willis_error_throw(
-			context,
-			error,
-			WILLIS_ERROR_WAYLAND_POINTER_SURFACE_MISSING);
-
-		return false;
-	}
-
 	// hide cursor
 	wl_pointer_set_cursor(
-		backend->pointer,
+		seat->pointer,
 		0,
 		NULL,
 		0,
 		0);
 
 	// register relative mouse events listener
-	backend->pointer_relative =
+	seat->pointer_relative =
 		zwp_relative_pointer_manager_v1_get_relative_pointer(
 			backend->pointer_relative_manager,
-			backend->pointer);
+			seat->pointer);
 
-	if (backend->pointer_relative == NULL)
+	if (seat->pointer_relative == NULL)
 	{
 		willis_error_throw(
 			context,
@@ -250,9 +204,9 @@ bool willis_wayland_mouse_grab(
 
 	error_posix =
 		zwp_relative_pointer_v1_add_listener(
-			backend->pointer_relative,
+			seat->pointer_relative,
 			&backend->listener_pointer_relative,
-			context);
+			seat);
 
 	if (error_posix == -1)
 	{
@@ -265,15 +219,15 @@ bool willis_wayland_mouse_grab(
 	}
 
 	// grab pointer
-	backend->pointer_locked =
+	seat->pointer_locked =
 		zwp_pointer_constraints_v1_lock_pointer(
 			backend->pointer_constraints_manager,
-			backend->pointer_surface,
-			backend->pointer,
+			seat->pointer_surface,
+			seat->pointer,
 			NULL,
 			ZWP_POINTER_CONSTRAINTS_V1_LIFETIME_PERSISTENT);
 
-	if (backend->pointer_locked == NULL)
+	if (seat->pointer_locked == NULL)
 	{
 		willis_error_throw(
 			context,
@@ -285,9 +239,9 @@ bool willis_wayland_mouse_grab(
 
 	error_posix =
 		zwp_locked_pointer_v1_add_listener(
-			backend->pointer_locked,
+			seat->pointer_locked,
 			&backend->listener_pointer_locked,
-			context);
+			seat);
 
 	if (error_posix == -1)
 	{
@@ -299,51 +253,121 @@ bool willis_wayland_mouse_grab(
 		return false;
 	}
 
-	// all good
-	backend->mouse_grabbed = true;
-	willis_error_ok(error);
 	return true;
 }
 
-bool willis_wayland_mouse_ungrab(
+static void seat_ungrab(
+	struct wayland_seat* seat)
+{
+	if (seat->pointer_relative != NULL)
+	{
+		zwp_relative_pointer_v1_destroy(seat->pointer_relative);
+		seat->pointer_relative = NULL;
+	}
+
+	if (seat->pointer_locked != NULL)
+	{
+		zwp_locked_pointer_v1_destroy(seat->pointer_locked);
+		seat->pointer_locked = NULL;
+	}
+}
+
+bool willis_wayland_mouse_grab(
 	struct willis* context,
 	struct willis_error_info* error)
 {
 	struct wayland_backend* backend = context->backend_data;
 
-	// abort if already ungrabbed
-	if (backend->mouse_grabbed == false)
+	// abort if already grabbed
+	if (backend->mouse_grabbed == true)
 	{
 		willis_error_ok(error);
 		return false;
 	}
 
 	// check we have everything we need
-	if (backend->pointer_relative == NULL)
+	if (backend->pointer_relative_manager == NULL)
 	{
 		willis_error_throw(
 			context,
 			error,
-			WILLIS_ERROR_WAYLAND_POINTER_RELATIVE_MISSING);
+			WILLIS_ERROR_WAYLAND_POINTER_RELATIVE_MANAGER_MISSING);
 
 		return false;
 	}
 
-	if (backend->pointer_locked == NULL)
+	if (backend->pointer_constraints_manager == NULL)
 	{
 		willis_error_throw(
 			context,
 			error,
-			WILLIS_ERROR_WAYLAND_POINTER_LOCKED_MISSING);
+			WILLIS_ERROR_WAYLAND_POINTER_CONSTRAINTS_MANAGER_MISSING);
 
 		return false;
 	}
 
+	// lock the pointers of all the seats currently over our surface
+	enum willis_error missing = WILLIS_ERROR_WAYLAND_POINTER_MISSING;
+	size_t grabbed = 0;
+
+	for (size_t i = 0; i < backend->seats_count; ++i)
+	{
+		struct wayland_seat* seat = &(backend->seats[i]);
+
+		if (seat->pointer == NULL)
+		{
+			continue;
+		}
+
+		if (seat->pointer_surface == NULL)
+		{
+			missing = WILLIS_ERROR_WAYLAND_POINTER_SURFACE_MISSING;
+			continue;
+		}
+
+		if (seat_grab(context, seat, error) == false)
+		{
+			for (size_t k = 0; k <= i; ++k)
+			{
+				seat_ungrab(&(backend->seats[k]));
+			}
+
+			return false;
+		}
+
+		++grabbed;
+	}
+
+	if (grabbed == 0)
+	{
+		willis_error_throw(context, error, missing);
+		return false;
+	}
+
+	// all good
+	backend->mouse_grabbed = true;
+	willis_error_ok(error);
+	return true;
+}
+
+bool willis_wayland_mouse_ungrab(
+	struct willis* context,
+	struct willis_error_info* error)
+{
+	struct wayland_backend* backend = context->backend_data;
+
+	// abort if already ungrabbed
+	if (backend->mouse_grabbed == false)
+	{
+		willis_error_ok(error);
+		return false;
+	}
+
 	// restore classic mouse pointer behaviour
-	zwp_relative_pointer_v1_destroy(backend->pointer_relative);
-	zwp_locked_pointer_v1_destroy(backend->pointer_locked);
-	backend->pointer_relative = NULL;
-	backend->pointer_locked = NULL;
+	for (size_t i = 0; i < backend->seats_count; ++i)
+	{
+		seat_ungrab(&(backend->seats[i]));
+	}
 
 	// all good
 	backend->mouse_grabbed = false;
@@ -351,48 +375,156 @@ bool willis_wayland_mouse_ungrab(
 	return true;
 }
 
-void willis_wayland_stop(
+// seats focused on a surface that is not served anymore lose their focus,
+// and their pointer lock with it
+static void surfaces_update(
+	struct wayland_backend* backend)
+{
+	bool locked = false;
+
+	for (size_t i = 0; i < backend->seats_count; ++i)
+	{
+		struct wayland_seat* seat = &(backend->seats[i]);
+
+		if ((seat->pointer_surface != NULL)
+		&& (wayland_helpers_surface_served(backend, seat->pointer_surface) == false))
+		{
+			seat_ungrab(seat);
+			seat->pointer_surface = NULL;
+		}
+
+		if ((seat->keyboard_surface != NULL)
+		&& (wayland_helpers_surface_served(backend, seat->keyboard_surface) == false))
+		{
+			seat->keyboard_surface = NULL;
+		}
+
+		if (seat->pointer_locked != NULL)
+		{
+			locked = true;
+		}
+	}
+
+	// so the mouse can be grabbed again
+	if (locked == false)
+	{
+		backend->mouse_grabbed = false;
+	}
+}
+
+void willis_wayland_window_attach(
 	struct willis* context,
+	uintptr_t window,
 	struct willis_error_info* error)
 {
 	struct wayland_backend* backend = context->backend_data;
-	struct willis_xkb* xkb_common = backend->xkb_common;
+	struct wl_surface* surface = (struct wl_surface*) window;
 
-	if (backend->keyboard != NULL)
+	if (surface == NULL)
 	{
-		wl_keyboard_release(backend->keyboard);
+		willis_error_throw(context, error, WILLIS_ERROR_NULL);
+		return;
 	}
 
-	if (backend->pointer != NULL)
+	// attaching a surface twice does nothing
+	for (size_t i = 0; i < backend->surfaces_count; ++i)
 	{
-		wl_pointer_release(backend->pointer);
+		if (backend->surfaces[i] == surface)
+		{
+			willis_error_ok(error);
+			return;
+		}
 	}
 
-	if (backend->pointer_relative_manager != NULL)
+	if (backend->surfaces_count >= WAYLAND_SURFACES_MAX)
 	{
-		zwp_relative_pointer_manager_v1_destroy(backend->pointer_relative_manager);
+		willis_error_throw(context, error, WILLIS_ERROR_WINDOW_LIMIT);
+		return;
 	}
 
-	if (backend->pointer_constraints_manager != NULL)
+	// the seats, their xkb state and the pointer constraints are already
+	// shared by all the surfaces, the first one restricts the served ones
+	backend->surfaces[backend->surfaces_count] = surface;
+	++(backend->surfaces_count);
+
+	if (backend->surfaces_count == 1)
 	{
-		zwp_pointer_constraints_v1_destroy(backend->pointer_constraints_manager);
+		surfaces_update(backend);
+	}
+
+	willis_error_ok(error);
+}
+
+void willis_wayland_window_detach(
+	struct willis* context,
+	uintptr_t window,
+	struct willis_error_info* error)
+{
+	struct wayland_backend* backend = context->backend_data;
+	struct wl_surface* surface = (struct wl_surface*) window;
+
+	for (size_t i = 0; i < backend->surfaces_count; ++i)
+	{
+		if (backend->surfaces[i] == surface)
+		{
+			--(backend->surfaces_count);
+			backend->surfaces[i] = backend->surfaces[backend->surfaces_count];
+
+			// all the surfaces are served again once the last one is detached
+			if (backend->surfaces_count > 0)
+			{
+				surfaces_update(backend);
+			}
+
+			willis_error_ok(error);
+			return;
+		}
+	}
+
+	willis_error_throw(context, error, WILLIS_ERROR_WINDOW_UNKNOWN);
+}
+
+void willis_wayland_stop(
+	struct willis* context,
+	struct willis_error_info* error)
+{
+	struct wayland_backend* backend = context->backend_data;
+	struct willis_xkb* xkb_common = backend->xkb_common;
+
+	for (size_t i = 0; i < backend->seats_count; ++i)
+	{
+		struct wayland_seat* seat = &(backend->seats[i]);
+
+		seat_ungrab(seat);
+
+		if (seat->keyboard != NULL)
+		{
+			wl_keyboard_release(seat->keyboard);
+		}
+
+		if (seat->pointer != NULL)
+		{
+			wl_pointer_release(seat->pointer);
+		}
+
+		// the context and compose table belong to the backend
+		willis_xkb_clean(&(seat->xkb));
 	}
 
-	if (backend->pointer_relative != NULL)
+	backend->seats_count = 0;
+	backend->surfaces_count = 0;
+
+	if (backend->pointer_relative_manager != NULL)
 	{
-		zwp_relative_pointer_v1_destroy(backend->pointer_relative);
+		zwp_relative_pointer_manager_v1_destroy(backend->pointer_relative_manager);
 	}
 
-	if (backend->pointer_locked != NULL)
+	if (backend->pointer_constraints_manager != NULL)
 	{
-		zwp_locked_pointer_v1_destroy(backend->pointer_locked);
+		zwp_pointer_constraints_v1_destroy(backend->pointer_constraints_manager);
 	}
 
-	xkb_state_unref(xkb_common->state);
-	xkb_keymap_unref(xkb_common->keymap);
-	xkb_compose_table_unref(xkb_common->compose_table);
-	xkb_compose_state_unref(xkb_common->compose_state);
-	xkb_context_unref(xkb_common->context);
+	willis_xkb_clean(xkb_common);
 
 	willis_error_ok(error);
 }
@@ -417,8 +549,11 @@ void willis_prepare_init_wayland(
 	config->init = willis_wayland_init;
 	config->start = willis_wayland_start;
 	config->handle_event = willis_wayland_handle_event;
+	config->handle_events = NULL;
 	config->mouse_grab = willis_wayland_mouse_grab;
 	config->mouse_ungrab = willis_wayland_mouse_ungrab;
+	config->window_attach = willis_wayland_window_attach;
+	config->window_detach = willis_wayland_window_detach;
 	config->stop = willis_wayland_stop;
 	config->clean = willis_wayland_clean;
 }
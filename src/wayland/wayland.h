@@ -11,6 +11,33 @@
 #include "zwp-relative-pointer-protocol.h"
 #include "zwp-pointer-constraints-protocol.h"
 
+// seats are stored in place so listeners can keep pointers to them
+#define WAYLAND_SEATS_MAX 8
+#define WAYLAND_SURFACES_MAX 32
+
+struct wayland_seat
+{
+	struct willis* context;
+	struct wl_seat* seat;
+	uint32_t id;
+
+	// input devices
+	struct wl_pointer* pointer;
+	struct wl_keyboard* keyboard;
+
+	// surfaces with the pointer and keyboard focus, NULL when not served
+	struct wl_surface* pointer_surface;
+	struct wl_surface* keyboard_surface;
+
+	// pointer constraints
+	struct zwp_relative_pointer_v1* pointer_relative;
+	struct zwp_locked_pointer_v1* pointer_locked;
+
+	// keymap, xkb state and compose state of this seat,
+	// the xkb context and compose table are shared with the backend
+	struct willis_xkb xkb;
+};
+
 struct wayland_backend
 {
 	bool mouse_grabbed;
@@ -26,14 +53,16 @@ struct wayland_backend
 		void* event);
 	void* event_callback_data;
 
-	// core structures
-	struct wl_pointer* pointer;
-	struct wl_keyboard* keyboard;
-	struct wl_surface* pointer_surface;
+	// seats, indexed by the seat id of the events
+	struct wayland_seat seats[WAYLAND_SEATS_MAX];
+	size_t seats_count;
 
-	// pointer structures
-	struct zwp_relative_pointer_v1* pointer_relative;
-	struct zwp_locked_pointer_v1* pointer_locked;
+	// surfaces served by the context, all of them while none is attached,
+	// they share the keyboard state, keymaps and mouse grab of the context
+	struct wl_surface* surfaces[WAYLAND_SURFACES_MAX];
+	size_t surfaces_count;
+
+	// pointer constraints managers
 	struct zwp_relative_pointer_manager_v1* pointer_relative_manager;
 	struct zwp_pointer_constraints_v1* pointer_constraints_manager;
 
@@ -67,6 +96,16 @@ bool willis_wayland_mouse_ungrab(
 	struct willis* context,
 	struct willis_error_info* error);
 
+void willis_wayland_window_attach(
+	struct willis* context,
+	uintptr_t window,
+	struct willis_error_info* error);
+
+void willis_wayland_window_detach(
+	struct willis* context,
+	uintptr_t window,
+	struct willis_error_info* error);
+
 void willis_wayland_stop(
 	struct willis* context,
 	struct willis_error_info* error);
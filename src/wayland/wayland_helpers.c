@@ -4,6 +4,7 @@
 #include "wayland/wayland.h"
 #include "wayland/wayland_helpers.h"
 #include "nix/nix.h"
+#include "nix/nix_registry.h"
 
 #include <linux/input.h>
 #include <stdbool.h>
@@ -13,6 +14,7 @@
 #include <sys/mman.h>
 #include <unistd.h>
 #include <wayland-client.h>
+#include <xkbcommon/xkbcommon-compose.h>
 #include "zwp-relative-pointer-protocol.h"
 #include "zwp-pointer-constraints-protocol.h"
 
@@ -25,6 +27,13 @@ union i64_bits
 	uint64_t bits;
 };
 
+// statistics
+static inline void count_callback(
+	struct willis* context)
+{
+	WILLIS_STATS_ADD(context, wayland_callbacks, 1);
+}
+
 // registry handler
 void wayland_helpers_registry_handler(
 	void* data,
@@ -34,6 +43,8 @@ void wayland_helpers_registry_handler(
 	uint32_t version)
 {
 	struct willis* context = data;
+	count_callback(context);
+
 	struct wayland_backend* backend = context->backend_data;
 	struct willis_error_info error;
 
@@ -76,26 +87,86 @@ void wayland_helpers_registry_handler(
 	}
 }
 
+// seats
+void wayland_helpers_seat_xkb(
+	struct wayland_backend* backend,
+	struct wayland_seat* seat)
+{
+	struct willis_xkb* xkb_common = backend->xkb_common;
+
+	// the keymap and xkb state are only created when the seat receives one
+	seat->xkb.context = xkb_common->context;
+	seat->xkb.locale = xkb_common->locale;
+	willis_xkb_share_compose(&(seat->xkb), xkb_common);
+}
+
+static struct wayland_seat* seat_get(
+	struct willis* context,
+	struct wl_seat* wl_seat)
+{
+	struct wayland_backend* backend = context->backend_data;
+
+	for (size_t i = 0; i < backend->seats_count; ++i)
+	{
+		if (backend->seats[i].seat == wl_seat)
+		{
+			return &(backend->seats[i]);
+		}
+	}
+
+	if (backend->seats_count >= WAYLAND_SEATS_MAX)
+	{
+		return NULL;
+	}
+
+	// seats are never removed so their ids stay valid
+	struct wayland_seat* seat = &(backend->seats[backend->seats_count]);
+	struct wayland_seat zero = {0};
+	*seat = zero;
+
+	seat->context = context;
+	seat->seat = wl_seat;
+	seat->id = backend->seats_count;
+	wayland_helpers_seat_xkb(backend, seat);
+
+	++(backend->seats_count);
+
+	return seat;
+}
+
 // capabilities handler
 void wayland_helpers_capabilities_handler(
 	void* data,
-	void* seat,
+	void* wl_seat,
 	uint32_t capabilities)
 {
 	struct willis* context = data;
 	struct wayland_backend* backend = context->backend_data;
+	count_callback(context);
 
 	struct willis_error_info error;
 	int error_posix;
 
+	struct wayland_seat* seat = seat_get(context, wl_seat);
+
+	if (seat == NULL)
+	{
+		willis_error_throw(
+			context,
+			&error,
+			WILLIS_ERROR_BOUNDS);
+
+		return;
+	}
+
 	bool pointer = (capabilities & WL_SEAT_CAPABILITY_POINTER) != 0;
 	bool keyboard = (capabilities & WL_SEAT_CAPABILITY_KEYBOARD) != 0;
 
-	if ((pointer == true) && (backend->pointer == NULL))
+	if ((pointer == true) && (seat->pointer == NULL))
 	{
-		backend->pointer = wl_seat_get_pointer(seat);
+		seat->pointer = wl_seat_get_pointer(wl_seat);
 
-		if (backend->pointer == NULL)
+		if (seat->pointer == NULL)
 		{
 			willis_error_throw(
 				context,
@@ -107,9 +178,9 @@ void wayland_helpers_capabilities_handler(
 
 		error_posix =
 			wl_pointer_add_listener(
-				backend->pointer,
+				seat->pointer,
 				&(backend->listener_pointer),
-				data);
+				seat);
 
 		if (error_posix == -1)
 		{
@@ -121,17 +192,18 @@ void wayland_helpers_capabilities_handler(
 			return;
 		}
 	}
-	else if ((pointer == false) && (backend->pointer != NULL))
+	else if ((pointer == false) && (seat->pointer != NULL))
 	{
-		wl_pointer_release(backend->pointer);
-		backend->pointer = NULL;
+		wl_pointer_release(seat->pointer);
+		seat->pointer = NULL;
+		seat->pointer_surface = NULL;
 	}
 
-	if ((keyboard == true) && (backend->keyboard == NULL))
+	if ((keyboard == true) && (seat->keyboard == NULL))
 	{
-		backend->keyboard = wl_seat_get_keyboard(seat);
+		seat->keyboard = wl_seat_get_keyboard(wl_seat);
 
-		if (backend->keyboard == NULL)
+		if (seat->keyboard == NULL)
 		{
 			willis_error_throw(
 				context,
@@ -143,9 +215,9 @@ void wayland_helpers_capabilities_handler(
 
 		error_posix =
 			wl_keyboard_add_listener(
-				backend->keyboard,
+				seat->keyboard,
 				&(backend->listener_keyboard),
-				data);
+				seat);
 
 		if (error_posix == -1)
 		{
@@ -157,10 +229,11 @@ void wayland_helpers_capabilities_handler(
 			return;
 		}
 	}
-	else if ((keyboard == false) && (backend->keyboard != NULL))
+	else if ((keyboard == false) && (seat->keyboard != NULL))
 	{
-		wl_keyboard_release(backend->keyboard);
-		backend->keyboard = NULL;
+		wl_keyboard_release(seat->keyboard);
+		seat->keyboard = NULL;
+		seat->keyboard_surface = NULL;
 	}
 }
 
@@ -176,16 +249,84 @@ void willis_wayland_reset_event_info(
 		.event_state = WILLIS_STATE_NONE,
 		.utf8_string = NULL,
 		.utf8_size = 0,
+		.utf8_buffer = {0},
+		.utf8_overflow = false,
 		.mouse_wheel_steps = 0,
 		.mouse_x = 0,
 		.mouse_y = 0,
 		.diff_x = 0,
 		.diff_y = 0,
+		.mouse_raw = false,
+		.time_native_ns = 0,
+		.time_ns = 0,
+		.seat = 0,
+		.device = 0,
+		.window = 0,
 	};
 
 	backend->event_info = event_info;
 }
 
+bool wayland_helpers_surface_served(
+	struct wayland_backend* backend,
+	struct wl_surface* surface)
+{
+	if (backend->surfaces_count == 0)
+	{
+		return true;
+	}
+
+	for (size_t i = 0; i < backend->surfaces_count; ++i)
+	{
+		if (backend->surfaces[i] == surface)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// event delivery
+void wayland_helpers_dispatch(
+	struct wayland_seat* seat,
+	struct wl_surface* surface)
+{
+	struct willis* context = seat->context;
+	struct wayland_backend* backend = context->backend_data;
+
+	// the focus is on a surface of another context
+	if (surface == NULL)
+	{
+		free(backend->event_info.utf8_string);
+		willis_wayland_reset_event_info(context);
+		return;
+	}
+
+	backend->event_info.seat = seat->id;
+	backend->event_info.window = (uintptr_t) surface;
+
+	// push straight into the attached queue instead of notifying the app
+	if (context->queue != NULL)
+	{
+		struct willis_event_info event_info;
+		struct willis_error_info error;
+
+		willis_handle_event(
+			context,
+			&(backend->event_serial),
+			&event_info,
+			&error);
+
+		free(event_info.utf8_string);
+		return;
+	}
+
+	backend->event_callback(
+		backend->event_callback_data,
+		&(backend->event_serial));
+}
+
 // mouse coordinates format conversion
 void wayland_helpers_mouse(
 	struct willis* context,
@@ -208,15 +349,24 @@ void wayland_helpers_listener_pointer_enter(
 	wl_fixed_t surface_x,
 	wl_fixed_t surface_y)
 {
-	struct willis* context = data;
+	struct wayland_seat* seat = data;
+	struct willis* context = seat->context;
 	struct wayland_backend* backend = context->backend_data;
+	count_callback(context);
 
 	backend->event_serial = serial;
-	backend->pointer_surface = surface;
+	seat->pointer_surface = NULL;
+
+	if (wayland_helpers_surface_served(backend, surface) == true)
+	{
+		seat->pointer_surface = surface;
+	}
 
-	wayland_helpers_mouse(data, surface_x, surface_y);
+	// this event has no timestamp
+	wayland_helpers_mouse(context, surface_x, surface_y);
+	backend->event_info.time_native_ns = 0;
 
-	backend->event_callback(backend->event_callback_data, &(backend->event_serial));
+	wayland_helpers_dispatch(seat, seat->pointer_surface);
 }
 
 void wayland_helpers_listener_pointer_leave(
@@ -225,14 +375,16 @@ void wayland_helpers_listener_pointer_leave(
 	uint32_t serial,
 	struct wl_surface* surface)
 {
-	struct willis* context = data;
+	struct wayland_seat* seat = data;
+	struct willis* context = seat->context;
 	struct wayland_backend* backend = context->backend_data;
+	count_callback(context);
 
 	backend->event_serial = serial;
 
-	if (backend->pointer_surface == surface)
+	if (seat->pointer_surface == surface)
 	{
-		backend->pointer_surface = NULL;
+		seat->pointer_surface = NULL;
 	}
 }
 
@@ -243,13 +395,16 @@ void wayland_helpers_listener_pointer_motion(
 	wl_fixed_t surface_x,
 	wl_fixed_t surface_y)
 {
-	struct willis* context = data;
+	struct wayland_seat* seat = data;
+	struct willis* context = seat->context;
 	struct wayland_backend* backend = context->backend_data;
+	count_callback(context);
 
-	wayland_helpers_mouse(data, surface_x, surface_y);
+	wayland_helpers_mouse(context, surface_x, surface_y);
+	backend->event_info.time_native_ns = WILLIS_TIME_MS_TO_NS(time);
 
 	// use previous serial for this context since this event does not provide one
-	backend->event_callback(backend->event_callback_data, &(backend->event_serial));
+	wayland_helpers_dispatch(seat, seat->pointer_surface);
 }
 
 void wayland_helpers_listener_pointer_button(
@@ -260,8 +415,10 @@ void wayland_helpers_listener_pointer_button(
 	uint32_t button,
 	uint32_t state)
 {
-	struct willis* context = data;
+	struct wayland_seat* seat = data;
+	struct willis* context = seat->context;
 	struct wayland_backend* backend = context->backend_data;
+	count_callback(context);
 	backend->event_serial = serial;
 
 	enum willis_event_code event_code;
@@ -302,8 +459,9 @@ void wayland_helpers_listener_pointer_button(
 
 	backend->event_info.event_code = event_code;
 	backend->event_info.event_state = event_state;
+	backend->event_info.time_native_ns = WILLIS_TIME_MS_TO_NS(time);
 
-	backend->event_callback(backend->event_callback_data, &(backend->event_serial));
+	wayland_helpers_dispatch(seat, seat->pointer_surface);
 }
 
 void wayland_helpers_listener_pointer_axis_source(
@@ -311,6 +469,9 @@ void wayland_helpers_listener_pointer_axis_source(
 	struct wl_pointer* pointer,
 	uint32_t axis_source)
 {
+	struct wayland_seat* seat = data;
+	count_callback(seat->context);
+
 	// high-res axes are not supported by willis
 }
 
@@ -320,6 +481,9 @@ void wayland_helpers_listener_pointer_axis_stop(
 	uint32_t time,
 	uint32_t axis)
 {
+	struct wayland_seat* seat = data;
+	count_callback(seat->context);
+
 	// high-res axes are not supported by willis
 }
 
@@ -329,11 +493,13 @@ void wayland_helpers_listener_pointer_axis_discrete(
 	uint32_t axis,
 	int32_t discrete)
 {
+	struct wayland_seat* seat = data;
+	count_callback(seat->context);
+
 	// only regular mouse wheel is supported by willis
 	if (axis == WL_POINTER_AXIS_VERTICAL_SCROLL)
 	{
-		struct willis* context = data;
-		struct wayland_backend* backend = context->backend_data;
+		struct wayland_backend* backend = seat->context->backend_data;
 
 		enum willis_event_code event_code;
 		uint32_t max;
@@ -354,7 +520,7 @@ void wayland_helpers_listener_pointer_axis_discrete(
 		backend->event_info.mouse_wheel_steps = max;
 
 		// use previous serial for this context since this event does not provide one
-		backend->event_callback(backend->event_callback_data, &(backend->event_serial));
+		wayland_helpers_dispatch(seat, seat->pointer_surface);
 	}
 }
 
@@ -365,9 +531,14 @@ void wayland_helpers_listener_pointer_axis(
 	uint32_t axis,
 	wl_fixed_t value)
 {
+	// counted by the discrete axis listener we forward this event to
 	// high-res axes are not supported by willis
+	struct wayland_seat* seat = data;
+	struct wayland_backend* backend = seat->context->backend_data;
 	int32_t discrete;
 
+	backend->event_info.time_native_ns = WILLIS_TIME_MS_TO_NS(time);
+
 	if (value > 0)
 	{
 		discrete = 1;
@@ -388,6 +559,9 @@ void wayland_helpers_listener_pointer_frame(
 	void* data,
 	struct wl_pointer* pointer)
 {
+	struct wayland_seat* seat = data;
+	count_callback(seat->context);
+
 	// high-res axes are not supported by willis
 	// compositions are to be handled outside of willis
 }
@@ -400,8 +574,10 @@ void wayland_helpers_listener_keyboard_keymap(
 	int32_t fd,
 	uint32_t size)
 {
-	struct willis* context = data;
+	struct wayland_seat* seat = data;
+	struct willis* context = seat->context;
 	struct wayland_backend* backend = context->backend_data;
+	count_callback(context);
 
 	if (format == WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1)
 	{
@@ -414,23 +590,62 @@ void wayland_helpers_listener_keyboard_keymap(
 				// advanced keyboard handling
 				willis_xkb_init_locale(backend->xkb_common);
 
-				backend->xkb_common->context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+				willis_xkb_registry_lock();
+				backend->xkb_common->context = willis_xkb_registry_context_acquire();
+				willis_xkb_registry_unlock();
 
 				if (backend->xkb_common->context == NULL)
 				{
 					return;
 				}
 
-				willis_xkb_init_compose(backend->xkb_common);
+				willis_xkb_load_compose(context, backend->xkb_common);
 			}
 
+			if (seat->xkb.context == NULL)
+			{
+				wayland_helpers_seat_xkb(backend, seat);
+			}
+
+			// switching back to a known layout only swaps pointers
+			uint64_t hash = willis_xkb_hash(map_shm, size, WILLIS_XKB_HASH_INIT);
+
+			if (willis_xkb_cache_use(&(seat->xkb), hash) == true)
+			{
+				munmap(map_shm, size);
+				close(fd);
+				WILLIS_STATS_ADD(context, keymap_cache_hits, 1);
+				return;
+			}
+
+			// the tables of a keymap met by an earlier run are enough to start
+			bool loaded =
+				willis_xkb_keymap_load_text(
+					context,
+					&(seat->xkb),
+					map_shm,
+					size,
+					hash);
+
+			if (loaded == true)
+			{
+				munmap(map_shm, size);
+				close(fd);
+				return;
+			}
+
+			// the shared xkb context is changed by the compilation
+			willis_xkb_registry_lock();
+
 			struct xkb_keymap* keymap =
 				xkb_keymap_new_from_string(
-					backend->xkb_common->context,
+					seat->xkb.context,
 					map_shm,
 					XKB_KEYMAP_FORMAT_TEXT_V1,
 					XKB_KEYMAP_COMPILE_NO_FLAGS);
 
+			willis_xkb_registry_unlock();
+
 			munmap(map_shm, size);
 			close(fd);
 
@@ -443,22 +658,18 @@ void wayland_helpers_listener_keyboard_keymap(
 
 			if (state == NULL)
 			{
+				// the last reference to the keymap releases the shared context
+				willis_xkb_registry_lock();
 				xkb_keymap_unref(keymap);
-				return;
-			}
-
-			if (backend->xkb_common->keymap != NULL)
-			{
-				xkb_keymap_unref(backend->xkb_common->keymap);
-			}
+				willis_xkb_registry_unlock();
 
-			if (backend->xkb_common->state != NULL)
-			{
-				xkb_state_unref(backend->xkb_common->state);
+				return;
 			}
 
-			backend->xkb_common->keymap = keymap;
-			backend->xkb_common->state = state;
+			willis_xkb_keymap_set(&(seat->xkb), keymap, state, hash);
+			willis_xkb_cache_add(&(seat->xkb), hash);
+			willis_xkb_keymap_save(context, &(seat->xkb));
+			WILLIS_STATS_ADD(context, keymap_rebuilds, 1);
 		}
 	}
 }
@@ -470,59 +681,38 @@ void wayland_helpers_listener_keyboard_enter(
 	struct wl_surface* surface,
 	struct wl_array* keys)
 {
-	struct willis* context = data;
+	struct wayland_seat* seat = data;
+	struct willis* context = seat->context;
 	struct wayland_backend* backend = context->backend_data;
+	count_callback(context);
 	backend->event_serial = serial;
+	seat->keyboard_surface = NULL;
+
+	if (wayland_helpers_surface_served(backend, surface) == true)
+	{
+		seat->keyboard_surface = surface;
+	}
 
 	struct willis_error_info error;
 	uint32_t* key;
 
 	willis_error_ok(&error);
 
-	if (backend->xkb_common->compose_state != NULL)
+	wl_array_for_each(key, keys)
 	{
-		wl_array_for_each(key, keys)
-		{
-			backend->event_info.event_code = willis_xkb_translate_keycode(*key + 8);
-			backend->event_info.event_state = WILLIS_STATE_PRESS;
+		backend->event_info.event_code = willis_xkb_translate_keycode(*key + 8);
+		backend->event_info.event_state = WILLIS_STATE_PRESS;
 
-			willis_xkb_utf8_compose(
-				context,
-				backend->xkb_common,
-				*key + 8,
-				&(backend->event_info.utf8_string),
-				&(backend->event_info.utf8_size),
-				&error);
+		willis_xkb_utf8(
+			context,
+			&(seat->xkb),
+			*key + 8,
+			&(backend->event_info),
+			&error);
 
-			if (willis_error_get_code(&error) == WILLIS_ERROR_OK)
-			{
-				backend->event_callback(
-					backend->event_callback_data,
-					&(backend->event_serial));
-			}
-		}
-	}
-	else
-	{
-		wl_array_for_each(key, keys)
+		if (willis_error_get_code(&error) == WILLIS_ERROR_OK)
 		{
-			backend->event_info.event_code = willis_xkb_translate_keycode(*key + 8);
-			backend->event_info.event_state = WILLIS_STATE_PRESS;
-
-			willis_xkb_utf8_simple(
-				context,
-				backend->xkb_common,
-				*key + 8,
-				&(backend->event_info.utf8_string),
-				&(backend->event_info.utf8_size),
-				&error);
-
-			if (willis_error_get_code(&error) == WILLIS_ERROR_OK)
-			{
-				backend->event_callback(
-					backend->event_callback_data,
-					&(backend->event_serial));
-			}
+			wayland_helpers_dispatch(seat, seat->keyboard_surface);
 		}
 	}
 }
@@ -533,7 +723,13 @@ void wayland_helpers_listener_keyboard_leave(
 	uint32_t serial,
 	struct wl_surface* surface)
 {
-	// not needed
+	struct wayland_seat* seat = data;
+	count_callback(seat->context);
+
+	if (seat->keyboard_surface == surface)
+	{
+		seat->keyboard_surface = NULL;
+	}
 }
 
 void wayland_helpers_listener_keyboard_key(
@@ -544,8 +740,10 @@ void wayland_helpers_listener_keyboard_key(
 	uint32_t key,
 	uint32_t state)
 {
-	struct willis* context = data;
+	struct wayland_seat* seat = data;
+	struct willis* context = seat->context;
 	struct wayland_backend* backend = context->backend_data;
+	count_callback(context);
 
 	struct willis_error_info error;
 	backend->event_serial = serial;
@@ -554,31 +752,18 @@ void wayland_helpers_listener_keyboard_key(
 	willis_error_ok(&error);
 
 	backend->event_info.event_code = willis_xkb_translate_keycode(key);
+	backend->event_info.time_native_ns = WILLIS_TIME_MS_TO_NS(time);
 
 	if (state == WL_KEYBOARD_KEY_STATE_PRESSED)
 	{
 		backend->event_info.event_state = WILLIS_STATE_PRESS;
 
-		if (backend->xkb_common->compose_state != NULL)
-		{
-			willis_xkb_utf8_compose(
-				context,
-				backend->xkb_common,
-				key,
-				&(backend->event_info.utf8_string),
-				&(backend->event_info.utf8_size),
-				&error);
-		}
-		else
-		{
-			willis_xkb_utf8_simple(
-				context,
-				backend->xkb_common,
-				key,
-				&(backend->event_info.utf8_string),
-				&(backend->event_info.utf8_size),
-				&error);
-		}
+		willis_xkb_utf8(
+			context,
+			&(seat->xkb),
+			key,
+			&(backend->event_info),
+			&error);
 	}
 	else
 	{
@@ -587,7 +772,7 @@ void wayland_helpers_listener_keyboard_key(
 
 	if (willis_error_get_code(&error) == WILLIS_ERROR_OK)
 	{
-		backend->event_callback(backend->event_callback_data, &(backend->event_serial));
+		wayland_helpers_dispatch(seat, seat->keyboard_surface);
 	}
 }
 
@@ -600,23 +785,22 @@ void wayland_helpers_listener_keyboard_modifiers(
 	uint32_t mods_locked,
 	uint32_t group)
 {
-	struct willis* context = data;
+	struct wayland_seat* seat = data;
+	struct willis* context = seat->context;
 	struct wayland_backend* backend = context->backend_data;
+	count_callback(context);
 	backend->event_serial = serial;
 
-	if (backend->xkb_common->state != NULL)
-	{
-		xkb_state_update_mask(
-			backend->xkb_common->state,
-			mods_depressed,
-			mods_latched,
-			mods_locked,
-			0,
-			0,
-			group);
-	}
+	willis_xkb_update_mask(
+		&(seat->xkb),
+		mods_depressed,
+		mods_latched,
+		mods_locked,
+		0,
+		0,
+		group);
 
-	backend->event_callback(backend->event_callback_data, &(backend->event_serial));
+	wayland_helpers_dispatch(seat, seat->keyboard_surface);
 }
 
 void wayland_helpers_listener_keyboard_repeat_info(
@@ -625,6 +809,9 @@ void wayland_helpers_listener_keyboard_repeat_info(
 	int32_t rate,
 	int32_t delay)
 {
+	struct wayland_seat* seat = data;
+	count_callback(seat->context);
+
 	// not needed
 }
 
@@ -638,8 +825,10 @@ void wayland_helpers_listener_pointer_relative(
 	wl_fixed_t x_linear,
 	wl_fixed_t y_linear)
 {
-	struct willis* context = data;
+	struct wayland_seat* seat = data;
+	struct willis* context = seat->context;
 	struct wayland_backend* backend = context->backend_data;
+	count_callback(context);
 
 	union i64_bits convert;
 	convert.number = x_linear;
@@ -649,15 +838,23 @@ void wayland_helpers_listener_pointer_relative(
 
 	backend->event_info.event_code = WILLIS_MOUSE_MOTION;
 	backend->event_info.event_state = WILLIS_STATE_NONE;
+	backend->event_info.mouse_raw = true;
+
+	// microsecond timestamp split in two 32-bit halves
+	uint64_t utime = (((uint64_t) time_msp) << 32) | time_lsp;
+	backend->event_info.time_native_ns = WILLIS_TIME_US_TO_NS(utime);
 
 	// use previous serial for this context since this event does not provide one
-	backend->event_callback(backend->event_callback_data, &(backend->event_serial));
+	wayland_helpers_dispatch(seat, seat->pointer_surface);
 }
 
 void wayland_helpers_listener_pointer_locked(
 	void* data,
 	struct zwp_locked_pointer_v1* locked)
 {
+	struct wayland_seat* seat = data;
+	count_callback(seat->context);
+
 	// not needed
 }
 
@@ -665,5 +862,8 @@ void wayland_helpers_listener_pointer_unlocked(
 	void* data,
 	struct zwp_locked_pointer_v1* locked)
 {
+	struct wayland_seat* seat = data;
+	count_callback(seat->context);
+
 	// not needed
 }
@@ -15,6 +15,11 @@ void wayland_helpers_registry_handler(
 	const char* interface,
 	uint32_t version);
 
+// shares the xkb context and compose table of the backend with a seat
+void wayland_helpers_seat_xkb(
+	struct wayland_backend* backend,
+	struct wayland_seat* seat);
+
 // capabilities handler
 void wayland_helpers_capabilities_handler(
 	void* data,
@@ -25,6 +30,16 @@ void wayland_helpers_capabilities_handler(
 void willis_wayland_reset_event_info(
 	struct willis* context);
 
+// tells whether the surface is served by the context
+bool wayland_helpers_surface_served(
+	struct wayland_backend* backend,
+	struct wl_surface* surface);
+
+// event delivery, the event is dropped if the surface is not served
+void wayland_helpers_dispatch(
+	struct wayland_seat* seat,
+	struct wl_surface* surface);
+
 // mouse coordinates format conversion
 void wayland_helpers_mouse(
 	struct willis* context,
@@ -70,14 +70,21 @@ void willis_win_handle_event(
 	event_info->event_state = event_state;
 	event_info->utf8_string = NULL;
 	event_info->utf8_size = 0;
+	event_info->utf8_buffer[0] = '\0';
+	event_info->utf8_overflow = false;
 	event_info->mouse_wheel_steps = 0;
 	event_info->mouse_x = 0;
 	event_info->mouse_y = 0;
 	event_info->diff_x = 0;
 	event_info->diff_y = 0;
+	event_info->mouse_raw = false;
+	event_info->seat = 0;
+	event_info->device = 0;
+	event_info->window = 0;
 
 	// handle event
 	MSG* msg = event;
+	event_info->time_native_ns = WILLIS_TIME_MS_TO_NS(msg->time);
 
 	switch (msg->message)
 	{
@@ -254,6 +261,7 @@ void willis_win_handle_event(
 				{
 					event_code = WILLIS_MOUSE_MOTION;
 					event_state = WILLIS_STATE_NONE;
+					event_info->mouse_raw = true;
 
 					event_info->diff_x = mouse->lLastX * 0x0000000100000000;
 					event_info->diff_y = mouse->lLastY * 0x0000000100000000;
@@ -266,42 +274,42 @@ void willis_win_handle_event(
 		{
 			// utf16 to utf8 conversion
 			uint32_t utf16 = msg->wParam;
-			event_info->utf8_string = malloc(5);
-
-			if (event_info->utf8_string == NULL)
-			{
-				willis_error_throw(context, error, WILLIS_ERROR_ALLOC);
-				break;
-			}
+			char utf8[4];
+			size_t utf8_size;
 
 			if (utf16 < 0x80)
 			{
-				event_info->utf8_string[0] = utf16;
-				event_info->utf8_size = 1;
+				utf8[0] = utf16;
+				utf8_size = 1;
 			}
 			else if (utf16 < 0x800)
 			{
-				event_info->utf8_string[0] = 0xC0 | (0x1F & (utf16 >> 6));
-				event_info->utf8_string[1] = 0x80 | (0x3F & (utf16 >> 0));
-				event_info->utf8_size = 2;
+				utf8[0] = 0xC0 | (0x1F & (utf16 >> 6));
+				utf8[1] = 0x80 | (0x3F & (utf16 >> 0));
+				utf8_size = 2;
 			}
 			else if (utf16 < 0x10000)
 			{
-				event_info->utf8_string[0] = 0xE0 | (0x0F & (utf16 >> 12));
-				event_info->utf8_string[1] = 0x80 | (0x3F & (utf16 >> 6));
-				event_info->utf8_string[2] = 0x80 | (0x3F & (utf16 >> 0));
-				event_info->utf8_size = 3;
+				utf8[0] = 0xE0 | (0x0F & (utf16 >> 12));
+				utf8[1] = 0x80 | (0x3F & (utf16 >> 6));
+				utf8[2] = 0x80 | (0x3F & (utf16 >> 0));
+				utf8_size = 3;
 			}
 			else
 			{
-				event_info->utf8_string[0] = 0xF0 | (0x07 & (utf16 >> 18));
-				event_info->utf8_string[1] = 0x80 | (0x3F & (utf16 >> 12));
-				event_info->utf8_string[2] = 0x80 | (0x3F & (utf16 >> 6));
-				event_info->utf8_string[3] = 0x80 | (0x3F & (utf16 >> 0));
-				event_info->utf8_size = 4;
+				utf8[0] = 0xF0 | (0x07 & (utf16 >> 18));
+				utf8[1] = 0x80 | (0x3F & (utf16 >> 12));
+				utf8[2] = 0x80 | (0x3F & (utf16 >> 6));
+				utf8[3] = 0x80 | (0x3F & (utf16 >> 0));
+				utf8_size = 4;
 			}
 
-			event_info->utf8_string[event_info->utf8_size] = '\0';
+			willis_utf8_store(
+				context,
+				event_info,
+				utf8,
+				utf8_size,
+				error);
 
 			break;
 		}
@@ -461,8 +469,11 @@ void willis_prepare_init_win(
 	config->init = willis_win_init;
 	config->start = willis_win_start;
 	config->handle_event = willis_win_handle_event;
+	config->handle_events = NULL;
 	config->mouse_grab = willis_win_mouse_grab;
 	config->mouse_ungrab = willis_win_mouse_ungrab;
+	config->window_attach = NULL;
+	config->window_detach = NULL;
 	config->stop = willis_win_stop;
 	config->clean = willis_win_clean;
 }
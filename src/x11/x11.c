@@ -1,15 +1,24 @@
+#define _GNU_SOURCE
 #include "include/willis.h"
 #include "common/willis_private.h"
+#include "common/willis_latency.h"
+#include "common/willis_trace.h"
 #include "include/willis_x11.h"
 #include "nix/nix.h"
+#include "nix/nix_registry.h"
 #include "x11/x11.h"
 #include "x11/x11_helpers.h"
 
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <xcb/xcb.h>
+#include <xcb/xcbext.h>
 #include <xcb/xfixes.h>
 #include <xcb/xinput.h>
 #include <xcb/xkb.h>
@@ -17,6 +26,14 @@
 #include <xkbcommon/xkbcommon-compose.h>
 #include <xkbcommon/xkbcommon-x11.h>
 
+static void x11_thread_disconnect(
+	struct x11_backend* backend);
+
+static void x11_thread_start(
+	struct willis* context,
+	struct willis_x11_data* window_data,
+	struct willis_error_info* error);
+
 void willis_x11_init(
 	struct willis* context,
 	struct willis_error_info* error)
@@ -65,14 +82,50 @@ void willis_x11_start(
 	xcb_generic_error_t* error_xcb;
 
 	backend->conn = window_data->conn;
-	backend->window = window_data->window;
 	backend->root = window_data->root;
+	backend->windows[0] = window_data->window;
+	backend->windows_count = 1;
+	backend->windows_filter = false;
+	backend->window_pointer = window_data->window;
+	backend->window = window_data->window;
 	backend->mouse_grabbed = false;
+	backend->grab_pending = false;
+	backend->raw_input_grab = window_data->raw_input_grab;
 
 	backend->xkb_device_id = 0;
 	backend->xkb_event = 0;
 	backend->xkb_select_events_details = zero;
 
+	backend->conn_app = window_data->conn;
+	backend->conn_thread = NULL;
+	backend->thread_running = false;
+
+	// the input thread gets its own connection, which the xkb setup uses
+	if (window_data->input_thread == true)
+	{
+		// the thread can only publish events through the queue
+		if (context->queue == NULL)
+		{
+			willis_error_throw(context, error, WILLIS_ERROR_NULL);
+			return;
+		}
+
+		backend->conn_thread =
+			xcb_connect(
+				window_data->input_thread_display,
+				NULL);
+
+		if (xcb_connection_has_error(backend->conn_thread) != 0)
+		{
+			xcb_disconnect(backend->conn_thread);
+			backend->conn_thread = NULL;
+			willis_error_throw(context, error, WILLIS_ERROR_X11_CONNECT);
+			return;
+		}
+
+		backend->conn = backend->conn_thread;
+	}
+
 	// get the best locale setting available
 	willis_xkb_init_locale(backend->xkb_common);
 
@@ -90,23 +143,25 @@ void willis_x11_start(
 
 	if (error_posix == 0)
 	{
+		x11_thread_disconnect(backend);
 		willis_error_throw(context, error, WILLIS_ERROR_X11_XKB_SETUP);
 		return;
 	}
 
-	// create the xkb context
-	backend->xkb_common->context =
-		xkb_context_new(
-			XKB_CONTEXT_NO_FLAGS);
+	// share the xkb context with the other willis contexts
+	willis_xkb_registry_lock();
+	backend->xkb_common->context = willis_xkb_registry_context_acquire();
+	willis_xkb_registry_unlock();
 
 	if (backend->xkb_common->context == NULL)
 	{
+		x11_thread_disconnect(backend);
 		willis_error_throw(context, error, WILLIS_ERROR_XKB_CONTEXT_NEW);
 		return;
 	}
 
-	// prepare composition handling with xkb
-	willis_xkb_init_compose(backend->xkb_common);
+	// prepare composition handling with xkb, now or later
+	willis_xkb_load_compose(context, backend->xkb_common);
 
 	// get the xkb device id
 	backend->xkb_device_id =
@@ -115,9 +170,8 @@ void willis_x11_start(
 
 	if (backend->xkb_device_id == -1)
 	{
-		xkb_compose_state_unref(backend->xkb_common->compose_state); // ok to unref if NULL
-		xkb_compose_table_unref(backend->xkb_common->compose_table); // ok to unref if NULL
-		xkb_context_unref(backend->xkb_common->context);
+		willis_xkb_clean(backend->xkb_common);
+		x11_thread_disconnect(backend);
 		willis_error_throw(context, error, WILLIS_ERROR_X11_XKB_DEVICE_GET);
 		return;
 	}
@@ -127,9 +181,8 @@ void willis_x11_start(
 
 	if (willis_error_get_code(error) != WILLIS_ERROR_OK)
 	{
-		xkb_compose_state_unref(backend->xkb_common->compose_state);
-		xkb_compose_table_unref(backend->xkb_common->compose_table);
-		xkb_context_unref(backend->xkb_common->context);
+		willis_xkb_clean(backend->xkb_common);
+		x11_thread_disconnect(backend);
 		return;
 	}
 
@@ -138,18 +191,168 @@ void willis_x11_start(
 
 	if (willis_error_get_code(error) != WILLIS_ERROR_OK)
 	{
-		xkb_state_unref(backend->xkb_common->state);
-		xkb_keymap_unref(backend->xkb_common->keymap);
-		xkb_compose_state_unref(backend->xkb_common->compose_state);
-		xkb_compose_table_unref(backend->xkb_common->compose_table);
-		xkb_context_unref(backend->xkb_common->context);
+		willis_xkb_clean(backend->xkb_common);
+		x11_thread_disconnect(backend);
 		return;
 	}
 
+	// list the xinput2 slave devices
+	if (window_data->input_devices == true)
+	{
+		x11_helpers_devices_init(context, error);
+
+		if (willis_error_get_code(error) != WILLIS_ERROR_OK)
+		{
+			willis_xkb_clean(backend->xkb_common);
+			x11_thread_disconnect(backend);
+			return;
+		}
+	}
+
+	// get what grabbing the mouse needs from the server once and for all
+	x11_helpers_grab_cache(context);
+	backend->grab_requests_count = 0;
+
+	// select input events on the thread connection and start reading them
+	if (backend->conn_thread != NULL)
+	{
+		x11_thread_start(context, window_data, error);
+
+		if (willis_error_get_code(error) != WILLIS_ERROR_OK)
+		{
+			x11_helpers_devices_clean(backend);
+			willis_xkb_clean(backend->xkb_common);
+			x11_thread_disconnect(backend);
+			return;
+		}
+	}
+
 	willis_error_ok(error);
 }
 
-void willis_x11_handle_event(
+static inline void x11_translate_key_utf8(
+	struct willis* context,
+	struct willis_xkb* xkb_common,
+	xkb_keycode_t keycode,
+	struct willis_event_info* event_info,
+	struct willis_error_info* error)
+{
+	struct x11_backend* backend = context->backend_data;
+
+	// apply the pending keymap changes
+	if ((xkb_common == backend->xkb_common) && (backend->keymap_dirty == true))
+	{
+		x11_helpers_update_keymap(context, error);
+
+		if (willis_error_get_code(error) != WILLIS_ERROR_OK)
+		{
+			return;
+		}
+	}
+
+	willis_xkb_utf8(
+		context,
+		xkb_common,
+		keycode,
+		event_info,
+		error);
+
+	// error always set
+}
+
+// keyboards with their own layout use their own xkb state
+static inline struct willis_xkb* x11_device_xkb(
+	struct willis* context,
+	uint16_t id)
+{
+	struct x11_backend* backend = context->backend_data;
+	struct x11_device* device = x11_helpers_device_get(backend, id);
+
+	if (device == NULL)
+	{
+		return backend->xkb_common;
+	}
+
+	// apply the pending keymap changes of the device
+	if (device->keymap_dirty == true)
+	{
+		x11_helpers_update_device_keymap(context, device);
+	}
+
+	if (device->xkb_own == true)
+	{
+		return &(device->xkb);
+	}
+
+	return backend->xkb_common;
+}
+
+// the core xkb state is updated by the server through xkb events
+static inline void x11_device_key(
+	struct x11_backend* backend,
+	struct willis_xkb* xkb,
+	xkb_keycode_t keycode,
+	enum xkb_key_direction direction)
+{
+	if (xkb != backend->xkb_common)
+	{
+		xkb_state_update_key(xkb->state, keycode, direction);
+	}
+}
+
+// raw key and button events replace the core and device ones while grabbed,
+// but only once the grab is confirmed or they arrive, so none is lost if it fails
+static inline bool x11_raw_duplicate(
+	struct x11_backend* backend)
+{
+	return (backend->raw_input_grab == true)
+		&& (__atomic_load_n(&(backend->mouse_grabbed), __ATOMIC_ACQUIRE) == true)
+		&& (__atomic_load_n(&(backend->grab_pending), __ATOMIC_ACQUIRE) == false);
+}
+
+// raw events are only sent once the grab requests were processed
+static inline void x11_raw_arrived(
+	struct x11_backend* backend)
+{
+	__atomic_store_n(&(backend->grab_pending), false, __ATOMIC_RELEASE);
+}
+
+// returns the index of the window, or SIZE_MAX if it is not attached,
+// the input thread looks windows up while the application attaches them
+static inline size_t x11_window_find(
+	struct x11_backend* backend,
+	xcb_window_t window)
+{
+	size_t count = __atomic_load_n(&(backend->windows_count), __ATOMIC_ACQUIRE);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (__atomic_load_n(&(backend->windows[i]), __ATOMIC_RELAXED) == window)
+		{
+			return i;
+		}
+	}
+
+	return SIZE_MAX;
+}
+
+// the input thread translates events while the application grabs the mouse
+static inline void x11_pointer_window(
+	struct x11_backend* backend,
+	xcb_window_t window)
+{
+	__atomic_store_n(&(backend->window_pointer), window, __ATOMIC_RELAXED);
+}
+
+// raw events are sent to the root window, they belong to the grabbed one
+static inline xcb_window_t x11_grab_window(
+	struct x11_backend* backend)
+{
+	return __atomic_load_n(&(backend->window), __ATOMIC_RELAXED);
+}
+
+// shared by the single and batched entry points so it gets inlined in both
+static inline void x11_translate_event(
 	struct willis* context,
 	void* event,
 	struct willis_event_info* event_info,
@@ -168,10 +371,18 @@ void willis_x11_handle_event(
 	event_info->event_state = event_state;
 	event_info->utf8_string = NULL;
 	event_info->utf8_size = 0;
+	event_info->utf8_buffer[0] = '\0';
+	event_info->utf8_overflow = false;
+	event_info->mouse_wheel_steps = 0;
 	event_info->mouse_x = 0;
 	event_info->mouse_y = 0;
 	event_info->diff_x = 0;
 	event_info->diff_y = 0;
+	event_info->mouse_raw = false;
+	event_info->time_native_ns = 0;
+	event_info->seat = 0;
+	event_info->device = 0;
+	event_info->window = 0;
 
 	// handle event
 	xcb_generic_event_t* xcb_event = event;
@@ -181,54 +392,60 @@ void willis_x11_handle_event(
 	{
 		case XCB_KEY_PRESS:
 		{
+			if (x11_raw_duplicate(backend) == true)
+			{
+				break;
+			}
+
 			xcb_key_press_event_t* key_press =
 				(xcb_key_press_event_t*) event;
 
 			event_code = willis_xkb_translate_keycode(key_press->detail);
 			event_state = WILLIS_STATE_PRESS;
+			event_info->time_native_ns = WILLIS_TIME_MS_TO_NS(key_press->time);
+			event_info->window = key_press->event;
 
-			// use compose functions if available
-			if (xkb_common->compose_state != NULL)
-			{
-				willis_xkb_utf8_compose(
-					context,
-					xkb_common,
-					(xkb_keycode_t) key_press->detail,
-					&(event_info->utf8_string),
-					&(event_info->utf8_size),
-					error);
-			}
-			// use simple keycode translation otherwise
-			else
-			{
-				willis_xkb_utf8_simple(
-					context,
-					xkb_common,
-					(xkb_keycode_t) key_press->detail,
-					&(event_info->utf8_string),
-					&(event_info->utf8_size),
-					error);
-			}
+			x11_translate_key_utf8(
+				context,
+				xkb_common,
+				(xkb_keycode_t) key_press->detail,
+				event_info,
+				error);
 
 			break;
 		}
 		case XCB_KEY_RELEASE:
 		{
+			if (x11_raw_duplicate(backend) == true)
+			{
+				break;
+			}
+
 			xcb_key_release_event_t* key_release =
 				(xcb_key_release_event_t*) event;
 
 			event_code = willis_xkb_translate_keycode(key_release->detail);
 			event_state = WILLIS_STATE_RELEASE;
+			event_info->time_native_ns = WILLIS_TIME_MS_TO_NS(key_release->time);
+			event_info->window = key_release->event;
 
 			break;
 		}
 		case XCB_BUTTON_PRESS:
 		{
+			if (x11_raw_duplicate(backend) == true)
+			{
+				break;
+			}
+
 			xcb_button_press_event_t* button_press =
 				(xcb_button_press_event_t*) event;
 
 			event_code = x11_helpers_translate_button(button_press->detail);
 			event_state = WILLIS_STATE_PRESS;
+			event_info->time_native_ns = WILLIS_TIME_MS_TO_NS(button_press->time);
+			event_info->window = button_press->event;
+			x11_pointer_window(backend, button_press->event);
 
 			switch (event_code)
 			{
@@ -248,11 +465,19 @@ void willis_x11_handle_event(
 		}
 		case XCB_BUTTON_RELEASE:
 		{
+			if (x11_raw_duplicate(backend) == true)
+			{
+				break;
+			}
+
 			xcb_button_release_event_t* button_release =
 				(xcb_button_release_event_t*) event;
 
 			event_code = x11_helpers_translate_button(button_release->detail);
 			event_state = WILLIS_STATE_RELEASE;
+			event_info->time_native_ns = WILLIS_TIME_MS_TO_NS(button_release->time);
+			event_info->window = button_release->event;
+			x11_pointer_window(backend, button_release->event);
 
 			switch (event_code)
 			{
@@ -277,6 +502,9 @@ void willis_x11_handle_event(
 
 			event_code = WILLIS_MOUSE_MOTION;
 			event_state = WILLIS_STATE_NONE;
+			event_info->time_native_ns = WILLIS_TIME_MS_TO_NS(motion->time);
+			event_info->window = motion->event;
+			x11_pointer_window(backend, motion->event);
 
 			event_info->mouse_x = motion->event_x;
 			event_info->mouse_y = motion->event_y;
@@ -288,36 +516,245 @@ void willis_x11_handle_event(
 			xcb_ge_generic_event_t* generic =
 				(xcb_ge_generic_event_t*) event;
 
-			if (generic->event_type != XCB_INPUT_RAW_MOTION)
+			switch (generic->event_type)
 			{
-				break;
-			}
+				case XCB_INPUT_RAW_MOTION:
+				{
+					xcb_input_raw_motion_event_t* raw
+						= (xcb_input_raw_motion_event_t*) event;
+
+					int len =
+						xcb_input_raw_button_press_axisvalues_raw_length(raw);
+
+					xcb_input_fp3232_t* axis =
+						xcb_input_raw_button_press_axisvalues_raw(raw);
+
+					int valuators_len =
+						xcb_input_raw_button_press_valuator_mask_length(raw);
+
+					uint32_t* valuators =
+						xcb_input_raw_button_press_valuator_mask(raw);
+
+					// values are only sent for the valuators set in the mask,
+					// the first two valuators being the x and y axes
+					uint32_t valuators_axes = 0;
+					int index = 0;
+					xcb_input_fp3232_t value;
+
+					if (valuators_len > 0)
+					{
+						valuators_axes = valuators[0];
+					}
+
+					if (((valuators_axes & 1) != 0) && (index < len))
+					{
+						value = axis[index];
+						event_info->diff_x = (((int64_t) value.integral) << 32) | value.frac;
+						++index;
+					}
+
+					if (((valuators_axes & 2) != 0) && (index < len))
+					{
+						value = axis[index];
+						event_info->diff_y = (((int64_t) value.integral) << 32) | value.frac;
+					}
+
+					event_code = WILLIS_MOUSE_MOTION;
+					event_state = WILLIS_STATE_NONE;
+					event_info->mouse_raw = true;
+					event_info->time_native_ns = WILLIS_TIME_MS_TO_NS(raw->time);
+					event_info->device = raw->sourceid;
+					event_info->window = x11_grab_window(backend);
 
-			xcb_input_raw_motion_event_t* raw
-				= (xcb_input_raw_motion_event_t*) event;
+					break;
+				}
+				// xinput2 raw events, selected while grabbed with raw input
+				case XCB_INPUT_RAW_KEY_PRESS:
+				{
+					xcb_input_raw_key_press_event_t* raw =
+						(xcb_input_raw_key_press_event_t*) event;
 
-			int len =
-				xcb_input_raw_button_press_axisvalues_length(raw);
+					x11_raw_arrived(backend);
 
-			xcb_input_fp3232_t* axis =
-				xcb_input_raw_button_press_axisvalues_raw(raw);
+					struct willis_xkb* xkb = x11_device_xkb(context, raw->sourceid);
 
-			xcb_input_fp3232_t value;
+					event_code = willis_xkb_translate_keycode(raw->detail);
+					event_state = WILLIS_STATE_PRESS;
+					event_info->time_native_ns = WILLIS_TIME_MS_TO_NS(raw->time);
+					event_info->device = raw->sourceid;
+					event_info->window = x11_grab_window(backend);
 
-			if (len > 0)
-			{
-				value = axis[0];
-				event_info->diff_x = (((int64_t) value.integral) << 32) | value.frac;
-			}
+					x11_translate_key_utf8(
+						context,
+						xkb,
+						(xkb_keycode_t) raw->detail,
+						event_info,
+						error);
 
-			if (len > 1)
-			{
-				value = axis[1];
-				event_info->diff_y = (((int64_t) value.integral) << 32) | value.frac;
-			}
+					x11_device_key(backend, xkb, raw->detail, XKB_KEY_DOWN);
 
-			event_code = WILLIS_MOUSE_MOTION;
-			event_state = WILLIS_STATE_NONE;
+					break;
+				}
+				case XCB_INPUT_RAW_KEY_RELEASE:
+				{
+					xcb_input_raw_key_release_event_t* raw =
+						(xcb_input_raw_key_release_event_t*) event;
+
+					x11_raw_arrived(backend);
+
+					struct willis_xkb* xkb = x11_device_xkb(context, raw->sourceid);
+
+					event_code = willis_xkb_translate_keycode(raw->detail);
+					event_state = WILLIS_STATE_RELEASE;
+					event_info->time_native_ns = WILLIS_TIME_MS_TO_NS(raw->time);
+					event_info->device = raw->sourceid;
+					event_info->window = x11_grab_window(backend);
+
+					x11_device_key(backend, xkb, raw->detail, XKB_KEY_UP);
+
+					break;
+				}
+				case XCB_INPUT_RAW_BUTTON_PRESS:
+				case XCB_INPUT_RAW_BUTTON_RELEASE:
+				{
+					xcb_input_raw_button_press_event_t* raw =
+						(xcb_input_raw_button_press_event_t*) event;
+
+					x11_raw_arrived(backend);
+
+					event_code = x11_helpers_translate_button(raw->detail);
+					event_info->time_native_ns = WILLIS_TIME_MS_TO_NS(raw->time);
+					event_info->device = raw->sourceid;
+					event_info->window = x11_grab_window(backend);
+
+					if (generic->event_type == XCB_INPUT_RAW_BUTTON_PRESS)
+					{
+						event_state = WILLIS_STATE_PRESS;
+					}
+					else
+					{
+						event_state = WILLIS_STATE_RELEASE;
+					}
+
+					if ((event_code == WILLIS_MOUSE_WHEEL_UP)
+					|| (event_code == WILLIS_MOUSE_WHEEL_DOWN))
+					{
+						event_info->mouse_wheel_steps = 1;
+					}
+
+					break;
+				}
+				// xinput2 device events, selected by the input thread
+				case XCB_INPUT_KEY_PRESS:
+				{
+					if (x11_raw_duplicate(backend) == true)
+					{
+						break;
+					}
+
+					xcb_input_key_press_event_t* key_press =
+						(xcb_input_key_press_event_t*) event;
+
+					struct willis_xkb* xkb =
+						x11_device_xkb(context, key_press->sourceid);
+
+					event_code = willis_xkb_translate_keycode(key_press->detail);
+					event_state = WILLIS_STATE_PRESS;
+					event_info->time_native_ns = WILLIS_TIME_MS_TO_NS(key_press->time);
+					event_info->device = key_press->sourceid;
+					event_info->window = key_press->event;
+
+					x11_translate_key_utf8(
+						context,
+						xkb,
+						(xkb_keycode_t) key_press->detail,
+						event_info,
+						error);
+
+					x11_device_key(backend, xkb, key_press->detail, XKB_KEY_DOWN);
+
+					break;
+				}
+				case XCB_INPUT_KEY_RELEASE:
+				{
+					if (x11_raw_duplicate(backend) == true)
+					{
+						break;
+					}
+
+					xcb_input_key_release_event_t* key_release =
+						(xcb_input_key_release_event_t*) event;
+
+					struct willis_xkb* xkb =
+						x11_device_xkb(context, key_release->sourceid);
+
+					event_code = willis_xkb_translate_keycode(key_release->detail);
+					event_state = WILLIS_STATE_RELEASE;
+					event_info->time_native_ns = WILLIS_TIME_MS_TO_NS(key_release->time);
+					event_info->device = key_release->sourceid;
+					event_info->window = key_release->event;
+
+					x11_device_key(backend, xkb, key_release->detail, XKB_KEY_UP);
+
+					break;
+				}
+				case XCB_INPUT_BUTTON_PRESS:
+				case XCB_INPUT_BUTTON_RELEASE:
+				{
+					if (x11_raw_duplicate(backend) == true)
+					{
+						break;
+					}
+
+					xcb_input_button_press_event_t* button =
+						(xcb_input_button_press_event_t*) event;
+
+					event_code = x11_helpers_translate_button(button->detail);
+					event_info->time_native_ns = WILLIS_TIME_MS_TO_NS(button->time);
+					event_info->device = button->sourceid;
+					event_info->window = button->event;
+					x11_pointer_window(backend, button->event);
+
+					if (generic->event_type == XCB_INPUT_BUTTON_PRESS)
+					{
+						event_state = WILLIS_STATE_PRESS;
+					}
+					else
+					{
+						event_state = WILLIS_STATE_RELEASE;
+					}
+
+					if ((event_code == WILLIS_MOUSE_WHEEL_UP)
+					|| (event_code == WILLIS_MOUSE_WHEEL_DOWN))
+					{
+						event_info->mouse_wheel_steps = 1;
+					}
+
+					break;
+				}
+				case XCB_INPUT_MOTION:
+				{
+					xcb_input_motion_event_t* motion =
+						(xcb_input_motion_event_t*) event;
+
+					event_code = WILLIS_MOUSE_MOTION;
+					event_state = WILLIS_STATE_NONE;
+					event_info->time_native_ns = WILLIS_TIME_MS_TO_NS(motion->time);
+					event_info->device = motion->sourceid;
+					event_info->window = motion->event;
+					x11_pointer_window(backend, motion->event);
+
+					// 16.16 fixed-point coordinates
+					event_info->mouse_x = motion->event_x >> 16;
+					event_info->mouse_y = motion->event_y >> 16;
+
+					break;
+				}
+				default:
+				{
+					break;
+				}
+			}
 
 			break;
 		}
@@ -335,12 +772,298 @@ void willis_x11_handle_event(
 		}
 	}
 
+	// once windows are attached, the events of the other ones are dropped,
+	// raw events use the grabbed window and xkb events have none
+	if ((event_info->window != XCB_WINDOW_NONE)
+	&& (__atomic_load_n(&(backend->windows_filter), __ATOMIC_ACQUIRE) == true)
+	&& (x11_window_find(backend, event_info->window) == SIZE_MAX))
+	{
+		free(event_info->utf8_string);
+		event_info->utf8_string = NULL;
+		event_info->utf8_size = 0;
+		event_info->utf8_buffer[0] = '\0';
+		event_info->utf8_overflow = false;
+		event_info->window = XCB_WINDOW_NONE;
+		event_code = WILLIS_NONE;
+		event_state = WILLIS_STATE_NONE;
+	}
+
 	event_info->event_code = event_code;
 	event_info->event_state = event_state;
 
 	// error always set
 }
 
+void willis_x11_handle_event(
+	struct willis* context,
+	void* event,
+	struct willis_event_info* event_info,
+	struct willis_error_info* error)
+{
+	x11_translate_event(context, event, event_info, error);
+
+	// error always set
+}
+
+size_t willis_x11_handle_events(
+	struct willis* context,
+	void** events,
+	size_t count,
+	struct willis_event_info* event_infos,
+	struct willis_error_info* error)
+{
+	struct willis_error_info error_event;
+	struct willis_event_info* event_info = event_infos;
+
+	willis_error_ok(error);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		x11_translate_event(context, events[i], event_info, &error_event);
+
+		// report the first error but keep translating the batch
+		if ((error_event.code != WILLIS_ERROR_OK)
+		&& (error->code == WILLIS_ERROR_OK))
+		{
+			*error = error_event;
+		}
+
+		// non-input events get overwritten by the next translation
+		if (willis_event_batched(event_info) == true)
+		{
+			++event_info;
+		}
+		else
+		{
+			free(event_info->utf8_string); // ok to free if NULL
+		}
+	}
+
+	// error always set
+	return event_info - event_infos;
+}
+
+static void* x11_thread_loop(
+	void* data)
+{
+	struct willis* context = data;
+	struct x11_backend* backend = context->backend_data;
+	struct willis_event_info event_info;
+	struct willis_error_info error;
+	xcb_generic_event_t* event;
+	uint64_t start;
+
+	while (__atomic_load_n(&(backend->thread_running), __ATOMIC_ACQUIRE) == true)
+	{
+		// blocks until the server sends something or the socket is shut down
+		event = xcb_wait_for_event(backend->conn_thread);
+
+		if (event == NULL)
+		{
+			break;
+		}
+
+		start = willis_get_time_ns();
+		x11_translate_event(context, event, &event_info, &error);
+		event_info.time_ns = willis_get_time_ns();
+		free(event);
+
+		willis_stats_event(context, &event_info);
+
+		// unmapped keys can still have text
+		if (event_info.event_code == WILLIS_NONE)
+		{
+			free(event_info.utf8_string);
+			continue;
+		}
+
+		willis_keys_update(context, &event_info);
+
+		if (context->latency != NULL)
+		{
+			willis_latency_record(context, &event_info, event_info.time_ns - start);
+		}
+
+		if (context->recorder != NULL)
+		{
+			willis_recorder_write(context, &event_info);
+		}
+
+		// the queue takes ownership of the heap string of accepted events
+		if (willis_queue_push(context->queue, &event_info) == false)
+		{
+			free(event_info.utf8_string);
+		}
+	}
+
+	return NULL;
+}
+
+static void x11_thread_disconnect(
+	struct x11_backend* backend)
+{
+	if (backend->conn_thread == NULL)
+	{
+		return;
+	}
+
+	xcb_disconnect(backend->conn_thread);
+	backend->conn_thread = NULL;
+	backend->conn = backend->conn_app;
+}
+
+static void x11_thread_start(
+	struct willis* context,
+	struct willis_x11_data* window_data,
+	struct willis_error_info* error)
+{
+	struct x11_backend* backend = context->backend_data;
+	pthread_attr_t attr;
+	int error_posix;
+
+	if ((window_data->input_thread_affinity == true)
+	&& ((window_data->input_thread_cpu < 0)
+		|| (window_data->input_thread_cpu >= CPU_SETSIZE)))
+	{
+		willis_error_throw(context, error, WILLIS_ERROR_DOMAIN);
+		return;
+	}
+
+	x11_helpers_select_events_thread(context, error);
+
+	if (willis_error_get_code(error) != WILLIS_ERROR_OK)
+	{
+		return;
+	}
+
+	xcb_flush(backend->conn_thread);
+
+	error_posix = pthread_attr_init(&attr);
+
+	if (error_posix != 0)
+	{
+		willis_error_throw(context, error, WILLIS_ERROR_X11_THREAD_START);
+		return;
+	}
+
+	if (window_data->input_thread_affinity == true)
+	{
+		cpu_set_t cpus;
+
+		CPU_ZERO(&cpus);
+		CPU_SET(window_data->input_thread_cpu, &cpus);
+		pthread_attr_setaffinity_np(&attr, sizeof (cpu_set_t), &cpus);
+	}
+
+	if (window_data->input_thread_priority > 0)
+	{
+		struct sched_param param =
+		{
+			.sched_priority = window_data->input_thread_priority,
+		};
+
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		pthread_attr_setschedparam(&attr, &param);
+	}
+
+	__atomic_store_n(&(backend->thread_running), true, __ATOMIC_RELEASE);
+
+	error_posix =
+		pthread_create(
+			&(backend->thread),
+			&attr,
+			x11_thread_loop,
+			context);
+
+	// realtime scheduling needs privileges, run with the default policy instead
+	if ((error_posix == EPERM) && (window_data->input_thread_priority > 0))
+	{
+		pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+
+		error_posix =
+			pthread_create(
+				&(backend->thread),
+				&attr,
+				x11_thread_loop,
+				context);
+	}
+
+	pthread_attr_destroy(&attr);
+
+	if (error_posix != 0)
+	{
+		__atomic_store_n(&(backend->thread_running), false, __ATOMIC_RELEASE);
+		willis_error_throw(context, error, WILLIS_ERROR_X11_THREAD_START);
+		return;
+	}
+
+	willis_error_ok(error);
+}
+
+static void x11_thread_stop(
+	struct x11_backend* backend)
+{
+	if (__atomic_load_n(&(backend->thread_running), __ATOMIC_ACQUIRE) == false)
+	{
+		return;
+	}
+
+	__atomic_store_n(&(backend->thread_running), false, __ATOMIC_RELEASE);
+
+	// makes the blocking xcb_wait_for_event call return NULL
+	shutdown(xcb_get_file_descriptor(backend->conn_thread), SHUT_RDWR);
+	pthread_join(backend->thread, NULL);
+}
+
+// forgets the requests of a grab or ungrab that was not polled to the end
+static void x11_grab_discard(
+	struct x11_backend* backend)
+{
+	for (size_t i = 0; i < backend->grab_requests_count; ++i)
+	{
+		xcb_discard_reply(
+			backend->conn,
+			backend->grab_requests[i].sequence);
+	}
+
+	backend->grab_requests_count = 0;
+}
+
+static void x11_grab_request(
+	struct x11_backend* backend,
+	unsigned int sequence,
+	enum willis_error error)
+{
+	struct x11_grab_request* request =
+		&(backend->grab_requests[backend->grab_requests_count]);
+
+	request->sequence = sequence;
+	request->error = error;
+	++(backend->grab_requests_count);
+}
+
+// the mouse is grabbed in the window it was last seen in when it is attached,
+// and in the first one otherwise
+static xcb_window_t x11_window_active(
+	struct x11_backend* backend)
+{
+	xcb_window_t window =
+		__atomic_load_n(&(backend->window_pointer), __ATOMIC_RELAXED);
+
+	if (x11_window_find(backend, window) != SIZE_MAX)
+	{
+		return window;
+	}
+
+	if (backend->windows_count > 0)
+	{
+		return backend->windows[0];
+	}
+
+	return XCB_WINDOW_NONE;
+}
+
 bool willis_x11_mouse_grab(
 	struct willis* context,
 	struct willis_error_info* error)
@@ -348,53 +1071,73 @@ bool willis_x11_mouse_grab(
 	struct x11_backend* backend = context->backend_data;
 
 	// abort if already grabbed
-	if (backend->mouse_grabbed == true)
+	if (__atomic_load_n(&(backend->mouse_grabbed), __ATOMIC_RELAXED) == true)
 	{
 		willis_error_ok(error);
 		return false;
 	}
 
 	// check xfixes supports what we are about to attempt
-	xcb_generic_error_t* error_xcb = NULL;
+	if (backend->xfixes_ok == false)
+	{
+		willis_error_throw(context, error, WILLIS_ERROR_X11_XFIXES_VERSION);
+		return false;
+	}
 
-	xcb_xfixes_query_version_cookie_t xfixes_version_cookie =
-		xcb_xfixes_query_version(
-			backend->conn,
-			4,
-			0);
-	
-	xcb_xfixes_query_version_reply_t* xfixes_version_reply =
-		xcb_xfixes_query_version_reply(
-			backend->conn,
-			xfixes_version_cookie,
-			&error_xcb);
+	if ((backend->devices_count == 0) && (backend->client_pointer_ok == false))
+	{
+		willis_error_throw(context, error, WILLIS_ERROR_X11_XINPUT_GET_POINTER);
+		return false;
+	}
 
-	if (error_xcb != NULL)
+	xcb_window_t window = x11_window_active(backend);
+
+	if (window == XCB_WINDOW_NONE)
 	{
-		willis_error_throw(context, error, WILLIS_ERROR_X11_XFIXES_VERSION);
+		willis_error_throw(context, error, WILLIS_ERROR_WINDOW_UNKNOWN);
 		return false;
 	}
 
-	free(xfixes_version_reply);
+	// read by the input thread to attribute raw events
+	__atomic_store_n(&(backend->window), window, __ATOMIC_RELAXED);
+
+	x11_grab_discard(backend);
+
+	// all the requests are sent at once and checked by willis_mouse_grab_poll
+	xcb_void_cookie_t cookie;
 
 	// hide the cursor just in case
-	xcb_void_cookie_t xfixes_hide_cookie =
-		xcb_xfixes_hide_cursor(
+	cookie =
+		xcb_xfixes_hide_cursor_checked(
 			backend->conn,
 			backend->window);
 
-	error_xcb =
-		xcb_request_check(
-			backend->conn,
-			xfixes_hide_cookie);
+	x11_grab_request(backend, cookie.sequence, WILLIS_ERROR_X11_XFIXES_HIDE);
 
-	if (error_xcb != NULL)
+	// select events
+	uint32_t mask = XCB_INPUT_XI_EVENT_MASK_RAW_MOTION;
+	uint32_t mask_keyboard = 0;
+
+	if (backend->raw_input_grab == true)
 	{
-		willis_error_throw(context, error, WILLIS_ERROR_X11_XFIXES_HIDE);
-		return false;
+		mask |=
+			XCB_INPUT_XI_EVENT_MASK_RAW_BUTTON_PRESS
+			| XCB_INPUT_XI_EVENT_MASK_RAW_BUTTON_RELEASE;
+
+		mask_keyboard =
+			XCB_INPUT_XI_EVENT_MASK_RAW_KEY_PRESS
+			| XCB_INPUT_XI_EVENT_MASK_RAW_KEY_RELEASE;
 	}
 
-	// grab the pointer
+	cookie =
+		x11_helpers_select_events_cursor(
+			context,
+			mask,
+			mask_keyboard);
+
+	x11_grab_request(backend, cookie.sequence, WILLIS_ERROR_X11_XINPUT_SELECT_EVENTS);
+
+	// grab the pointer last, its reply completes the whole grab
 	xcb_grab_pointer_cookie_t pointer_cookie =
 		xcb_grab_pointer(
 			backend->conn,
@@ -407,30 +1150,16 @@ bool willis_x11_mouse_grab(
 			XCB_CURSOR_NONE, // TODO use invisible cursor
 			XCB_CURRENT_TIME);
 
-	xcb_grab_pointer_reply_t* pointer_reply =
-		xcb_grab_pointer_reply(
-			backend->conn,
-			pointer_cookie,
-			&error_xcb);
+	x11_grab_request(backend, pointer_cookie.sequence, WILLIS_ERROR_X11_GRAB);
 
-	if (error_xcb != NULL)
-	{
-		willis_error_throw(context, error, WILLIS_ERROR_X11_GRAB);
-		return false;
-	}
-
-	// select events
-	x11_helpers_select_events_cursor(
-		context,
-		XCB_INPUT_XI_EVENT_MASK_RAW_MOTION,
-		error);
+	xcb_flush(backend->conn);
 
-	if (willis_error_get_code(error) != WILLIS_ERROR_OK)
-	{
-		return false;
-	}
+	backend->grab_requests_grab = true;
+	__atomic_store_n(&(backend->grab_pending), true, __ATOMIC_RELEASE);
+	__atomic_store_n(&(backend->mouse_grabbed), true, __ATOMIC_RELEASE);
 
 	// error always set
+	willis_error_ok(error);
 	return true;
 }
 
@@ -439,65 +1168,261 @@ bool willis_x11_mouse_ungrab(
 	struct willis_error_info* error)
 {
 	struct x11_backend* backend = context->backend_data;
-	xcb_generic_error_t* error_xcb = NULL;
 	xcb_void_cookie_t cookie;
 
 	// abort if already ungrabbed
-	if (backend->mouse_grabbed == false)
+	if (__atomic_load_n(&(backend->mouse_grabbed), __ATOMIC_RELAXED) == false)
 	{
 		willis_error_ok(error);
 		return false;
 	}
 
+	x11_grab_discard(backend);
+
 	// ungrab the pointer
 	cookie =
-		xcb_ungrab_pointer(
+		xcb_ungrab_pointer_checked(
 			backend->conn,
 			XCB_CURRENT_TIME);
 
-	error_xcb =
-		xcb_request_check(
-			backend->conn,
-			cookie);
-
-	if (error_xcb != NULL)
-	{
-		willis_error_throw(context, error, WILLIS_ERROR_X11_UNGRAB);
-		return false;
-	}
+	x11_grab_request(backend, cookie.sequence, WILLIS_ERROR_X11_UNGRAB);
 
 	// show the cursor back
 	cookie =
-		xcb_xfixes_show_cursor(
+		xcb_xfixes_show_cursor_checked(
 			backend->conn,
 			backend->window);
 
-	error_xcb =
-		xcb_request_check(
+	x11_grab_request(backend, cookie.sequence, WILLIS_ERROR_X11_XFIXES_SHOW);
+
+	// select events
+	cookie =
+		x11_helpers_select_events_cursor(
+			context,
+			0,
+			0);
+
+	x11_grab_request(backend, cookie.sequence, WILLIS_ERROR_X11_XINPUT_SELECT_EVENTS);
+
+	// none of the above has a reply so end with a cheap request that does
+	xcb_get_input_focus_cookie_t focus_cookie =
+		xcb_get_input_focus(
+			backend->conn);
+
+	x11_grab_request(backend, focus_cookie.sequence, WILLIS_ERROR_X11_UNGRAB);
+
+	xcb_flush(backend->conn);
+
+	backend->grab_requests_grab = false;
+	__atomic_store_n(&(backend->grab_pending), false, __ATOMIC_RELEASE);
+	__atomic_store_n(&(backend->mouse_grabbed), false, __ATOMIC_RELEASE);
+
+	// error always set
+	willis_error_ok(error);
+	return true;
+}
+
+bool willis_x11_mouse_grab_poll(
+	struct willis* context,
+	struct willis_error_info* error)
+{
+	struct x11_backend* backend = context->backend_data;
+	size_t count = backend->grab_requests_count;
+
+	// nothing to wait for
+	if (count == 0)
+	{
+		willis_error_ok(error);
+		return true;
+	}
+
+	struct x11_grab_request* last = &(backend->grab_requests[count - 1]);
+	xcb_generic_error_t* error_xcb = NULL;
+	void* reply = NULL;
+
+	int done =
+		xcb_poll_for_reply(
 			backend->conn,
-			cookie);
+			last->sequence,
+			&reply,
+			&error_xcb);
 
-	if (error_xcb != NULL)
+	if (done == 0)
 	{
-		willis_error_throw(context, error, WILLIS_ERROR_X11_XFIXES_SHOW);
+		willis_error_ok(error);
 		return false;
 	}
 
-	// select events
-	x11_helpers_select_events_cursor(
-		context,
-		0,
-		error);
+	enum willis_error code_last = WILLIS_ERROR_OK;
 
-	if (willis_error_get_code(error) != WILLIS_ERROR_OK)
+	if (error_xcb != NULL)
 	{
-		return false;
+		code_last = last->error;
 	}
+	else if ((backend->grab_requests_grab == true) && (reply != NULL))
+	{
+		xcb_grab_pointer_reply_t* pointer_reply = reply;
 
-	// error always set
+		if (pointer_reply->status != XCB_GRAB_STATUS_SUCCESS)
+		{
+			code_last = last->error;
+		}
+	}
+
+	free(error_xcb);
+	free(reply);
+
+	// the previous requests were processed first, report the earliest error
+	enum willis_error code = WILLIS_ERROR_OK;
+
+	for (size_t i = 0; i < (count - 1); ++i)
+	{
+		error_xcb = NULL;
+		reply = NULL;
+
+		xcb_poll_for_reply(
+			backend->conn,
+			backend->grab_requests[i].sequence,
+			&reply,
+			&error_xcb);
+
+		if ((error_xcb != NULL) && (code == WILLIS_ERROR_OK))
+		{
+			code = backend->grab_requests[i].error;
+		}
+
+		free(error_xcb);
+		free(reply);
+	}
+
+	if (code == WILLIS_ERROR_OK)
+	{
+		code = code_last;
+	}
+
+	backend->grab_requests_count = 0;
+
+	// the core events are dropped from now on if the grab succeeded
+	__atomic_store_n(&(backend->grab_pending), false, __ATOMIC_RELEASE);
+
+	// go back to the previous state so the operation can be retried
+	if (code != WILLIS_ERROR_OK)
+	{
+		__atomic_store_n(
+			&(backend->mouse_grabbed),
+			!(backend->grab_requests_grab),
+			__ATOMIC_RELEASE);
+		willis_error_throw(context, error, code);
+		return true;
+	}
+
+	willis_error_ok(error);
 	return true;
 }
 
+void willis_x11_window_attach(
+	struct willis* context,
+	uintptr_t window,
+	struct willis_error_info* error)
+{
+	struct x11_backend* backend = context->backend_data;
+	xcb_window_t id = (xcb_window_t) window;
+
+	if (id == XCB_WINDOW_NONE)
+	{
+		willis_error_throw(context, error, WILLIS_ERROR_NULL);
+		return;
+	}
+
+	// attaching a window twice does nothing
+	if (x11_window_find(backend, id) != SIZE_MAX)
+	{
+		willis_error_ok(error);
+		return;
+	}
+
+	if (backend->windows_count >= X11_WINDOWS_MAX)
+	{
+		willis_error_throw(context, error, WILLIS_ERROR_WINDOW_LIMIT);
+		return;
+	}
+
+	// the xkb state and keymaps of the context already apply to all windows,
+	// only the input thread connection must be told about the new one
+	if (backend->conn_thread != NULL)
+	{
+		xcb_void_cookie_t cookie =
+			x11_helpers_select_events_window(
+				context,
+				id,
+				true);
+
+		xcb_generic_error_t* error_xcb =
+			xcb_request_check(
+				backend->conn,
+				cookie);
+
+		if (error_xcb != NULL)
+		{
+			free(error_xcb);
+			willis_error_throw(context, error, WILLIS_ERROR_X11_XINPUT_SELECT_EVENTS);
+			return;
+		}
+	}
+
+	// the entry is written before the input thread can see it
+	__atomic_store_n(&(backend->windows[backend->windows_count]), id, __ATOMIC_RELAXED);
+	__atomic_store_n(&(backend->windows_count), backend->windows_count + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&(backend->windows_filter), true, __ATOMIC_RELEASE);
+
+	willis_error_ok(error);
+}
+
+void willis_x11_window_detach(
+	struct willis* context,
+	uintptr_t window,
+	struct willis_error_info* error)
+{
+	struct x11_backend* backend = context->backend_data;
+	xcb_window_t id = (xcb_window_t) window;
+	size_t index = x11_window_find(backend, id);
+
+	if (index == SIZE_MAX)
+	{
+		willis_error_throw(context, error, WILLIS_ERROR_WINDOW_UNKNOWN);
+		return;
+	}
+
+	// the mouse can't stay grabbed in a window the context does not serve
+	if ((__atomic_load_n(&(backend->mouse_grabbed), __ATOMIC_RELAXED) == true)
+	&& (backend->window == id))
+	{
+		willis_x11_mouse_ungrab(context, error);
+	}
+
+	// the window may already be destroyed, so errors are not checked
+	if (backend->conn_thread != NULL)
+	{
+		xcb_void_cookie_t cookie =
+			x11_helpers_select_events_window(
+				context,
+				id,
+				false);
+
+		xcb_discard_reply(backend->conn, cookie.sequence);
+		xcb_flush(backend->conn);
+	}
+
+	// the last window takes its place before the count shrinks, so the input
+	// thread always finds the windows that stay attached
+	size_t last = backend->windows_count - 1;
+
+	__atomic_store_n(&(backend->windows[index]), backend->windows[last], __ATOMIC_RELAXED);
+	__atomic_store_n(&(backend->windows_count), last, __ATOMIC_RELEASE);
+
+	willis_error_ok(error);
+}
+
 void willis_x11_stop(
 	struct willis* context,
 	struct willis_error_info* error)
@@ -505,11 +1430,15 @@ void willis_x11_stop(
 	struct x11_backend* backend = context->backend_data;
 	struct willis_xkb* xkb_common = backend->xkb_common;
 
-	xkb_state_unref(xkb_common->state);
-	xkb_keymap_unref(xkb_common->keymap);
-	xkb_compose_table_unref(xkb_common->compose_table);
-	xkb_compose_state_unref(xkb_common->compose_state);
-	xkb_context_unref(xkb_common->context);
+	x11_grab_discard(backend);
+
+	// the thread uses the xkb state so it must be stopped first
+	x11_thread_stop(backend);
+	x11_thread_disconnect(backend);
+	x11_helpers_devices_clean(backend);
+
+	willis_xkb_clean(xkb_common);
+	__atomic_store_n(&(backend->windows_count), 0, __ATOMIC_RELEASE);
 
 	willis_error_ok(error);
 }
@@ -534,8 +1463,12 @@ void willis_prepare_init_x11(
 	config->init = willis_x11_init;
 	config->start = willis_x11_start;
 	config->handle_event = willis_x11_handle_event;
+	config->handle_events = willis_x11_handle_events;
 	config->mouse_grab = willis_x11_mouse_grab;
 	config->mouse_ungrab = willis_x11_mouse_ungrab;
+	config->mouse_grab_poll = willis_x11_mouse_grab_poll;
+	config->window_attach = willis_x11_window_attach;
+	config->window_detach = willis_x11_window_detach;
 	config->stop = willis_x11_stop;
 	config->clean = willis_x11_clean;
 }
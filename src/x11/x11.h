@@ -7,20 +7,88 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <pthread.h>
 #include <xcb/xcb.h>
 #include <xcb/xkb.h>
 
+#define X11_DEVICES_MAX 32
+#define X11_WINDOWS_MAX 32
+#define X11_GRAB_REQUESTS 4
+
+// request issued by a grab or ungrab and the error it maps to
+struct x11_grab_request
+{
+	unsigned int sequence;
+	enum willis_error error;
+};
+
+struct x11_device
+{
+	uint16_t id;
+	bool keyboard;
+	// set by the xkb events of the device, applied at its next key event
+	bool keymap_dirty;
+
+	// only used when the layout differs from the core keyboard one,
+	// the xkb state is then updated by willis from the key events
+	bool xkb_own;
+	struct willis_xkb xkb;
+};
+
 struct x11_backend
 {
 	xcb_connection_t* conn;
-	xcb_window_t window;
 	xcb_window_t root;
+
+	// windows served by the context, starting with the one given at start,
+	// they share the keyboard state, keymaps and mouse grab of the context
+	// (read by the input thread, so only updated with atomic stores)
+	xcb_window_t windows[X11_WINDOWS_MAX];
+	size_t windows_count;
+	// the events of the windows that are not served are only dropped once
+	// one was attached, until then all the forwarded events are translated
+	bool windows_filter;
+	// window of the last pointer event, the next grab happens there if attached
+	xcb_window_t window_pointer;
+	// window holding the current grab (the one given at start until then)
+	xcb_window_t window;
+
+	// read by the input thread, so only updated with atomic stores,
+	// the grab is pending until confirmed or the first raw event arrives
 	bool mouse_grabbed;
+	bool grab_pending;
+	bool raw_input_grab;
+
+	// cached at start so grabbing does not wait for the server
+	bool xfixes_ok;
+	bool client_pointer_ok;
+	uint16_t client_pointer;
+
+	// requests of the last grab or ungrab, the last one has a reply
+	// so its arrival means all the others were processed as well
+	struct x11_grab_request grab_requests[X11_GRAB_REQUESTS];
+	size_t grab_requests_count;
+	bool grab_requests_grab;
 
 	struct willis_xkb* xkb_common;
 	int32_t xkb_device_id;
 	uint8_t xkb_event;
 	xcb_xkb_select_events_details_t xkb_select_events_details;
+
+	// keymap changes are applied once, when the next key press needs them
+	bool keymap_dirty;
+	// hash of the core keymap, 0 if the server did not describe it
+	uint64_t keymap_hash;
+
+	// xinput2 slave devices, only listed with the input_devices option
+	struct x11_device devices[X11_DEVICES_MAX];
+	size_t devices_count;
+
+	// dedicated input thread, conn points to conn_thread while it is used
+	xcb_connection_t* conn_app;
+	xcb_connection_t* conn_thread;
+	pthread_t thread;
+	bool thread_running;
 };
 
 void willis_x11_init(
@@ -38,6 +106,13 @@ void willis_x11_handle_event(
 	struct willis_event_info* event_info,
 	struct willis_error_info* error);
 
+size_t willis_x11_handle_events(
+	struct willis* context,
+	void** events,
+	size_t count,
+	struct willis_event_info* event_infos,
+	struct willis_error_info* error);
+
 bool willis_x11_mouse_grab(
 	struct willis* context,
 	struct willis_error_info* error);
@@ -46,6 +121,20 @@ bool willis_x11_mouse_ungrab(
 	struct willis* context,
 	struct willis_error_info* error);
 
+bool willis_x11_mouse_grab_poll(
+	struct willis* context,
+	struct willis_error_info* error);
+
+void willis_x11_window_attach(
+	struct willis* context,
+	uintptr_t window,
+	struct willis_error_info* error);
+
+void willis_x11_window_detach(
+	struct willis* context,
+	uintptr_t window,
+	struct willis_error_info* error);
+
 void willis_x11_stop(
 	struct willis* context,
 	struct willis_error_info* error);
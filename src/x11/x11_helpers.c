@@ -3,12 +3,15 @@
 #include "x11/x11.h"
 #include "x11/x11_helpers.h"
 #include "nix/nix.h"
+#include "nix/nix_registry.h"
 
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <xcb/xcb.h>
+#include <xcb/xfixes.h>
 #include <xcb/xinput.h>
+#include <xkbcommon/xkbcommon-compose.h>
 #include <xkbcommon/xkbcommon-x11.h>
 
 // HACK
@@ -44,75 +47,246 @@ union willis_magic_xkb_event
 	xcb_xkb_map_notify_event_t map;
 };
 
+// requests identifying the keymap of a device, and its state
+struct keymap_cookies
+{
+	xcb_xkb_get_names_cookie_t names;
+	xcb_xkb_get_map_cookie_t map;
+	xcb_xkb_get_state_cookie_t state;
+};
 
-void x11_helpers_select_events_cursor(
-	struct willis* context,
-	uint32_t mask,
-	struct willis_error_info* error)
+void x11_helpers_grab_cache(
+	struct willis* context)
 {
 	struct x11_backend* backend = context->backend_data;
 	xcb_generic_error_t* error_xcb = NULL;
 
-	// get the xinput device id for the pointer
+	// both requests are sent before waiting for the first reply
+	xcb_xfixes_query_version_cookie_t cookie_xfixes =
+		xcb_xfixes_query_version(
+			backend->conn,
+			4,
+			0);
+
 	xcb_input_xi_get_client_pointer_cookie_t cookie_pointer =
 		xcb_input_xi_get_client_pointer(
 			backend->conn,
 			backend->window);
 
+	xcb_xfixes_query_version_reply_t* reply_xfixes =
+		xcb_xfixes_query_version_reply(
+			backend->conn,
+			cookie_xfixes,
+			&error_xcb);
+
+	// cursor hiding appeared in xfixes 4
+	backend->xfixes_ok =
+		(error_xcb == NULL)
+		&& (reply_xfixes != NULL)
+		&& (reply_xfixes->major_version >= 4);
+
+	free(error_xcb);
+	free(reply_xfixes);
+	error_xcb = NULL;
+
 	xcb_input_xi_get_client_pointer_reply_t* reply_pointer =
 		xcb_input_xi_get_client_pointer_reply(
 			backend->conn,
 			cookie_pointer,
 			&error_xcb);
 
-	if (error_xcb != NULL)
+	backend->client_pointer_ok =
+		(error_xcb == NULL)
+		&& (reply_pointer != NULL);
+
+	if (backend->client_pointer_ok == true)
 	{
-		willis_error_throw(context, error, WILLIS_ERROR_X11_XINPUT_GET_POINTER);
-		return;
+		backend->client_pointer = reply_pointer->deviceid;
 	}
 
-	xcb_input_device_id_t dev = reply_pointer->deviceid;
+	free(error_xcb);
 	free(reply_pointer);
 
-	// register event
-	struct willis_xinput_event_mask mask_grab =
+	WILLIS_STATS_ADD(context, x11_round_trips, 1);
+
+	// failures are reported when grabbing
+}
+
+xcb_void_cookie_t x11_helpers_select_events_cursor(
+	struct willis* context,
+	uint32_t mask,
+	uint32_t mask_keyboard)
+{
+	struct x11_backend* backend = context->backend_data;
+
+	struct willis_xinput_event_mask mask_grab[X11_DEVICES_MAX];
+	uint16_t mask_count = 0;
+
+	// select raw events on each slave device when they are listed
+	if (backend->devices_count > 0)
 	{
-		.deviceid = dev,
+		for (size_t i = 0; i < backend->devices_count; ++i)
+		{
+			struct x11_device* device = &(backend->devices[i]);
+
+			if (device->keyboard == false)
+			{
+				mask_grab[mask_count].deviceid = device->id;
+				mask_grab[mask_count].mask_len = 1;
+				mask_grab[mask_count].mask = mask;
+				++mask_count;
+			}
+			else if (backend->raw_input_grab == true)
+			{
+				mask_grab[mask_count].deviceid = device->id;
+				mask_grab[mask_count].mask_len = 1;
+				mask_grab[mask_count].mask = mask_keyboard;
+				++mask_count;
+			}
+		}
+	}
+	// use the client pointer cached at start otherwise
+	else
+	{
+		mask_grab[0].deviceid = backend->client_pointer;
+		mask_grab[0].mask_len = 1;
+		mask_grab[0].mask = mask;
+		mask_count = 1;
+
+		// raw key events come from the master keyboard, not the pointer,
+		// but a selection made by the application itself stays untouched
+		if (backend->raw_input_grab == true)
+		{
+			mask_grab[1].deviceid = XCB_INPUT_DEVICE_ALL_MASTER;
+			mask_grab[1].mask_len = 1;
+			mask_grab[1].mask = mask_keyboard;
+			mask_count = 2;
+		}
+	}
+
+	// checked later by willis_mouse_grab_poll
+	return
+		xcb_input_xi_select_events_checked(
+			backend->conn,
+			backend->root,
+			mask_count,
+			(xcb_input_event_mask_t*) mask_grab);
+}
+
+xcb_void_cookie_t x11_helpers_select_events_window(
+	struct willis* context,
+	xcb_window_t window,
+	bool select)
+{
+	struct x11_backend* backend = context->backend_data;
+
+	struct willis_xinput_event_mask mask_window =
+	{
+		.deviceid = XCB_INPUT_DEVICE_ALL_MASTER,
 		.mask_len = 1,
-		.mask = mask,
+		.mask = 0,
 	};
 
-	xcb_void_cookie_t cookie_select =
-		xcb_input_xi_select_events(
+	if (select == true)
+	{
+		mask_window.mask =
+			XCB_INPUT_XI_EVENT_MASK_KEY_PRESS
+			| XCB_INPUT_XI_EVENT_MASK_KEY_RELEASE
+			| XCB_INPUT_XI_EVENT_MASK_BUTTON_PRESS
+			| XCB_INPUT_XI_EVENT_MASK_BUTTON_RELEASE
+			| XCB_INPUT_XI_EVENT_MASK_MOTION;
+	}
+
+	// checked by the caller, or discarded if the window may be gone already
+	return
+		xcb_input_xi_select_events_checked(
 			backend->conn,
-			backend->root,
+			window,
 			1,
-			(xcb_input_event_mask_t*) &mask_grab);
+			(xcb_input_event_mask_t*) &mask_window);
+}
 
-	error_xcb =
-		xcb_request_check(
+void x11_helpers_select_events_thread(
+	struct willis* context,
+	struct willis_error_info* error)
+{
+	struct x11_backend* backend = context->backend_data;
+	xcb_generic_error_t* error_xcb = NULL;
+
+	// xinput2 events are only sent to clients announcing they support them
+	xcb_input_xi_query_version_cookie_t cookie_version =
+		xcb_input_xi_query_version(
 			backend->conn,
-			cookie_select);
+			2,
+			0);
+
+	xcb_input_xi_query_version_reply_t* reply_version =
+		xcb_input_xi_query_version_reply(
+			backend->conn,
+			cookie_version,
+			&error_xcb);
 
 	if (error_xcb != NULL)
 	{
-		willis_error_throw(context, error, WILLIS_ERROR_X11_XINPUT_SELECT_EVENTS);
+		free(error_xcb);
+		willis_error_throw(context, error, WILLIS_ERROR_X11_XINPUT_VERSION);
 		return;
 	}
 
-	// update internal grabbed info
-	if (mask == 0)
-	{
-		backend->mouse_grabbed = false;
-	}
-	else
+	free(reply_version);
+
+	// register the device events of the windows on the input thread connection
+	for (size_t i = 0; i < backend->windows_count; ++i)
 	{
-		backend->mouse_grabbed = true;
+		xcb_void_cookie_t cookie_select =
+			x11_helpers_select_events_window(
+				context,
+				backend->windows[i],
+				true);
+
+		error_xcb =
+			xcb_request_check(
+				backend->conn,
+				cookie_select);
+
+		if (error_xcb != NULL)
+		{
+			free(error_xcb);
+			willis_error_throw(context, error, WILLIS_ERROR_X11_XINPUT_SELECT_EVENTS);
+			return;
+		}
 	}
 
 	willis_error_ok(error);
 }
 
+// classic xcb function with 321948571 parameters
+static xcb_void_cookie_t keyboard_select(
+	struct x11_backend* backend,
+	uint16_t device_id,
+	uint16_t events)
+{
+	uint16_t map_parts = 
+		XCB_XKB_MAP_PART_KEY_TYPES
+		| XCB_XKB_MAP_PART_KEY_SYMS
+		| XCB_XKB_MAP_PART_MODIFIER_MAP
+		| XCB_XKB_MAP_PART_EXPLICIT_COMPONENTS
+		| XCB_XKB_MAP_PART_KEY_ACTIONS
+		| XCB_XKB_MAP_PART_VIRTUAL_MODS
+		| XCB_XKB_MAP_PART_VIRTUAL_MOD_MAP;
+
+	return
+		xcb_xkb_select_events_aux_checked(
+			backend->conn,
+			device_id,
+			events,
+			0,
+			0,
+			map_parts,
+			map_parts,
+			&(backend->xkb_select_events_details));
+}
+
 void x11_helpers_select_events_keyboard(
 	struct willis* context,
 	struct willis_error_info* error)
@@ -144,26 +318,11 @@ void x11_helpers_select_events_keyboard(
 		| XCB_XKB_EVENT_TYPE_MAP_NOTIFY
 		| XCB_XKB_EVENT_TYPE_STATE_NOTIFY;
 
-	uint16_t map_parts = 
-		XCB_XKB_MAP_PART_KEY_TYPES
-		| XCB_XKB_MAP_PART_KEY_SYMS
-		| XCB_XKB_MAP_PART_MODIFIER_MAP
-		| XCB_XKB_MAP_PART_EXPLICIT_COMPONENTS
-		| XCB_XKB_MAP_PART_KEY_ACTIONS
-		| XCB_XKB_MAP_PART_VIRTUAL_MODS
-		| XCB_XKB_MAP_PART_VIRTUAL_MOD_MAP;
-
-	// classic xcb function with 321948571 parameters
 	xcb_void_cookie_t cookie =
-		xcb_xkb_select_events_aux_checked(
-			backend->conn,
+		keyboard_select(
+			backend,
 			backend->xkb_device_id,
-			events,
-			0,
-			0,
-			map_parts,
-			map_parts,
-			&(backend->xkb_select_events_details));
+			events);
 
 	xcb_generic_error_t* error_xcb =
 		xcb_request_check(
@@ -179,43 +338,553 @@ void x11_helpers_select_events_keyboard(
 	willis_error_ok(error);
 }
 
-void x11_helpers_update_keymap(
+// the names of the keymap components and the key map identify a keymap
+// without fetching and compiling all of it
+static bool keymap_hash(
+	xcb_xkb_get_names_reply_t* reply_names,
+	xcb_xkb_get_map_reply_t* reply_map,
+	uint64_t* hash)
+{
+	xcb_xkb_get_names_value_list_t names = {0};
+
+	xcb_xkb_get_names_value_list_unpack(
+		xcb_xkb_get_names_value_list(reply_names),
+		reply_names->nTypes,
+		reply_names->indicators,
+		reply_names->virtualMods,
+		reply_names->groupNames,
+		reply_names->nKeys,
+		reply_names->nKeyAliases,
+		reply_names->nRadioGroups,
+		reply_names->which,
+		&names);
+
+	xcb_atom_t atoms[4] =
+	{
+		names.keycodesName,
+		names.symbolsName,
+		names.typesName,
+		names.compatName,
+	};
+
+	*hash = willis_xkb_hash(atoms, sizeof (atoms), WILLIS_XKB_HASH_INIT);
+
+	// the reply is contiguous, 32 bytes followed by length 4-byte units,
+	// and only its sequence number (in the first 8 bytes) changes every time
+	*hash =
+		willis_xkb_hash(
+			((const uint8_t*) reply_map) + 8,
+			32 + (4 * ((size_t) reply_map->length)) - 8,
+			*hash);
+
+	return (names.symbolsName != XCB_ATOM_NONE);
+}
+
+// sends the requests identifying the keymap of a device and giving its state
+static struct keymap_cookies keymap_request(
+	xcb_connection_t* conn,
+	xcb_xkb_device_spec_t device_id)
+{
+	struct keymap_cookies cookies;
+
+	cookies.names =
+		xcb_xkb_get_names(
+			conn,
+			device_id,
+			XCB_XKB_NAME_DETAIL_KEYCODES
+			| XCB_XKB_NAME_DETAIL_SYMBOLS
+			| XCB_XKB_NAME_DETAIL_TYPES
+			| XCB_XKB_NAME_DETAIL_COMPAT);
+
+	// the parts of the key map xkbcommon uses to translate keys
+	uint16_t map_parts =
+		XCB_XKB_MAP_PART_KEY_TYPES
+		| XCB_XKB_MAP_PART_KEY_SYMS
+		| XCB_XKB_MAP_PART_MODIFIER_MAP
+		| XCB_XKB_MAP_PART_VIRTUAL_MODS
+		| XCB_XKB_MAP_PART_VIRTUAL_MOD_MAP;
+
+	cookies.map =
+		xcb_xkb_get_map(
+			conn,
+			device_id,
+			map_parts,
+			// the whole parts are sent, so the ranges are left empty
+			0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+	cookies.state =
+		xcb_xkb_get_state(
+			conn,
+			device_id);
+
+	return cookies;
+}
+
+// returns false if the keymap can't be identified, the state reply is
+// returned whenever it arrived and must be freed
+static bool keymap_identify(
+	xcb_connection_t* conn,
+	struct keymap_cookies* cookies,
+	uint64_t* hash,
+	xcb_xkb_get_state_reply_t** reply_state)
+{
+	xcb_generic_error_t* error_xcb = NULL;
+
+	xcb_xkb_get_names_reply_t* reply_names =
+		xcb_xkb_get_names_reply(
+			conn,
+			cookies->names,
+			&error_xcb);
+
+	free(error_xcb);
+	error_xcb = NULL;
+
+	xcb_xkb_get_map_reply_t* reply_map =
+		xcb_xkb_get_map_reply(
+			conn,
+			cookies->map,
+			&error_xcb);
+
+	free(error_xcb);
+	error_xcb = NULL;
+
+	*reply_state =
+		xcb_xkb_get_state_reply(
+			conn,
+			cookies->state,
+			&error_xcb);
+
+	free(error_xcb);
+
+	bool known =
+		(reply_names != NULL)
+		&& (reply_map != NULL)
+		&& (*reply_state != NULL)
+		&& (keymap_hash(reply_names, reply_map, hash) == true);
+
+	free(reply_names);
+	free(reply_map);
+
+	return known;
+}
+
+// fetches and compiles the keymap of a device and makes it current
+static enum willis_error keymap_fetch_device(
 	struct willis* context,
-	struct willis_error_info* error)
+	struct willis_xkb* xkb_common,
+	int32_t device_id,
+	uint64_t hash)
 {
 	struct x11_backend* backend = context->backend_data;
-	struct willis_xkb* xkb_common = backend->xkb_common;
+
+	// the shared xkb context is changed by the compilation,
+	// layout changes are rare enough to hold the lock for the round trips
+	willis_xkb_registry_lock();
 
 	struct xkb_keymap* keymap =
 		xkb_x11_keymap_new_from_device(
 			xkb_common->context,
 			backend->conn,
-			backend->xkb_device_id,
+			device_id,
 			XKB_KEYMAP_COMPILE_NO_FLAGS);
 
+	willis_xkb_registry_unlock();
+
 	if (keymap == NULL)
 	{
-		willis_error_throw(context, error, WILLIS_ERROR_X11_XKB_KEYMAP_NEW);
-		return;
+		return WILLIS_ERROR_X11_XKB_KEYMAP_NEW;
 	}
 
 	struct xkb_state* state =
 		xkb_x11_state_new_from_device(
 			keymap,
 			backend->conn,
-			backend->xkb_device_id);
+			device_id);
 
 	if (state == NULL)
 	{
+		// the last reference to the keymap releases the shared context
+		willis_xkb_registry_lock();
 		xkb_keymap_unref(keymap);
-		willis_error_throw(context, error, WILLIS_ERROR_X11_XKB_STATE_NEW);
+		willis_xkb_registry_unlock();
+
+		return WILLIS_ERROR_X11_XKB_STATE_NEW;
+	}
+
+	// the state of the device is the one to keep
+	willis_xkb_update_mask(
+		xkb_common,
+		xkb_state_serialize_mods(state, XKB_STATE_MODS_DEPRESSED),
+		xkb_state_serialize_mods(state, XKB_STATE_MODS_LATCHED),
+		xkb_state_serialize_mods(state, XKB_STATE_MODS_LOCKED),
+		xkb_state_serialize_layout(state, XKB_STATE_LAYOUT_DEPRESSED),
+		xkb_state_serialize_layout(state, XKB_STATE_LAYOUT_LATCHED),
+		xkb_state_serialize_layout(state, XKB_STATE_LAYOUT_LOCKED));
+
+	willis_xkb_keymap_set(xkb_common, keymap, state, hash);
+	WILLIS_STATS_ADD(context, keymap_rebuilds, 1);
+
+	return WILLIS_ERROR_OK;
+}
+
+static void keymap_fetch(
+	struct willis* context,
+	uint64_t hash,
+	struct willis_error_info* error)
+{
+	struct x11_backend* backend = context->backend_data;
+
+	enum willis_error code =
+		keymap_fetch_device(
+			context,
+			backend->xkb_common,
+			backend->xkb_device_id,
+			hash);
+
+	if (code != WILLIS_ERROR_OK)
+	{
+		willis_error_throw(context, error, code);
+		return;
+	}
+
+	willis_error_ok(error);
+}
+
+// keyboards get their own keymap only when their layout differs,
+// the ones already compiled by a willis context of the process are reused
+static void device_keymap(
+	struct willis* context,
+	struct x11_device* device,
+	struct keymap_cookies* cookies)
+{
+	struct x11_backend* backend = context->backend_data;
+	struct willis_xkb* xkb_common = backend->xkb_common;
+	xcb_xkb_get_state_reply_t* reply_state = NULL;
+	uint64_t hash = 0;
+
+	bool known =
+		keymap_identify(
+			backend->conn,
+			cookies,
+			&hash,
+			&reply_state);
+
+	// fall back to the core keymap if the device has none
+	if ((known == false) || (hash == backend->keymap_hash))
+	{
+		free(reply_state);
+		return;
+	}
+
+	device->xkb.context = xkb_common->context;
+	device->xkb.locale = xkb_common->locale;
+	willis_xkb_share_compose(&(device->xkb), xkb_common);
+	device->xkb_own = true;
+
+	// applied to the state once there is one
+	willis_xkb_update_mask(
+		&(device->xkb),
+		reply_state->baseMods,
+		reply_state->latchedMods,
+		reply_state->lockedMods,
+		reply_state->baseGroup,
+		reply_state->latchedGroup,
+		reply_state->lockedGroup);
+
+	free(reply_state);
+
+	if (willis_xkb_cache_use(&(device->xkb), hash) == true)
+	{
+		WILLIS_STATS_ADD(context, keymap_cache_hits, 1);
+		return;
+	}
+
+	enum willis_error code =
+		keymap_fetch_device(
+			context,
+			&(device->xkb),
+			device->id,
+			hash);
+
+	if (code != WILLIS_ERROR_OK)
+	{
+		// the context and compose table belong to the core xkb struct
+		willis_xkb_clean(&(device->xkb));
+		device->xkb_own = false;
+		return;
+	}
+
+	willis_xkb_cache_add(&(device->xkb), hash);
+}
+
+void x11_helpers_devices_init(
+	struct willis* context,
+	struct willis_error_info* error)
+{
+	struct x11_backend* backend = context->backend_data;
+	xcb_generic_error_t* error_xcb = NULL;
+
+	xcb_input_xi_query_device_cookie_t cookie =
+		xcb_input_xi_query_device(
+			backend->conn,
+			XCB_INPUT_DEVICE_ALL);
+
+	xcb_input_xi_query_device_reply_t* reply =
+		xcb_input_xi_query_device_reply(
+			backend->conn,
+			cookie,
+			&error_xcb);
+
+	WILLIS_STATS_ADD(context, x11_round_trips, 1);
+
+	if (error_xcb != NULL)
+	{
+		free(error_xcb);
+		willis_error_throw(context, error, WILLIS_ERROR_X11_XINPUT_QUERY_DEVICE);
+		return;
+	}
+
+	struct keymap_cookies cookies[X11_DEVICES_MAX];
+	bool keyboards = false;
+
+	xcb_input_xi_device_info_iterator_t iter =
+		xcb_input_xi_query_device_infos_iterator(reply);
+
+	backend->devices_count = 0;
+
+	// devices past the limit are left out, their events use the core keymap
+	while ((iter.rem > 0) && (backend->devices_count < X11_DEVICES_MAX))
+	{
+		xcb_input_xi_device_info_t* info = iter.data;
+
+		// master devices only aggregate the events of their slaves
+		if ((info->type == XCB_INPUT_DEVICE_TYPE_SLAVE_POINTER)
+		|| (info->type == XCB_INPUT_DEVICE_TYPE_SLAVE_KEYBOARD))
+		{
+			struct x11_device* device =
+				&(backend->devices[backend->devices_count]);
+
+			struct x11_device zero = {0};
+			*device = zero;
+
+			device->id = info->deviceid;
+			device->keyboard =
+				(info->type == XCB_INPUT_DEVICE_TYPE_SLAVE_KEYBOARD);
+
+			// all the keymaps are identified with a single round trip
+			if (device->keyboard == true)
+			{
+				cookies[backend->devices_count] =
+					keymap_request(
+						backend->conn,
+						device->id);
+
+				keyboards = true;
+			}
+
+			++(backend->devices_count);
+		}
+
+		xcb_input_xi_device_info_next(&iter);
+	}
+
+	free(reply);
+
+	if (keyboards == true)
+	{
+		WILLIS_STATS_ADD(context, x11_round_trips, 1);
+	}
+
+	for (size_t i = 0; i < backend->devices_count; ++i)
+	{
+		struct x11_device* device = &(backend->devices[i]);
+
+		if (device->keyboard == true)
+		{
+			// layout changes of the device mark its keymap dirty,
+			// it then falls back to the core one if the selection failed
+			xcb_void_cookie_t cookie_select =
+				keyboard_select(
+					backend,
+					device->id,
+					XCB_XKB_EVENT_TYPE_NEW_KEYBOARD_NOTIFY
+					| XCB_XKB_EVENT_TYPE_MAP_NOTIFY);
+
+			xcb_discard_reply(backend->conn, cookie_select.sequence);
+
+			device_keymap(context, device, &(cookies[i]));
+		}
+	}
+
+	willis_error_ok(error);
+}
+
+void x11_helpers_devices_clean(
+	struct x11_backend* backend)
+{
+	for (size_t i = 0; i < backend->devices_count; ++i)
+	{
+		struct x11_device* device = &(backend->devices[i]);
+
+		if (device->xkb_own == true)
+		{
+			// the context and compose table belong to the core xkb struct
+			willis_xkb_clean(&(device->xkb));
+			device->xkb_own = false;
+		}
+	}
+
+	backend->devices_count = 0;
+}
+
+void x11_helpers_update_device_keymap(
+	struct willis* context,
+	struct x11_device* device)
+{
+	struct x11_backend* backend = context->backend_data;
+
+	device->keymap_dirty = false;
+
+	struct keymap_cookies cookies =
+		keymap_request(
+			backend->conn,
+			device->id);
+
+	WILLIS_STATS_ADD(context, x11_round_trips, 1);
+
+	// the state of the previous layout does not apply to the new one
+	if (device->xkb_own == true)
+	{
+		// the context and compose table belong to the core xkb struct
+		willis_xkb_clean(&(device->xkb));
+		device->xkb = (struct willis_xkb) {0};
+		device->xkb_own = false;
+	}
+
+	device_keymap(context, device, &cookies);
+}
+
+struct x11_device* x11_helpers_device_get(
+	struct x11_backend* backend,
+	uint16_t id)
+{
+	for (size_t i = 0; i < backend->devices_count; ++i)
+	{
+		if (backend->devices[i].id == id)
+		{
+			return &(backend->devices[i]);
+		}
+	}
+
+	return NULL;
+}
+
+// compiles the keymap the tables of the disk cache were loaded for
+static void keymap_compile(
+	struct willis* context,
+	struct willis_xkb* xkb_common,
+	struct willis_error_info* error)
+{
+	uint64_t hash = xkb_common->keymap_hash;
+
+	// another willis context might have compiled it since
+	if (willis_xkb_cache_use(xkb_common, hash) == true)
+	{
+		willis_error_ok(error);
+		return;
+	}
+
+	keymap_fetch(context, hash, error);
+
+	if (willis_error_get_code(error) != WILLIS_ERROR_OK)
+	{
+		return;
+	}
+
+	willis_xkb_cache_add(xkb_common, hash);
+}
+
+void x11_helpers_update_keymap(
+	struct willis* context,
+	struct willis_error_info* error)
+{
+	struct x11_backend* backend = context->backend_data;
+	struct willis_xkb* xkb_common = backend->xkb_common;
+	xcb_xkb_get_state_reply_t* reply_state = NULL;
+	uint64_t hash = 0;
+
+	backend->keymap_dirty = false;
+
+	// all requests are sent before waiting for the first reply
+	struct keymap_cookies cookies =
+		keymap_request(
+			backend->conn,
+			backend->xkb_device_id);
+
+	bool cache =
+		keymap_identify(
+			backend->conn,
+			&cookies,
+			&hash,
+			&reply_state);
+
+	WILLIS_STATS_ADD(context, x11_round_trips, 1);
+
+	// the keyboard devices using the core layout are told apart with it
+	backend->keymap_hash = (cache == true) ? hash : 0;
+
+	if (cache == true)
+	{
+		// switching back to a known layout only swaps pointers,
+		// and the tables of a layout met by an earlier run are enough to start
+		bool found = willis_xkb_cache_use(xkb_common, hash);
+
+		if (found == true)
+		{
+			WILLIS_STATS_ADD(context, keymap_cache_hits, 1);
+		}
+		else
+		{
+			found =
+				willis_xkb_keymap_load_table(
+					context,
+					xkb_common,
+					hash,
+					keymap_compile);
+		}
+
+		if (found == true)
+		{
+			willis_xkb_update_mask(
+				xkb_common,
+				reply_state->baseMods,
+				reply_state->latchedMods,
+				reply_state->lockedMods,
+				reply_state->baseGroup,
+				reply_state->latchedGroup,
+				reply_state->lockedGroup);
+
+			free(reply_state);
+			willis_error_ok(error);
+			return;
+		}
+	}
+
+	free(reply_state);
+
+	keymap_fetch(context, hash, error);
+
+	if (willis_error_get_code(error) != WILLIS_ERROR_OK)
+	{
 		return;
 	}
 
-	xkb_state_unref(xkb_common->state);
-	xkb_keymap_unref(xkb_common->keymap);
-	xkb_common->keymap = keymap;
-	xkb_common->state = state;
+	if (cache == true)
+	{
+		willis_xkb_cache_add(xkb_common, hash);
+		willis_xkb_keymap_save(context, xkb_common);
+	}
+
 	willis_error_ok(error);
 }
 
@@ -265,36 +934,47 @@ void x11_helpers_handle_xkb(
 	union willis_magic_xkb_event* xkb_event =
 		(union willis_magic_xkb_event*) event;
 
+	// the other keyboards only select the notifications of layout changes
 	if (xkb_event->magic.device_id != backend->xkb_device_id)
 	{
-        return;
+		struct x11_device* device =
+			x11_helpers_device_get(
+				backend,
+				xkb_event->magic.device_id);
+
+		if ((device != NULL)
+		&& ((xkb_event->magic.xkb_type == XCB_XKB_MAP_NOTIFY)
+		|| ((xkb_event->magic.xkb_type == XCB_XKB_NEW_KEYBOARD_NOTIFY)
+		&& ((xkb_event->keyboard.changed & XCB_XKB_NKN_DETAIL_KEYCODES) != 0))))
+		{
+			device->keymap_dirty = true;
+		}
+
+		return;
 	}
 
 	switch (xkb_event->magic.xkb_type)
 	{
+		// bursts of notifications are merged into a single rebuild
 		case XCB_XKB_NEW_KEYBOARD_NOTIFY:
 		{
 			if ((xkb_event->keyboard.changed & XCB_XKB_NKN_DETAIL_KEYCODES) != 0)
 			{
-				x11_helpers_update_keymap(
-					context,
-					error);
+				backend->keymap_dirty = true;
 			}
 
 			break;
 		}
 		case XCB_XKB_MAP_NOTIFY:
 		{
-			x11_helpers_update_keymap(
-				context,
-				error);
+			backend->keymap_dirty = true;
 
 			break;
 		}
 		case XCB_XKB_STATE_NOTIFY:
 		{
-			xkb_state_update_mask(
-				xkb_common->state,
+			willis_xkb_update_mask(
+				xkb_common,
 				xkb_event->state.baseMods,
 				xkb_event->state.latchedMods,
 				xkb_event->state.lockedMods,
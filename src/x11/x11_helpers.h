@@ -4,15 +4,42 @@
 #include "include/willis.h"
 #include "x11/x11.h"
 
-void x11_helpers_select_events_cursor(
+void x11_helpers_grab_cache(
+	struct willis* context);
+
+xcb_void_cookie_t x11_helpers_select_events_cursor(
 	struct willis* context,
 	uint32_t mask,
+	uint32_t mask_keyboard);
+
+xcb_void_cookie_t x11_helpers_select_events_window(
+	struct willis* context,
+	xcb_window_t window,
+	bool select);
+
+void x11_helpers_select_events_thread(
+	struct willis* context,
 	struct willis_error_info* error);
 
 void x11_helpers_select_events_keyboard(
 	struct willis* context,
 	struct willis_error_info* error);
 
+void x11_helpers_devices_init(
+	struct willis* context,
+	struct willis_error_info* error);
+
+void x11_helpers_devices_clean(
+	struct x11_backend* backend);
+
+void x11_helpers_update_device_keymap(
+	struct willis* context,
+	struct x11_device* device);
+
+struct x11_device* x11_helpers_device_get(
+	struct x11_backend* backend,
+	uint16_t id);
+
 void x11_helpers_update_keymap(
 	struct willis* context,
 	struct willis_error_info* error);